@@ -0,0 +1,11 @@
+SET(CMAKE_SYSTEM_NAME Linux)
+SET(CMAKE_SYSTEM_PROCESSOR aarch64)
+
+SET(CMAKE_C_COMPILER    aarch64-linux-gnu-gcc)
+SET(CMAKE_CXX_COMPILER  aarch64-linux-gnu-g++)
+
+SET(CMAKE_FIND_ROOT_PATH_MODE_PROGRAM NEVER)
+SET(CMAKE_FIND_ROOT_PATH_MODE_LIBRARY ONLY)
+SET(CMAKE_FIND_ROOT_PATH_MODE_INCLUDE ONLY)
+
+set(ENV{PKG_CONFIG_PATH} /opt/devkit/lib/pkgconfig)
@@ -1,9 +1,18 @@
 #include "gbm_egl_device_impl.hpp"
+#include "gbm_egl_options.hpp"
+#include "gbm_egl_util.hpp"
+#include "gbm_egl_kernels.hpp"
+#include "gbm_egl_trace.hpp"
+#include "gbm_egl_realtime.hpp"
+#include "gbm_egl_resources.hpp"
 #include <fcntl.h>
 #include <string.h>
 #include <iostream>
 #include <signal.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
 #define EGL_EGLEXT_PROTOTYPES
 #include <EGL/eglext.h>
 #include <GLES2/gl2.h>
@@ -11,350 +20,2135 @@
 #include <GLES2/gl2ext.h>
 #include <drm_fourcc.h>
 
+// gles 3.0, not in the gles2 headers
+#ifndef GL_READ_FRAMEBUFFER
+#define GL_READ_FRAMEBUFFER 0x8CA8
+#endif
+#ifndef GL_DRAW_FRAMEBUFFER
+#define GL_DRAW_FRAMEBUFFER 0x8CA9
+#endif
+
+typedef void (GL_APIENTRYP blit_framebuffer_proc)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1,
+                                                  GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1,
+                                                  GLbitfield mask, GLenum filter);
+static blit_framebuffer_proc blit_framebuffer = nullptr;
+
 std::atomic_bool gbm_egl_device_impl::running {true};
 
-uint16_t gbm_egl_device_impl::get_resolution_width()
+// from construction to the placeholder on screen
+static const double first_frame_target_ms = 300.0;
+
+uint16_t gbm_egl_device_impl::get_resolution_width()
+{
+    return drm.render_width;
+}
+
+
+uint16_t gbm_egl_device_impl::get_resolution_height()
+{
+    return drm.render_height;
+}
+
+
+bool gbm_egl_device_impl::render_target_flipped()
+{
+    return flip_y;
+}
+
+
+float gbm_egl_device_impl::render_scale() const
+{
+    return scaled.fbo ? governor.settings().render_scale : 1.0f;
+}
+
+
+bool gbm_egl_device_impl::create_texture(int width, int height, oes_texture& out_texture, TextureFormat format)
+{
+    int32_t bpp = 0;
+    EGLint egl_format = 0;
+    uint32_t gbm_format = 0;
+    switch (format)
+    {
+        case TextureFormat::Depth16:
+            egl_format = DRM_FORMAT_RGB565;
+            gbm_format = GBM_FORMAT_RGB565;
+            bpp = 2;
+            break;
+
+        case TextureFormat::YUYV:
+            egl_format = DRM_FORMAT_YUYV;
+            gbm_format = GBM_FORMAT_YUYV;
+            bpp = 2;
+            break;
+
+        case TextureFormat::RGB8:
+            // 24 bit buffers are rarely importable, expanded to rgbx on upload
+            egl_format = DRM_FORMAT_XBGR8888;
+            gbm_format = GBM_FORMAT_XBGR8888;
+            bpp = 4;
+            break;
+
+        default:
+            return false;
+            break;
+    }
+
+    // the camera copy writes rows straight into the mapping, so only a
+    // linear layout works here whatever else the gpu could sample
+    gbm_bo* bo = nullptr;
+    if (gbm_egl_options::get().modifiers)
+    {
+        const std::vector<uint64_t> sampled = egl_modifiers(egl_format, false);
+        const uint64_t linear = DRM_FORMAT_MOD_LINEAR;
+        if (sampled.empty() || std::find(sampled.begin(), sampled.end(), linear) != sampled.end())
+            bo = gbm_bo_create_with_modifiers(gbm.dev, width, height, gbm_format, &linear, 1);
+    }
+    if (!bo)
+        bo = gbm_bo_create(gbm.dev, width, height, gbm_format, GBM_BO_USE_RENDERING | GBM_BO_USE_SCANOUT | GBM_BO_USE_LINEAR);
+    if (!bo)
+    {
+        fprintf(stderr, "failed to create a gbm buffer.\n");
+        return false;
+    }
+    log_buffer("texture", bo);
+    // a driver that ignores the linear flag would have rows mapped here
+    // land somewhere else in its tiled layout
+    const uint64_t modifier = gbm_bo_get_modifier(bo);
+    if (modifier != DRM_FORMAT_MOD_LINEAR && modifier != DRM_FORMAT_MOD_INVALID)
+    {
+        fprintf(stderr, "camera texture buffer is not linear (modifier 0x%llx).\n", (unsigned long long)modifier);
+        gbm_bo_destroy(bo);
+        return false;
+    }
+
+    // rows are as far apart as the bo says, not width * bpp, for the image
+    // and for every mapping of it
+    const uint32_t stride = gbm_bo_get_stride(bo);
+    const size_t size = size_t(stride) * height;
+    resource_created(resource_kind::bo, bo, size, "camera texture");
+
+    // the image holds its own reference to the dma-buf
+    const int fd = gbm_bo_get_fd(bo);
+    const EGLint khr_image_attrs[] = {EGL_DMA_BUF_PLANE0_FD_EXT, fd,
+                                      EGL_WIDTH, width,
+                                      EGL_HEIGHT, height,
+                                      EGL_LINUX_DRM_FOURCC_EXT, egl_format,
+                                      EGL_DMA_BUF_PLANE0_PITCH_EXT, EGLint(stride),
+                                      EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+                                      EGL_NONE};
+    EGLImageKHR eglImage = fd >= 0 ? eglCreateImageKHR(gl.display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, khr_image_attrs)
+                                   : EGL_NO_IMAGE_KHR;
+    if (fd >= 0)
+        close(fd);
+    if (eglImage == EGL_NO_IMAGE_KHR)
+    {
+        fprintf(stderr, "failed to make image from buffer object.\n");
+        resource_destroyed(resource_kind::bo, bo);
+        gbm_bo_destroy(bo);
+        return false;
+    }
+    resource_created(resource_kind::image, eglImage, size, "camera texture");
+
+    struct drm_mode_map_dumb arg = {0};
+    arg.handle = gbm_bo_get_handle(bo).u32;
+    void* address = MAP_FAILED;
+    if (drmIoctl(drm.fd, DRM_IOCTL_MODE_MAP_DUMB, &arg) == 0)
+        address = mmap(0, size, PROT_WRITE, MAP_SHARED, drm.fd, arg.offset);
+    if (address == MAP_FAILED)
+    {
+        fprintf(stderr, "failed to map dma buffer.\n");
+        resource_destroyed(resource_kind::image, eglImage);
+        eglDestroyImageKHR(gl.display, eglImage);
+        resource_destroyed(resource_kind::bo, bo);
+        gbm_bo_destroy(bo);
+        return false;
+    }
+    resource_created(resource_kind::mapping, address, size, "camera texture");
+
+    // binding the image can stall for a while in the driver, the
+    // upload context does it and the texture is ready a frame later
+    GLuint glTexture = 0;
+    glGenTextures(1, &glTexture);
+    resource_created(resource_kind::texture, uint64_t(glTexture), 0, "camera texture");
+    const uint64_t upload = uploader.retarget(glTexture, eglImage);
+
+    out_texture.format = format;
+    out_texture.bpp = bpp;
+    out_texture.width = width;
+    out_texture.height = height;
+    out_texture.size = size;
+    out_texture.bo = bo;
+    out_texture.image = eglImage;
+    out_texture.id = glTexture;
+    out_texture.offset = arg.offset;
+    out_texture.dma = address;
+    out_texture.upload = upload;
+    return true;
+}
+
+
+void gbm_egl_device_impl::destroy_texture(oes_texture& texture)
+{
+    // the upload context may still be binding the image
+    if (!texture_ready(texture))
+        uploader.finish();
+
+    if (texture.id)
+    {
+        resource_destroyed(resource_kind::texture, uint64_t(texture.id));
+        glDeleteTextures(1, &texture.id), texture.id = 0;
+    }
+
+    if (texture.image)
+    {
+        resource_destroyed(resource_kind::image, texture.image);
+        eglDestroyImageKHR(gl.display, texture.image), texture.image = nullptr;
+    }
+
+    // the mapping made in create_texture, the same size as every other one
+    if (texture.dma)
+    {
+        resource_destroyed(resource_kind::mapping, texture.dma);
+        munmap(texture.dma, texture.size);
+    }
+
+    if (texture.bo)
+    {
+        resource_destroyed(resource_kind::bo, texture.bo);
+        gbm_bo_destroy(texture.bo);
+    }
+
+    texture = oes_texture();
+}
+
+
+bool gbm_egl_device_impl::acquire_texture(int width, int height, oes_texture& out_texture, TextureFormat format)
+{
+    for (auto it = texture_pool.rbegin(); it != texture_pool.rend(); ++it)
+    {
+        if (it->width == width && it->height == height && it->format == format)
+        {
+            out_texture = *it;
+            texture_pool.erase(std::next(it).base());
+            return true;
+        }
+    }
+
+    std::cout << "texture pool: allocating " << width << "x" << height << std::endl;
+    return create_texture(width, height, out_texture, format);
+}
+
+
+void gbm_egl_device_impl::release_texture(oes_texture& texture)
+{
+    if (!texture.bo)
+        return;
+
+    texture_pool.push_back(texture);
+    texture = oes_texture();
+    while (texture_pool.size() > texture_pool_limit)
+    {
+        destroy_texture(texture_pool.front());
+        texture_pool.erase(texture_pool.begin());
+    }
+}
+
+
+bool gbm_egl_device_impl::texture_ready(const oes_texture& texture) const
+{
+    return texture.upload <= uploader.completed();
+}
+
+
+bool gbm_egl_device_impl::update_texture(oes_texture& texture, const void* data)
+{
+    return update_texture(texture, data, texture.width, texture.height, ingest_window());
+}
+
+
+gbm_egl_device_impl::ingest_window gbm_egl_device_impl::clamp_window(ingest_window window, int frame_width, int frame_height, TextureFormat format)
+{
+    if ((window.decimate != 2 && window.decimate != 4) || format == TextureFormat::RGB8)
+        window.decimate = 1;
+    if (window.width <= 0 || window.height <= 0)
+        window.x = window.y = 0, window.width = frame_width, window.height = frame_height;
+
+    window.x = std::max(0, std::min(window.x, frame_width - 1));
+    window.y = std::max(0, std::min(window.y, frame_height - 1));
+    window.width = std::min(window.width, frame_width - window.x);
+    window.height = std::min(window.height, frame_height - window.y);
+
+    // yuyv pixel pairs share their chroma, the window starts on one and
+    // leaves an even number of pixels after decimation
+    const int pair = format == TextureFormat::YUYV ? 2 : 1;
+    window.x -= window.x % pair;
+    window.width -= window.width % (pair * window.decimate);
+    window.height -= window.height % window.decimate;
+    return window;
+}
+
+
+// one pixel pair out of every decimate pairs: y of the first pixel of each
+// and the chroma of its pair
+static void decimate_yuyv_row(uint8_t* dst, const uint8_t* src, int pairs, int decimate)
+{
+    uint32_t* out = (uint32_t*)dst;
+    for (int j = 0; j < pairs; ++j)
+    {
+        const uint8_t* first = src + 4 * j * decimate;
+        const uint8_t* second = first + 2 * decimate;
+        out[j] = uint32_t(first[0]) | uint32_t(first[1]) << 8 | uint32_t(second[0]) << 16 | uint32_t(first[3]) << 24;
+    }
+}
+
+
+// rows 2y, 2y + 1 (4x: 4y .. 4y + 3) of the window into output row y
+static void decimate_z16_row(uint16_t* dst, const uint8_t* src, size_t src_stride, int width, int decimate, bool nearest)
+{
+    const auto filter = nearest ? kernels().z16_min_2x2 : kernels().z16_median_2x2;
+    const uint16_t* row = (const uint16_t*)src;
+    const size_t step = src_stride / 2;
+    if (decimate == 2)
+    {
+        filter(dst, row, row + step, width);
+        return;
+    }
+
+    // 4x in two 2x steps, exact for min, a median of medians otherwise
+    uint16_t half[2][2048];
+    for (int x = 0; x < width; x += 1024)
+    {
+        const int span = std::min(width - x, 1024);
+        filter(half[0], row + 4 * x, row + step + 4 * x, 2 * span);
+        filter(half[1], row + 2 * step + 4 * x, row + 3 * step + 4 * x, 2 * span);
+        filter(dst + x, half[0], half[1], span);
+    }
+}
+
+
+bool gbm_egl_device_impl::update_texture(oes_texture& texture, const void* data, int frame_width, int frame_height,
+                                         const ingest_window& wanted, bool* changed)
+{
+    trace_span span("update_texture");
+    if (changed)
+        *changed = true;
+    if (!data || !texture.bo)
+        return false;
+
+    const ingest_window window = clamp_window(wanted, frame_width, frame_height, texture.format);
+    const int n = window.decimate;
+    if (window.width / n != texture.width || window.height / n != texture.height)
+        return false;
+
+    const int src_bpp = texture.format == TextureFormat::RGB8 ? 3 : texture.bpp;
+    const size_t src_stride = size_t(frame_width) * src_bpp;
+    const uint8_t* origin = (const uint8_t*)data + window.y * src_stride + window.x * src_bpp;
+    const int height = texture.height;
+    const size_t row = texture.size / height;
+    const size_t size = texture.size;
+    const bool whole = window.width == frame_width && n == 1;
+
+#if 1
+    // mmap fast
+    {
+        // populated in one go rather than a fault per page during the copy
+        const int populate = gbm_egl_options::get().lock_memory ? MAP_POPULATE : 0;
+        void* address = mmap(0, size, PROT_WRITE, MAP_SHARED | populate, drm.fd, texture.offset);
+        if (address != MAP_FAILED)
+        {
+            resource_created(resource_kind::mapping, address, size, "camera copy");
+            uint8_t* dst = (uint8_t*)address;
+            size_t written = size;
+            if (gbm_egl_options::get().dirty_tiles)
+            {
+                bool any = true;
+                written = update_tiles(texture, dst, origin, src_stride, window, any);
+                if (!any)
+                    unchanged_total.add();
+                if (changed)
+                    *changed = any;
+            }
+            else if (texture.format == TextureFormat::RGB8)
+            {
+                const uint32_t stride = gbm_bo_get_stride(texture.bo);
+                workers.parallel_rows(height, [&](int first, int last){
+                    for (int y = first; y < last; ++y)
+                        kernels().rgb_to_rgbx(dst + y * stride, origin + y * src_stride, texture.width);
+                });
+            }
+            else if (n > 1 && texture.format == TextureFormat::Depth16)
+            {
+                workers.parallel_rows(height, [&](int first, int last){
+                    for (int y = first; y < last; ++y)
+                        decimate_z16_row((uint16_t*)(dst + y * row), origin + y * n * src_stride, src_stride,
+                                         texture.width, n, window.depth_min);
+                });
+            }
+            else if (n > 1)
+            {
+                workers.parallel_rows(height, [&](int first, int last){
+                    for (int y = first; y < last; ++y)
+                        decimate_yuyv_row(dst + y * row, origin + y * n * src_stride, texture.width / 2, n);
+                });
+            }
+            else if (whole && row == src_stride)
+            {
+                workers.parallel_rows(height, [&](int first, int last){
+                    kernels().copy(dst + first * row, origin + first * row, (last - first) * row);
+                });
+            }
+            else
+            {
+                // cropped or a padded bo, the rows are apart in the frame or the texture
+                const size_t row_bytes = size_t(texture.width) * texture.bpp;
+                workers.parallel_rows(height, [&](int first, int last){
+                    for (int y = first; y < last; ++y)
+                        kernels().copy(dst + y * row, origin + y * src_stride, row_bytes);
+                });
+            }
+            resource_destroyed(resource_kind::mapping, address);
+            munmap(address, size);
+            uploaded_total.add();
+            camera_bytes_total.add(size_t(frame_height) * src_stride);
+            ingest_bytes_total.add(written);
+            return true;
+        }
+    }
+#else
+    // memcpy slow
+    if (texture.dma && whole)
+    {
+        kernels().copy(texture.dma, data, size);
+        return true;
+    }
+#endif
+    return false;
+}
+
+
+size_t gbm_egl_device_impl::update_tiles(oes_texture& texture, uint8_t* dst, const uint8_t* origin, size_t src_stride,
+                                         const ingest_window& window, bool& changed)
+{
+    const int n = window.decimate;
+    const int width = texture.width;
+    const int height = texture.height;
+    const int src_bpp = texture.format == TextureFormat::RGB8 ? 3 : texture.bpp;
+    const size_t dst_stride = texture.format == TextureFormat::RGB8 ? gbm_bo_get_stride(texture.bo) : texture.size / height;
+    const int tiles_x = (width + tile_width - 1) / tile_width;
+    const int tiles_y = (height + tile_height - 1) / tile_height;
+
+    // nothing written through this tracking yet, every tile is new
+    const bool all = texture.tile_hashes.size() != size_t(tiles_x) * tiles_y;
+    if (all)
+        texture.tile_hashes.assign(size_t(tiles_x) * tiles_y, 0);
+    // a hash collision leaves a tile stale at most until its row comes round
+    const int refresh = texture.refresh_row;
+    texture.refresh_row = (refresh + 1) % tiles_y;
+
+    // texels x .. x + count of texture row y
+    auto write_span = [&](int y, int x, int count){
+        const uint8_t* src = origin + size_t(y) * n * src_stride + size_t(x) * n * src_bpp;
+        if (texture.format == TextureFormat::RGB8)
+            kernels().rgb_to_rgbx(dst + y * dst_stride + x * 4, src, count);
+        else if (n > 1 && texture.format == TextureFormat::Depth16)
+            decimate_z16_row((uint16_t*)(dst + y * dst_stride) + x, src, src_stride, count, n, window.depth_min);
+        else if (n > 1)
+            decimate_yuyv_row(dst + y * dst_stride + x * 2, src, count / 2, n);
+        else
+            kernels().copy(dst + y * dst_stride + x * texture.bpp, src, size_t(count) * texture.bpp);
+    };
+
+    std::atomic<size_t> written {0};
+    std::atomic<int> tiles_changed {0};
+    std::atomic<int> tiles_written {0};
+    workers.parallel_rows(tiles_y, [&](int first, int last){
+        std::vector<uint8_t> dirty(tiles_x);
+        size_t bytes = 0;
+        int changes = 0;
+        int rewrites = 0;
+        for (int ty = first; ty < last; ++ty)
+        {
+            const int y0 = ty * tile_height;
+            const int rows = std::min(tile_height, height - y0);
+            for (int tx = 0; tx < tiles_x; ++tx)
+            {
+                const int x0 = tx * tile_width;
+                const int count = std::min(tile_width, width - x0);
+                const uint64_t hash = tile_hash(origin + size_t(y0) * n * src_stride + size_t(x0) * n * src_bpp,
+                                                src_stride, size_t(count) * n * src_bpp, rows * n);
+                uint64_t& known = texture.tile_hashes[size_t(ty) * tiles_x + tx];
+                const bool differs = all || hash != known;
+                known = hash;
+                changes += differs;
+                dirty[tx] = differs || ty == refresh;
+            }
+
+            // neighbouring dirty tiles are written as one span per row
+            for (int tx = 0; tx < tiles_x; )
+            {
+                if (!dirty[tx])
+                {
+                    ++tx;
+                    continue;
+                }
+                int end = tx;
+                while (end < tiles_x && dirty[end])
+                    ++end;
+                const int x0 = tx * tile_width;
+                const int count = std::min(end * tile_width, width) - x0;
+                for (int y = y0; y < y0 + rows; ++y)
+                    write_span(y, x0, count);
+                bytes += size_t(rows) * count * texture.bpp;
+                rewrites += end - tx;
+                tx = end;
+            }
+        }
+        written += bytes;
+        tiles_changed += changes;
+        tiles_written += rewrites;
+    });
+
+    tiles_total.add(size_t(tiles_x) * tiles_y);
+    tiles_written_total.add(tiles_written);
+    changed = tiles_changed > 0;
+    return written;
+}
+
+
+void gbm_egl_device_impl::set_source_timestamp(double timestamp_ms)
+{
+    source_timestamp = timestamp_ms;
+}
+
+
+void gbm_egl_device_impl::mark_startup(const char* event)
+{
+    timeline.mark(event);
+}
+
+
+void gbm_egl_device_impl::gpu_pass(const char* name)
+{
+    gpu_timer.begin_pass(name);
+}
+
+
+void gbm_egl_device_impl::placeholder_impl()
+{
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+
+void gbm_egl_device_impl::page_flip_done(const flip_info& flip, unsigned int sec, unsigned int usec)
+{
+    ++frames_flipped;
+    double flip_time = sec * 1000.0 + usec / 1000.0;
+    if (!flip_timestamp_monotonic)
+        flip_time -= realtime_ms() - monotonic_ms();
+    trace_instant(flip.async ? "flip done (async)" : "flip done", uint64_t(flip_time * 1000000.0));
+    // async flip events may carry the last vblank time, which can predate the
+    // frame, the time the event arrives is the better estimate there
+    if (flip.async)
+        flip_time = monotonic_ms();
+
+    // a vsync flip more than a refresh after the last one missed vblanks
+    if (!flip.async && last_flip_time > 0 && drm.mode && drm.mode->vrefresh)
+    {
+        const int vblanks = int((flip_time - last_flip_time) * drm.mode->vrefresh / 1000.0 + 0.5);
+        if (vblanks > 1)
+            flip_misses_total.add(vblanks - 1);
+    }
+    last_flip_time = flip_time;
+    flipped_total.add();
+
+    const double latency = flip_time - flip.render_start;
+    render_to_scanout.record(latency);
+    trace_counter("render to scanout us", int64_t(latency * 1000.0));
+    (flip.async ? present_async : present_vsync).record(latency);
+
+    // only the first flip that shows a camera frame counts, repeats of the
+    // same frame at display rate would skew the distribution
+    if (flip.source_timestamp <= 0 || flip.source_timestamp == last_source_timestamp)
+        return;
+    last_source_timestamp = flip.source_timestamp;
+    glass_to_glass.record(flip_time + realtime_ms() - monotonic_ms() - flip.source_timestamp);
+
+    if (!timeline_printed)
+    {
+        timeline.mark("first camera frame on screen");
+        timeline.print("placeholder on screen", first_frame_target_ms);
+        timeline_printed = true;
+    }
+}
+
+
+void gbm_egl_device_impl::report_stats(bool final)
+{
+    const double now = monotonic_ms();
+    const double elapsed = (now - last_report_time) / 1000.0;
+    if (!final && elapsed < 5.0)
+        return;
+    last_report_time = now;
+
+    if (final && !timeline_printed)
+    {
+        timeline.print("placeholder on screen", first_frame_target_ms);
+        timeline_printed = true;
+    }
+
+    fprintf(stdout, "rendered %.1f fps, displayed %.1f fps, replaced %llu\n",
+                    (frames_rendered - last_frames_rendered) / elapsed,
+                    (frames_flipped - last_frames_flipped) / elapsed,
+                    (unsigned long long)frames_replaced);
+    last_frames_rendered = frames_rendered;
+    last_frames_flipped = frames_flipped;
+
+    // what cropping and decimation save on the way into the textures
+    const uint64_t camera_bytes = camera_bytes_total.value.load(std::memory_order_relaxed);
+    const uint64_t ingest_bytes = ingest_bytes_total.value.load(std::memory_order_relaxed);
+    if (camera_bytes > last_camera_bytes)
+        fprintf(stdout, "ingest %.1f MB/s of camera frames, %.1f MB/s copied (%.0f%%)\n",
+                        (camera_bytes - last_camera_bytes) / elapsed / 1e6,
+                        (ingest_bytes - last_ingest_bytes) / elapsed / 1e6,
+                        100.0 * (ingest_bytes - last_ingest_bytes) / (camera_bytes - last_camera_bytes));
+    last_camera_bytes = camera_bytes;
+    last_ingest_bytes = ingest_bytes;
+    const uint64_t tiles = tiles_total.value.load(std::memory_order_relaxed);
+    const uint64_t tiles_written = tiles_written_total.value.load(std::memory_order_relaxed);
+    if (tiles > last_tiles)
+        fprintf(stdout, "dirty tiles: %.0f%% rewritten, %llu texture updates unchanged so far\n",
+                        100.0 * (tiles_written - last_tiles_written) / (tiles - last_tiles),
+                        (unsigned long long)unchanged_total.value.load(std::memory_order_relaxed));
+    last_tiles = tiles;
+    last_tiles_written = tiles_written;
+
+    // where the frame budget goes: cpu stages, gpu passes, display
+    cpu_update.print();
+    cpu_render.print();
+    if (cpu_hud.count())
+        cpu_hud.print();
+    gpu_timer.print();
+    uploader.print();
+    glass_to_glass.print();
+    render_to_scanout.print();
+    if (fence_wait.count())
+        fence_wait.print();
+    // median and tail of each presentation path side by side
+    for (const latency_histogram* present : { &present_vsync, &present_async, &present_front })
+    {
+        if (present->count() && present->count() != render_to_scanout.count())
+            present->print();
+    }
+
+    const char* stats_file = gbm_egl_options::get().stats_file;
+    if (final && stats_file)
+    {
+        FILE* file = fopen(stats_file, "w");
+        if (file)
+        {
+            cpu_update.dump(file);
+            cpu_render.dump(file);
+            cpu_hud.dump(file);
+            gpu_timer.dump(file);
+            uploader.dump(file);
+            glass_to_glass.dump(file);
+            render_to_scanout.dump(file);
+            fence_wait.dump(file);
+            present_vsync.dump(file);
+            present_async.dump(file);
+            present_front.dump(file);
+            fclose(file);
+        }
+        else
+        {
+            std::cerr << "failed to open stats file " << stats_file << ": " << strerror(errno) << std::endl;
+        }
+    }
+
+    const char* bench_json = gbm_egl_options::get().bench_json;
+    if (final && bench_json)
+        write_bench_json(bench_json);
+}
+
+
+void gbm_egl_device_impl::write_bench_json(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        std::cerr << "failed to open bench results " << path << ": " << strerror(errno) << std::endl;
+        return;
+    }
+
+    // stopped before the frame limit, the threads may be gone by now
+    if (thread_times.empty())
+    {
+        run_end = monotonic_ms();
+        thread_times = thread_cpu_times();
+    }
+    const double seconds = run_start > 0 ? (run_end - run_start) / 1000.0 : 0.0;
+
+    fprintf(file, "{\n  \"frames\": %llu,\n  \"seconds\": %.3f,\n  \"fps\": %.2f,\n  \"width\": %u,\n  \"height\": %u,\n",
+                  (unsigned long long)frames_rendered, seconds, seconds > 0 ? frames_rendered / seconds : 0.0,
+                  drm.render_width, drm.render_height);
+    fprintf(file, "  \"threads\": [");
+    for (size_t i = 0; i < thread_times.size(); ++i)
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"user_ms\": %.1f, \"system_ms\": %.1f}", i ? "," : "",
+                      thread_times[i].name.c_str(), thread_times[i].user_ms, thread_times[i].system_ms);
+    fprintf(file, "\n  ],\n");
+
+    std::vector<const latency_histogram*> extra = gpu_timer.histograms();
+    for (const latency_histogram* histogram : uploader.histograms())
+        extra.push_back(histogram);
+    for (const latency_histogram* histogram : { &cpu_hud, &present_vsync, &present_async, &present_front })
+    {
+        if (histogram->count())
+            extra.push_back(histogram);
+    }
+    // the metrics object goes on where this one left off, past its opening brace
+    const std::string metrics = metrics_json(extra);
+    fputs(metrics.c_str() + 2, file);
+    fputs("\n", file);
+    fclose(file);
+    std::cout << "bench results written to " << path << std::endl;
+}
+
+
+gbm_egl_device_impl::~gbm_egl_device_impl()
+{
+    if (drm.crtc)
+    {
+        drmModeSetCrtc(drm.fd, drm.crtc->crtc_id, drm.crtc->buffer_id,
+                       drm.crtc->x, drm.crtc->y, &drm.connector->connector_id,
+                                    1, &drm.crtc->mode);
+        drmModeFreeCrtc(drm.crtc);
+    }
+
+    destroy_render_targets();
+    destroy_scaled_target();
+    // the last commit's, no buffer took it over
+    if (commit_out_fence >= 0)
+        close(commit_out_fence), commit_out_fence = -1;
+    for (oes_texture& texture : texture_pool)
+        destroy_texture(texture);
+    texture_pool.clear();
+    workers.stop();
+    metrics_shutdown();
+    trace_shutdown();
+
+    if (gl.display)
+    {
+        uploader.shutdown();
+        hud.destroy();
+        gpu_timer.destroy();
+        if (gl.surface)
+	        eglDestroySurface(gl.display, gl.surface);
+        if (gl.context)
+            eglDestroyContext(gl.display, gl.context);
+        eglTerminate(gl.display);
+    }
+
+    if (gbm.surface)
+        gbm_surface_destroy(gbm.surface);
+    if (gbm.dev)
+        gbm_device_destroy(gbm.dev);
+
+    if (drm.connector)
+        drmModeFreeConnector(drm.connector);
+    if (drm.encoder)
+        drmModeFreeEncoder(drm.encoder);
+    if (drm.resources)
+        drmModeFreeResources(drm.resources);
+    if (drm.fd > 0)
+        drmClose(drm.fd);
+    // everything the pipeline made should be gone by now
+    const std::string leftover = resources_report();
+    if (!leftover.empty())
+        std::cerr << "resources still alive at exit:\n" << leftover;
+}
+
+
+bool gbm_egl_device_impl::create_impl(uint16_t resolution_w, uint16_t resolution_h)
+{
+    const auto& options = gbm_egl_options::get();
+    trace_init(options.trace_file, !options.trace_paused);
+    for (const latency_histogram* histogram : { &cpu_update, &cpu_render, &glass_to_glass, &render_to_scanout, &fence_wait })
+        metrics_histogram(*histogram);
+    metrics_init(options.metrics);
+
+    timeline.mark("create");
+    workers.start(options.workers);
+    std::cout << workers.size() << (workers.size() > 1 ? " cores" : " core") << " for per-frame cpu work" << std::endl;
+    prepare_impl();
+
+    return init_drm(resolution_w, resolution_h) && 
+           init_gbm() && 
+           init_gl();
+}
+
+
+void gbm_egl_device_impl::main_loop_impl()
+{
+    std::cout << "main_loop_impl" << std::endl;
+    trace_thread_name("render");
+    const auto& options = gbm_egl_options::get();
+
+    // a refresh interval, half of it reserved for rendering under deadline
+    thread_profile render;
+    render.policy = parse_rt_policy(options.realtime);
+    render.priority = 50;
+    render.period_ms = drm.mode && drm.mode->vrefresh ? 1000.0 / drm.mode->vrefresh : 16.7;
+    render.runtime_ms = render.period_ms * 0.5;
+    render.cpu = options.render_cpu;
+    apply_thread_profile("render", render);
+    // everything the loops need is allocated by now
+    if (options.lock_memory && lock_memory())
+        std::cout << "memory locked" << std::endl;
+
+    // handle Ctrl+C
+    signal(SIGINT, [](int){ running = false; });
+
+    // page flip timestamps are CLOCK_MONOTONIC on any recent kernel
+    uint64_t cap = 0;
+    flip_timestamp_monotonic = drmGetCap(drm.fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap) == 0 && cap;
+    last_report_time = monotonic_ms();
+
+    if (options.present == present_mode::surface && options.explicit_sync)
+        std::cout << "explicit sync needs own scanout buffers, using fifo" << std::endl;
+    else if (options.present == present_mode::async && options.explicit_sync)
+        std::cout << "async flips do not go through atomic commits, explicit sync runs as fifo" << std::endl;
+
+    if (options.present == present_mode::offscreen)
+        offscreen_loop();
+    else if (options.present == present_mode::front)
+        front_buffer_loop();
+    else if ((options.present == present_mode::surface || options.present == present_mode::async) && !options.explicit_sync)
+        surface_loop();
+    else
+        swapchain_loop();
+}
+
+
+bool gbm_egl_device_impl::handle_events(int timeout_ms)
+{
+    static drmEventContext evctx = { DRM_EVENT_CONTEXT_VERSION, 0, 
+                                     [](int fd, unsigned int frame, unsigned int sec, unsigned int usec, void* data){
+                                         flip_info* flip = (flip_info*)data;
+                                         flip->waiting = 0;
+                                         flip->device->page_flip_done(*flip, sec, usec);
+                                   }};
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(0, &fds);
+    FD_SET(drm.fd, &fds);
+
+    timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    int ret = select(drm.fd + 1, &fds, nullptr, nullptr, timeout_ms < 0 ? nullptr : &timeout);
+    wakeups_total.add();
+    if (ret < 0)
+    {
+        std::cerr << "select err: " << strerror(errno) << std::endl;
+        return false;
+    }
+    else if (ret == 0)
+    {
+        if (timeout_ms < 0)
+        {
+            std::cerr << "select timeout!" << std::endl;
+            return false;
+        }
+    }
+    else if (FD_ISSET(0, &fds))
+    {
+        std::cout << "user interrupted!" << std::endl;
+        return false;
+    }
+    else
+    {
+        drmHandleEvent(drm.fd, &evctx);
+    }
+
+    return true;
+}
+
+
+void gbm_egl_device_impl::render_frame(double& frame_source_timestamp)
+{
+    frame_source_timestamp = source_timestamp;
+    gpu_timer.begin_frame();
+    uploader.poll();
+
+    // the upscale blit writes wherever the frame was meant to go
+    GLint target_fbo = 0;
+    if (scaled.fbo)
+    {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, scaled.fbo);
+        glViewport(0, 0, scaled.width, scaled.height);
+    }
+
+    const double update_start = monotonic_ms();
+    if (run_start == 0)
+        run_start = update_start;
+    if (last_frame_start > 0)
+        hud.add_frame_time(update_start - last_frame_start);
+    last_frame_start = update_start;
+    {
+        trace_span span("update_impl");
+        update_impl();
+    }
+    const double render_start = monotonic_ms();
+    cpu_update.record(render_start - update_start);
+    {
+        trace_span span("render_impl");
+        render_impl();
+    }
+    const double render_end = monotonic_ms();
+    cpu_render.record(render_end - render_start);
+
+    if (scaled.fbo)
+    {
+        gpu_timer.begin_pass("upscale");
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, scaled.fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target_fbo);
+        blit_framebuffer(0, 0, scaled.width, scaled.height,
+                         0, 0, get_resolution_width(), get_resolution_height(),
+                         GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, target_fbo);
+        glViewport(0, 0, get_resolution_width(), get_resolution_height());
+    }
+
+    if (gbm_egl_options::get().latency_barcode)
+    {
+        gpu_timer.begin_pass("barcode");
+        const int height = 32;
+        const int y = render_target_flipped() ? get_resolution_height() - height : 0;
+        draw_barcode(uint32_t(uint64_t(frame_source_timestamp)), 0, y, get_resolution_width(), height);
+    }
+    if (hud_enabled)
+    {
+        // timed like any other pass, so its own cost shows on it
+        gpu_timer.begin_pass("hud");
+        const double hud_start = monotonic_ms();
+        update_hud();
+        hud.draw(get_resolution_width(), get_resolution_height(), render_target_flipped());
+        cpu_hud.record(monotonic_ms() - hud_start);
+    }
+    gpu_timer.end_pass();
+
+    ++frames_rendered;
+    rendered_total.add();
+    upload_jobs.set(uploader.submitted() - uploader.completed());
+
+    if (governor_enabled)
+        govern(render_end - update_start);
+
+    // a fixed length run, threads sampled while all of them are still up
+    const int frame_limit = gbm_egl_options::get().frames;
+    if (frame_limit > 0 && frames_rendered == uint64_t(frame_limit))
+    {
+        run_end = monotonic_ms();
+        thread_times = thread_cpu_times();
+        running = false;
+    }
+}
+
+
+void gbm_egl_device_impl::govern(double cpu_ms)
+{
+    const uint64_t misses = flip_misses_total.value.load(std::memory_order_relaxed);
+    const int missed = int(misses - governor_misses);
+    governor_misses = misses;
+
+    const int previous = governor.level();
+    if (!governor.update(cpu_ms, gpu_timer.last_frame_ms(), missed))
+        return;
+
+    const quality_level& level = governor.settings();
+    const bool down = governor.level() > previous;
+    (down ? quality_down_total : quality_up_total).add();
+    quality_level_gauge.set(governor.level());
+    trace_counter("quality level", governor.level());
+    std::cout << "quality " << (down ? "down" : "up") << " to level " << governor.level()
+              << " (" << level.name << "): " << governor.reason() << std::endl;
+
+    // takes effect from the next frame on
+    destroy_scaled_target();
+    if (level.render_scale < 1.0f && !create_scaled_target(level.render_scale))
+        governor.set_scaling(false);
+    quality_impl(level);
+}
+
+
+void gbm_egl_device_impl::update_hud()
+{
+    // quantiles walk every bucket, a few refreshes a second are plenty
+    const double now = monotonic_ms();
+    if (now - hud_text_time < 250.0)
+        return;
+    const double fps = hud_text_time > 0 ? (frames_rendered - hud_frames) * 1000.0 / (now - hud_text_time) : 0.0;
+    hud_text_time = now;
+    hud_frames = frames_rendered;
+
+    std::vector<std::string> lines;
+    char line[96];
+    snprintf(line, sizeof(line), "FPS %.1f  FRAME %.2f MS", fps, fps > 0 ? 1000.0 / fps : 0.0);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "CPU P50 UPDATE %.2f RENDER %.2f HUD %.2f MS",
+             cpu_update.quantile(0.5), cpu_render.quantile(0.5), cpu_hud.quantile(0.5));
+    lines.push_back(line);
+    const latency_histogram* gpu_hud = gpu_timer.pass_histogram("hud");
+    if (gpu_timer.supported())
+        snprintf(line, sizeof(line), "GPU P50 FRAME %.2f HUD %.3f MS",
+                 gpu_timer.frame_histogram().quantile(0.5), gpu_hud ? gpu_hud->quantile(0.5) : 0.0);
+    else
+        snprintf(line, sizeof(line), "GPU TIMING N/A");
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "P50 GLASS %.1f SCANOUT %.1f MS",
+             glass_to_glass.quantile(0.5), render_to_scanout.quantile(0.5));
+    lines.push_back(line);
+    if (governor_enabled)
+    {
+        snprintf(line, sizeof(line), "QUALITY LEVEL %d RENDER %d%%", governor.level(), int(render_scale() * 100.0f + 0.5f));
+        lines.push_back(line);
+    }
+    snprintf(line, sizeof(line), "DROPPED %llu MISSED %llu REPLACED %llu",
+             (unsigned long long)camera_dropped_total.value.load(),
+             (unsigned long long)flip_misses_total.value.load(),
+             (unsigned long long)replaced_total.value.load());
+    lines.push_back(line);
+    hud.set_text(lines);
+}
+
+
+void gbm_egl_device_impl::surface_loop()
+{
+    const auto& options = gbm_egl_options::get();
+    bool async = options.present == present_mode::async && async_flip_supported();
+    const double compare_interval = options.present_compare * 1000.0;
+
+    placeholder_impl();
+    eglSwapBuffers(gl.display, gl.surface);
+
+    gbm_bo* bo = gbm_surface_lock_front_buffer(gbm.surface);
+    drm_fb* fb = drm_fb_get_from_bo(bo);
+
+    // set mode:
+    if (set_crtc(fb->fb_id))
+    {
+        timeline.mark("placeholder on screen");
+        begin_impl();
+        timeline.mark("renderer ready");
+
+        const double loop_start = monotonic_ms();
+        bool local_working = true;
+        while (local_working && running)
+        {
+            flip_info flip;
+            flip.waiting = 1;
+            flip.device = this;
+            flip.render_start = monotonic_ms();
+            // alternate between async and vsync flips to compare both under the same load
+            flip.async = async && (compare_interval <= 0 || int((flip.render_start - loop_start) / compare_interval) % 2 == 0);
+            render_frame(flip.source_timestamp);
+
+            {
+                trace_span span("eglSwapBuffers");
+                eglSwapBuffers(gl.display, gl.surface);
+            }
+            gbm_bo* next_bo = gbm_surface_lock_front_buffer(gbm.surface);
+            fb = drm_fb_get_from_bo(next_bo);
+
+            // Here you could also update drm plane layers if you want hw composition
+
+            int ret;
+            {
+                trace_span span("drmModePageFlip");
+                ret = drmModePageFlip(drm.fd, drm.crtc_id, fb->fb_id, 
+                    DRM_MODE_PAGE_FLIP_EVENT | (flip.async ? DRM_MODE_PAGE_FLIP_ASYNC : 0), &flip);
+            }
+            if (ret && flip.async && errno == EINVAL)
+            {
+                std::cerr << "kernel driver rejected async page flip, falling back to vsync" << std::endl;
+                async = flip.async = false;
+                ret = drmModePageFlip(drm.fd, drm.crtc_id, fb->fb_id, DRM_MODE_PAGE_FLIP_EVENT, &flip);
+            }
+            if (ret)
+            {
+                std::cerr << "failed to queue page flip: " << strerror(errno) << std::endl;
+                break;
+            }
+
+            while (flip.waiting)
+            {
+                if (!handle_events(-1))
+                {
+                    running = false;
+                    break;
+                }
+            }
+
+            // release last buffer to render on again:
+            gbm_surface_release_buffer(gbm.surface, bo);
+            bo = next_bo;
+
+            report_stats(false);
+        }
+
+        end_impl();
+        report_stats(true);
+    }
+    else
+    {
+        std::cerr << "failed to set mode: " << strerror(errno) << std::endl;
+    }
+}
+
+
+bool gbm_egl_device_impl::async_flip_supported()
+{
+    uint64_t cap = 0;
+    if (drmGetCap(drm.fd, DRM_CAP_ASYNC_PAGE_FLIP, &cap) == 0 && cap)
+        return true;
+
+    std::cerr << "kernel driver does not support async page flips, falling back to vsync" << std::endl;
+    return false;
+}
+
+
+void gbm_egl_device_impl::front_buffer_loop()
+{
+    // a single buffer that stays on screen, every frame is drawn straight into it
+    if (!create_render_targets(1))
+    {
+        std::cerr << "no scanout render target, front buffer rendering not supported" << std::endl;
+        destroy_render_targets();
+        flip_y = false;
+        surface_loop();
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targets[0].fbo);
+    placeholder_impl();
+    glFinish();
+
+    if (!set_crtc(targets[0].fb->fb_id))
+    {
+        std::cerr << "failed to set mode, front buffer rendering not supported: " << strerror(errno) << std::endl;
+        destroy_render_targets();
+        flip_y = false;
+        surface_loop();
+        return;
+    }
+
+    std::cout << "front buffer rendering" << std::endl;
+    timeline.mark("placeholder on screen");
+    begin_impl();
+    timeline.mark("renderer ready");
+
+    render_target& target = targets[0];
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    bool dirty_failed = false;
+    while (running)
+    {
+        flip_info frame;
+        frame.render_start = monotonic_ms();
+        render_frame(frame.source_timestamp);
+
+        // the frame is visible as soon as the gpu is done, scanout picks it up
+        // wherever the beam is
+        EGLSyncKHR sync = eglCreateSyncKHR(gl.display, EGL_SYNC_FENCE_KHR, nullptr);
+        if (sync != EGL_NO_SYNC_KHR)
+        {
+            eglClientWaitSyncKHR(gl.display, sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+            eglDestroySyncKHR(gl.display, sync);
+        }
+        else
+        {
+            glFinish();
+        }
+
+        // drivers that track damage or update the panel on request (command
+        // mode dsi, virtio-gpu, udl) only show what they are told changed
+        const int dirty = drmModeDirtyFB(drm.fd, target.fb->fb_id, nullptr, 0);
+        if (dirty != 0 && dirty != -ENOSYS && !dirty_failed)
+        {
+            std::cerr << "failed to mark the front buffer dirty: " << strerror(-dirty) << std::endl;
+            dirty_failed = true;
+        }
+
+        const double done = monotonic_ms();
+        ++frames_flipped;
+        flipped_total.add();
+        render_to_scanout.record(done - frame.render_start);
+        present_front.record(done - frame.render_start);
+        if (frame.source_timestamp > 0 && frame.source_timestamp != last_source_timestamp)
+        {
+            last_source_timestamp = frame.source_timestamp;
+            glass_to_glass.record(done + realtime_ms() - monotonic_ms() - frame.source_timestamp);
+        }
+
+        if (!handle_events(0))
+        {
+            running = false;
+            break;
+        }
+
+        report_stats(false);
+    }
+
+    end_impl();
+    report_stats(true);
+}
+
+
+void gbm_egl_device_impl::offscreen_loop()
+{
+    // one frame rendering while the previous one finishes, like fifo without
+    // waiting for vblank
+    const int depth = 2;
+    if (!create_render_targets(depth, false))
+        return;
+
+    std::cout << "offscreen: " << get_resolution_width() << "x" << get_resolution_height() << ", "
+              << depth << " buffers" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targets[0].fbo);
+    placeholder_impl();
+    glFinish();
+
+    flip_info flip;
+    flip.device = this;
+    // completions are stamped here, on the monotonic clock
+    flip_timestamp_monotonic = true;
+    std::deque<int> in_flight;
+
+    // the fence of a frame stands in for its page flip
+    auto retire = [&](){
+        render_target& target = targets[in_flight.front()];
+        in_flight.pop_front();
+        const double wait_start = monotonic_ms();
+        if (target.sync)
+        {
+            trace_span span("fence wait");
+            eglClientWaitSyncKHR(gl.display, target.sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+            eglDestroySyncKHR(gl.display, target.sync);
+            target.sync = nullptr;
+        }
+        const double done = monotonic_ms();
+        fence_wait.record(done - wait_start);
+
+        flip.render_start = target.render_start;
+        flip.source_timestamp = target.source_timestamp;
+        const unsigned int sec = unsigned(done / 1000.0);
+        page_flip_done(flip, sec, unsigned((done - sec * 1000.0) * 1000.0));
+    };
+
+    timeline.mark("placeholder on screen");
+    begin_impl();
+    timeline.mark("renderer ready");
+
+    int next = 0;
+    while (running)
+    {
+        render_into_target(next);
+        in_flight.push_back(next);
+        next = (next + 1) % depth;
+        if (int(in_flight.size()) == depth)
+            retire();
+        report_stats(false);
+    }
+
+    while (!in_flight.empty())
+        retire();
+
+    end_impl();
+    report_stats(true);
+}
+
+
+void gbm_egl_device_impl::swapchain_loop()
+{
+    const auto& options = gbm_egl_options::get();
+    const bool mailbox = options.present == present_mode::mailbox;
+
+    // fifo needs one buffer on screen and one to render into, mailbox one more
+    // so that a finished frame can wait while the next one is rendered
+    int depth = options.swapchain_depth ? options.swapchain_depth : 3;
+    depth = std::max(depth, mailbox ? 3 : 2);
+    depth = std::min(depth, 8);
+    if (!create_render_targets(depth))
+        return;
+
+    explicit_sync = options.explicit_sync && init_explicit_sync();
+
+    std::cout << "swapchain: " << (mailbox ? "mailbox" : "fifo") << ", " << depth << " buffers, "
+              << (explicit_sync ? "explicit" : "implicit") << " sync" << std::endl;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, targets[0].fbo);
+    placeholder_impl();
+    glFinish();
+
+    if (!set_crtc(targets[0].fb->fb_id))
+    {
+        std::cerr << "failed to set mode: " << strerror(errno) << std::endl;
+        return;
+    }
+
+    std::deque<int> free_targets;
+    std::deque<int> queued_targets;
+    for (int i = 1; i < depth; ++i)
+        free_targets.push_back(i);
+    int scanout_target = 0;
+    int pending_target = -1;
+
+    flip_info flip;
+    flip.device = this;
+
+    timeline.mark("placeholder on screen");
+    begin_impl();
+    timeline.mark("renderer ready");
+
+    while (running)
+    {
+        // hand the oldest finished frame to the display
+        if (pending_target < 0 && !queued_targets.empty())
+        {
+            const int next = queued_targets.front();
+            queued_targets.pop_front();
+
+            if (!present_target(next, flip))
+                break;
+            pending_target = next;
+
+            // with an out fence the old buffer can be handed back right away,
+            // the gpu waits for the fence before drawing into it again
+            if (explicit_sync)
+            {
+                targets[scanout_target].release_fence = commit_out_fence;
+                commit_out_fence = -1;
+                free_targets.push_back(scanout_target);
+                scanout_target = next;
+            }
+        }
+
+        int next = -1;
+        if (!free_targets.empty())
+        {
+            next = free_targets.front();
+            free_targets.pop_front();
+        }
+        else if (mailbox && !queued_targets.empty())
+        {
+            // everything else is on screen or about to be, overwrite the queued frame
+            next = queued_targets.front();
+            queued_targets.pop_front();
+            discard_target(next);
+            ++frames_replaced;
+            replaced_total.add();
+        }
+
+        bool ok = true;
+        if (next >= 0)
+        {
+            render_into_target(next);
+
+            // the newest finished frame replaces the one still waiting
+            if (mailbox)
+            {
+                for (int replaced : queued_targets)
+                {
+                    discard_target(replaced);
+                    free_targets.push_back(replaced);
+                }
+                frames_replaced += queued_targets.size();
+                replaced_total.add(queued_targets.size());
+                queued_targets.clear();
+            }
+            queued_targets.push_back(next);
+            trace_counter("queued frames", queued_targets.size());
+            queued_frames.set(queued_targets.size());
+
+            // pick up a completed flip without blocking
+            ok = handle_events(0);
+        }
+        else
+        {
+            ok = handle_events(-1);
+        }
+
+        if (!ok)
+        {
+            running = false;
+            break;
+        }
+
+        if (pending_target >= 0 && !flip.waiting)
+        {
+            if (!explicit_sync)
+            {
+                free_targets.push_back(scanout_target);
+                scanout_target = pending_target;
+            }
+            pending_target = -1;
+        }
+
+        report_stats(false);
+    }
+
+    // the flip event still refers to this frame. it never comes when the
+    // crtc went off or the device is gone, a timeout does not end the wait
+    // by itself
+    for (int tries = 0; pending_target >= 0 && flip.waiting; ++tries)
+    {
+        if (tries == 3)
+        {
+            std::cerr << "no page flip event after " << tries << " s, shutting down without it" << std::endl;
+            break;
+        }
+        if (!handle_events(1000))
+            break;
+    }
+
+    end_impl();
+    report_stats(true);
+}
+
+
+void gbm_egl_device_impl::discard_target(int index)
+{
+    render_target& target = targets[index];
+    if (target.sync)
+        eglDestroySyncKHR(gl.display, target.sync), target.sync = nullptr;
+    if (target.render_fence >= 0)
+        close(target.render_fence), target.render_fence = -1;
+}
+
+
+void gbm_egl_device_impl::render_into_target(int index)
+{
+    render_target& target = targets[index];
+    // nothing should be left over, but a frame that never went out could
+    discard_target(index);
+
+    // let the gpu, not the cpu, wait until the buffer has left scanout
+    if (target.release_fence >= 0)
+    {
+        const EGLint attrs[] = { EGL_SYNC_NATIVE_FENCE_FD_ANDROID, target.release_fence, EGL_NONE };
+        EGLSyncKHR release = eglCreateSyncKHR(gl.display, EGL_SYNC_NATIVE_FENCE_ANDROID, attrs);
+        if (release != EGL_NO_SYNC_KHR)
+        {
+            // egl owns the fd now
+            eglWaitSyncKHR(gl.display, release, 0);
+            eglDestroySyncKHR(gl.display, release);
+        }
+        else
+        {
+            close(target.release_fence);
+        }
+        target.release_fence = -1;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    target.render_start = monotonic_ms();
+    render_frame(target.source_timestamp);
+
+    if (explicit_sync)
+    {
+        const EGLint attrs[] = { EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID, EGL_NONE };
+        EGLSyncKHR sync = eglCreateSyncKHR(gl.display, EGL_SYNC_NATIVE_FENCE_ANDROID, attrs);
+        // the native fence fd only exists once the commands are flushed
+        glFlush();
+        if (sync != EGL_NO_SYNC_KHR)
+        {
+            target.render_fence = eglDupNativeFenceFDANDROID(gl.display, sync);
+            eglDestroySyncKHR(gl.display, sync);
+        }
+        if (target.render_fence < 0)
+            glFinish();
+        return;
+    }
+
+    target.sync = eglCreateSyncKHR(gl.display, EGL_SYNC_FENCE_KHR, nullptr);
+    if (target.sync == EGL_NO_SYNC_KHR)
+    {
+        target.sync = nullptr;
+        glFinish();
+    }
+    else
+    {
+        glFlush();
+    }
+}
+
+
+bool gbm_egl_device_impl::present_target(int index, flip_info& flip)
+{
+    render_target& target = targets[index];
+
+    flip.waiting = 1;
+    flip.render_start = target.render_start;
+    flip.source_timestamp = target.source_timestamp;
+
+    if (explicit_sync)
+    {
+        // the kernel waits for the render fence and reports through the
+        // out fence when the buffer that is replaced has left scanout
+        drmModeAtomicReq* req = drmModeAtomicAlloc();
+        drmModeAtomicAddProperty(req, drm.plane_id, drm.prop_fb_id, target.fb->fb_id);
+        if (target.render_fence >= 0)
+            drmModeAtomicAddProperty(req, drm.plane_id, drm.prop_in_fence_fd, target.render_fence);
+        drmModeAtomicAddProperty(req, drm.crtc_id, drm.prop_out_fence_ptr, (uint64_t)(uintptr_t)&commit_out_fence);
+
+        commit_out_fence = -1;
+        trace_span span("drmModeAtomicCommit");
+        int ret = drmModeAtomicCommit(drm.fd, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, &flip);
+        drmModeAtomicFree(req);
+
+        if (target.render_fence >= 0)
+            close(target.render_fence), target.render_fence = -1;
+
+        if (ret)
+        {
+            std::cerr << "failed to commit: " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    if (target.sync)
+    {
+        trace_span span("fence wait");
+        const double wait_start = monotonic_ms();
+        eglClientWaitSyncKHR(gl.display, target.sync, 0, EGL_FOREVER_KHR);
+        eglDestroySyncKHR(gl.display, target.sync);
+        target.sync = nullptr;
+        fence_wait.record(monotonic_ms() - wait_start);
+    }
+
+    trace_span span("drmModePageFlip");
+    if (drmModePageFlip(drm.fd, drm.crtc_id, target.fb->fb_id,
+        DRM_MODE_PAGE_FLIP_EVENT, &flip))
+    {
+        std::cerr << "failed to queue page flip: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+bool gbm_egl_device_impl::init_explicit_sync()
+{
+    const char* extensions = eglQueryString(gl.display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_ANDROID_native_fence_sync") || !strstr(extensions, "EGL_KHR_wait_sync"))
+    {
+        std::cerr << "explicit sync: EGL_ANDROID_native_fence_sync not available" << std::endl;
+        return false;
+    }
+
+    if (!drm.plane_id || drmSetClientCap(drm.fd, DRM_CLIENT_CAP_ATOMIC, 1))
+    {
+        std::cerr << "explicit sync: atomic modesetting not available" << std::endl;
+        return false;
+    }
+
+    drm.prop_fb_id = get_property_id(drm.plane_id, DRM_MODE_OBJECT_PLANE, "FB_ID");
+    drm.prop_in_fence_fd = get_property_id(drm.plane_id, DRM_MODE_OBJECT_PLANE, "IN_FENCE_FD");
+    drm.prop_out_fence_ptr = get_property_id(drm.crtc_id, DRM_MODE_OBJECT_CRTC, "OUT_FENCE_PTR");
+    if (!drm.prop_fb_id || !drm.prop_in_fence_fd || !drm.prop_out_fence_ptr)
+    {
+        std::cerr << "explicit sync: plane or crtc lacks fence properties" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+
+bool gbm_egl_device_impl::create_render_targets(int count, bool scanout)
+{
+    const int width = get_resolution_width();
+    const int height = get_resolution_height();
+
+    // layouts both the plane can scan out and the gpu can render to
+    std::vector<uint64_t> modifiers = scanout && gbm_egl_options::get().modifiers ? 
+                                      scanout_modifiers(GBM_FORMAT_XRGB8888, true) : std::vector<uint64_t>();
+
+    for (int i = 0; i < count; ++i)
+    {
+        targets.emplace_back();
+        render_target& target = targets.back();
+
+        if (!modifiers.empty())
+        {
+            target.bo = gbm_bo_create_with_modifiers(gbm.dev, width, height, GBM_FORMAT_XRGB8888, modifiers.data(), modifiers.size());
+            if (!target.bo)
+            {
+                std::cerr << "render target with modifiers failed, falling back to linear" << std::endl;
+                modifiers.clear();
+            }
+        }
+        if (!target.bo)
+            target.bo = gbm_bo_create(gbm.dev, width, height, GBM_FORMAT_XRGB8888,
+                                      scanout ? GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING : GBM_BO_USE_RENDERING);
+        if (!target.bo)
+        {
+            std::cerr << "failed to create render target buffer" << std::endl;
+            return false;
+        }
+        const size_t size = size_t(gbm_bo_get_stride(target.bo)) * height;
+        resource_created(resource_kind::bo, target.bo, size, "render target");
+
+        target.image = create_bo_image(target.bo);
+        if (!target.image)
+        {
+            std::cerr << "failed to make image from render target buffer" << std::endl;
+            return false;
+        }
+        resource_created(resource_kind::image, target.image, size, "render target");
+
+        glGenRenderbuffers(1, &target.color_rb);
+        glBindRenderbuffer(GL_RENDERBUFFER, target.color_rb);
+        glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER, target.image);
+
+        glGenRenderbuffers(1, &target.depth_rb);
+        glBindRenderbuffer(GL_RENDERBUFFER, target.depth_rb);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+
+        glGenFramebuffers(1, &target.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.color_rb);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depth_rb);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "render target framebuffer incomplete" << std::endl;
+            return false;
+        }
+
+        if (!scanout)
+            continue;
+        target.fb = drm_fb_get_from_bo(target.bo);
+        if (!target.fb && !modifiers.empty())
+        {
+            // the plane advertised the layout but the kernel would not take
+            // the framebuffer, this one and the rest are made linear
+            std::cerr << "render target with modifiers cannot be scanned out, falling back to linear" << std::endl;
+            destroy_render_target(target);
+            targets.pop_back();
+            modifiers.clear();
+            --i;
+            continue;
+        }
+        if (!target.fb)
+            return false;
+    }
+
+    // fbo content ends up upside down compared to the window surface
+    flip_y = true;
+    return true;
+}
+
+
+void* gbm_egl_device_impl::create_bo_image(gbm_bo* bo)
 {
-    return drm.mode->hdisplay;
+    const uint64_t modifier = gbm_bo_get_modifier(bo);
+    const int planes = std::min(gbm_bo_get_plane_count(bo), 4);
+    const int fd = gbm_bo_get_fd(bo);
+
+    static const EGLint plane_attrs[4][5] = {
+        { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+          EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+          EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+          EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT,
+          EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT },
+    };
+
+    std::vector<EGLint> attrs = { EGL_WIDTH, EGLint(gbm_bo_get_width(bo)),
+                                  EGL_HEIGHT, EGLint(gbm_bo_get_height(bo)),
+                                  EGL_LINUX_DRM_FOURCC_EXT, EGLint(gbm_bo_get_format(bo)) };
+    for (int i = 0; i < planes; ++i)
+    {
+        attrs.insert(attrs.end(), { plane_attrs[i][0], fd,
+                                    plane_attrs[i][1], EGLint(gbm_bo_get_offset(bo, i)),
+                                    plane_attrs[i][2], EGLint(gbm_bo_get_stride_for_plane(bo, i)) });
+        if (modifier != DRM_FORMAT_MOD_INVALID)
+            attrs.insert(attrs.end(), { plane_attrs[i][3], EGLint(modifier & 0xffffffff),
+                                        plane_attrs[i][4], EGLint(modifier >> 32) });
+    }
+    attrs.push_back(EGL_NONE);
+
+    EGLImageKHR image = eglCreateImageKHR(gl.display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, attrs.data());
+    close(fd);
+    return image != EGL_NO_IMAGE_KHR ? image : nullptr;
 }
 
 
-uint16_t gbm_egl_device_impl::get_resolution_height()
+bool gbm_egl_device_impl::create_scaled_target(float scale)
 {
-    return drm.mode->vdisplay;
+    // even sizes keep the upscale from shifting by half a pixel
+    scaled.width = std::max(2, int(get_resolution_width() * scale) & ~1);
+    scaled.height = std::max(2, int(get_resolution_height() * scale) & ~1);
+
+    glGenTextures(1, &scaled.texture);
+    resource_created(resource_kind::texture, uint64_t(scaled.texture), size_t(scaled.width) * scaled.height * 4, "scaled target");
+    glBindTexture(GL_TEXTURE_2D, scaled.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, scaled.width, scaled.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &scaled.depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, scaled.depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, scaled.width, scaled.height);
+
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGenFramebuffers(1, &scaled.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, scaled.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, scaled.texture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, scaled.depth_rb);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (!complete)
+    {
+        std::cerr << "scaled render target " << scaled.width << "x" << scaled.height << " incomplete" << std::endl;
+        destroy_scaled_target();
+        return false;
+    }
+    return true;
 }
 
 
-bool gbm_egl_device_impl::create_texture(int width, int height, oes_texture& out_texture, TextureFormat format)
+void gbm_egl_device_impl::destroy_scaled_target()
 {
-    bool ret = false;
-    int32_t bpp = 0;
-    EGLint egl_format = 0;
-    uint32_t gbm_format = 0;
-    switch (format)
+    if (scaled.fbo)
+        glDeleteFramebuffers(1, &scaled.fbo);
+    if (scaled.depth_rb)
+        glDeleteRenderbuffers(1, &scaled.depth_rb);
+    if (scaled.texture)
     {
-        case TextureFormat::Depth16:
-            egl_format = DRM_FORMAT_RGB565;
-            gbm_format = GBM_FORMAT_RGB565;
-            bpp = 2;
-            break;
+        resource_destroyed(resource_kind::texture, uint64_t(scaled.texture));
+        glDeleteTextures(1, &scaled.texture);
+    }
+    scaled = scaled_target();
+}
 
-        case TextureFormat::YUYV:
-            egl_format = DRM_FORMAT_YUYV;
-            gbm_format = GBM_FORMAT_YUYV;
-            bpp = 2;
-            break;
 
-        case TextureFormat::RGB8:
-            egl_format = DRM_FORMAT_RGB888;
-            gbm_format = GBM_FORMAT_RGB888;
-            bpp = 3;
-            break;
+void gbm_egl_device_impl::destroy_render_targets()
+{
+    if (!targets.empty())
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    for (render_target& target : targets)
+        destroy_render_target(target);
+    targets.clear();
+}
 
-        default:
-            return false;
-            break;
-    }
 
-    gbm_bo* bo = gbm_bo_create(gbm.dev, width, height, gbm_format, GBM_BO_USE_RENDERING | GBM_BO_USE_SCANOUT);
-    if (bo)
+void gbm_egl_device_impl::destroy_render_target(render_target& target)
+{
+    if (target.sync)
+        eglDestroySyncKHR(gl.display, target.sync);
+    if (target.render_fence >= 0)
+        close(target.render_fence);
+    if (target.release_fence >= 0)
+        close(target.release_fence);
+    if (target.fbo)
+        glDeleteFramebuffers(1, &target.fbo);
+    if (target.depth_rb)
+        glDeleteRenderbuffers(1, &target.depth_rb);
+    if (target.color_rb)
+        glDeleteRenderbuffers(1, &target.color_rb);
+    if (target.image)
+    {
+        resource_destroyed(resource_kind::image, target.image);
+        eglDestroyImageKHR(gl.display, target.image);
+    }
+    // also removes the drm framebuffer attached as user data
+    if (target.bo)
     {
-        const int fd = gbm_bo_get_fd(bo);
-        const EGLint khr_image_attrs[] = {EGL_DMA_BUF_PLANE0_FD_EXT, fd,
-                                          EGL_WIDTH, width,
-                                          EGL_HEIGHT, height,
-                                          EGL_LINUX_DRM_FOURCC_EXT, egl_format,
-                                          EGL_DMA_BUF_PLANE0_PITCH_EXT, width * bpp,
-                                          EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
-                                          EGL_NONE};
+        resource_destroyed(resource_kind::bo, target.bo);
+        gbm_bo_destroy(target.bo);
+    }
+}
+
 
-        EGLImageKHR eglImage = eglCreateImageKHR(gl.display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, nullptr, khr_image_attrs);
-        if (eglImage != EGL_NO_IMAGE_KHR)
+bool gbm_egl_device_impl::init_drm(uint16_t resolution_w, uint16_t resolution_h)
+{
+    bool ret = false;
+	int fd = open("/dev/dri/card0", O_RDWR);
+	if (fd >= 0 && gbm_egl_options::get().present == present_mode::offscreen)
+    {
+        // no mode is set and no connector needs to be there, the card node
+        // is for gbm and the dumb buffers camera frames land in
+        drm.fd = fd;
+        drm.render_width = resolution_w;
+        drm.render_height = resolution_h;
+        fprintf(stdout, "offscreen at %ux%u, no display\n", resolution_w, resolution_h);
+        timeline.mark("drm ready");
+        return true;
+    }
+	if (fd >= 0)
+    {
+        drmModeRes* resources = drmModeGetResources(fd);
+        if (resources)
         {
-            GLuint glTexture = 0;
-            glGenTextures(1, &glTexture);
-            glBindTexture(GL_TEXTURE_EXTERNAL_OES, glTexture);
-            glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, eglImage);
+            drm.fd = fd;
+            drm.resources = resources;
+
+            const auto& options = gbm_egl_options::get();
+            const display_table table = read_display_table();
+            std::cout << "resources connectors num: " << resources->count_connectors << std::endl;
+
+            if (options.modes_dump)
+            {
+                FILE* file = fopen(options.modes_dump, "w");
+                if (file)
+                {
+                    fputs(serialize_display_table(table).c_str(), file);
+                    fclose(file);
+                }
+            }
 
-            struct drm_mode_map_dumb arg = {0};
-            arg.handle = gbm_bo_get_handle(bo).u32;
-            if (drmIoctl(drm.fd, DRM_IOCTL_MODE_MAP_DUMB, &arg) == 0)
+            mode_policy policy;
+            policy.width = resolution_w;
+            policy.height = resolution_h;
+            policy.refresh_hz = options.refresh;
+            policy.allow_scaling = options.scaling;
+
+            mode_selection selection;
+            if (select_display_mode(table, policy, selection))
             {
-                int size = width * height * bpp;
-                void* address = mmap(0, size, PROT_WRITE, MAP_SHARED, drm.fd, arg.offset);
-                if (address != MAP_FAILED)
+                const display_connector& connector = table.connectors[selection.connector];
+                drm.connector = drmModeGetConnector(fd, connector.connector_id);
+                drm.encoder = drmModeGetEncoder(fd, selection.encoder_id);
+                if (drm.connector && drm.encoder && selection.mode < drm.connector->count_modes)
                 {
-                    out_texture.format = format;
-                    out_texture.bpp = bpp;
-                    out_texture.bo = bo;
-                    out_texture.image = eglImage;
-                    out_texture.id = glTexture;
-                    out_texture.offset = arg.offset;
-                    out_texture.dma = address;
+                    drm.mode = &drm.connector->modes[selection.mode];
+                    drm.crtc_id = selection.crtc_id;
+                    drm.crtc_index = selection.crtc_index;
+                    drm.plane_id = select_primary_plane(table, selection.crtc_index);
+                    drm.crtc = drmModeGetCrtc(fd, selection.crtc_id);
+                    drm.render_width = selection.render_width;
+                    drm.render_height = selection.render_height;
+                    drm.scaled = selection.scaled;
+                    drm.vrr_capable = connector.vrr_capable;
                     ret = true;
+
+                    fprintf(stdout, "mode %s %ux%u@%.2f%s, connector %u, encoder %u, crtc %u%s\n",
+                                    drm.mode->name, drm.mode->hdisplay, drm.mode->vdisplay,
+                                    connector.modes[selection.mode].refresh_mhz() / 1000.0,
+                                    (drm.mode->type & DRM_MODE_TYPE_PREFERRED) ? " (preferred)" : "",
+                                    drm.connector->connector_id, selection.encoder_id, drm.crtc_id,
+                                    drm.vrr_capable ? ", vrr capable" : "");
+                    if (drm.scaled)
+                        fprintf(stdout, "rendering at %ux%u, scaled on scanout\n", drm.render_width, drm.render_height);
                 }
             }
             else
             {
-                eglDestroyImageKHR(gl.display, eglImage);
-                fprintf(stderr, "failed to map dma buffer.\n");
+                std::cerr << "no connected display offers " << resolution_w << "x" << resolution_h 
+                          << (options.scaling ? " or larger" : "") << std::endl;
             }
         }
-        else
-        {
-            fprintf(stderr, "failed to make image from buffer object.\n");
-            gbm_bo_destroy(bo);
-        }
     }
-    else
+
+    if (ret)
     {
-        fprintf(stderr, "failed to create a gbm buffer.\n");
+        uint64_t cap = 0;
+        drm.fb_modifiers = drmGetCap(drm.fd, DRM_CAP_ADDFB2_MODIFIERS, &cap) == 0 && cap;
+        std::cout << "primary plane: " << drm.plane_id 
+                  << (drm.fb_modifiers ? ", fb modifiers supported" : ", no fb modifiers") << std::endl;
+        timeline.mark("drm ready");
     }
 
     return ret;
 }
 
 
-void gbm_egl_device_impl::destroy_texture(oes_texture& texture)
+display_table gbm_egl_device_impl::read_display_table()
 {
-    if (texture.id)
-        glDeleteTextures(1, &texture.id), texture.id = 0;
+    display_table table;
+    for (int i = 0; i < drm.resources->count_crtcs; ++i)
+        table.crtcs.push_back(drm.resources->crtcs[i]);
 
-    if (texture.image)
-        eglDestroyImageKHR(gl.display, texture.image), texture.image = nullptr;
+    // primary and cursor planes are only listed with universal planes on
+    drmSetClientCap(drm.fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+    drmModePlaneRes* planes = drmModeGetPlaneResources(drm.fd);
+    for (uint32_t p = 0; planes && p < planes->count_planes; ++p)
+    {
+        drmModePlane* plane = drmModeGetPlane(drm.fd, planes->planes[p]);
+        if (plane)
+        {
+            display_plane entry;
+            entry.plane_id = plane->plane_id;
+            entry.possible_crtcs = plane->possible_crtcs;
+            uint64_t type = 0;
+            if (get_property_id(plane->plane_id, DRM_MODE_OBJECT_PLANE, "type", &type) && type <= uint64_t(plane_type::cursor))
+                entry.type = plane_type(type);
+            table.planes.push_back(entry);
+            drmModeFreePlane(plane);
+        }
+    }
+    if (planes)
+        drmModeFreePlaneResources(planes);
 
-    if (texture.dma && texture.bo)
+    for (int e = 0; e < drm.resources->count_encoders; ++e)
     {
-        const uint32_t stride = gbm_bo_get_stride(texture.bo);
-        const uint32_t height = gbm_bo_get_height(texture.bo);
-        munmap(texture.dma, stride * height);
-        texture.dma = nullptr;
+        drmModeEncoder* encoder = drmModeGetEncoder(drm.fd, drm.resources->encoders[e]);
+        if (encoder)
+        {
+            display_encoder entry;
+            entry.encoder_id = encoder->encoder_id;
+            entry.crtc_id = encoder->crtc_id;
+            entry.possible_crtcs = encoder->possible_crtcs;
+            table.encoders.push_back(entry);
+            drmModeFreeEncoder(encoder);
+        }
     }
 
-    if (texture.bo)
-        gbm_bo_destroy(texture.bo), texture.bo = nullptr;
-}
+    for (int c = 0; c < drm.resources->count_connectors; ++c)
+    {
+        drmModeConnector* connector = drmModeGetConnector(drm.fd, drm.resources->connectors[c]);
+        if (!connector)
+            continue;
 
+        display_connector entry;
+        entry.connector_id = connector->connector_id;
+        entry.connected = connector->connection == DRM_MODE_CONNECTED;
+        entry.encoder_id = connector->encoder_id;
+        entry.encoders.assign(connector->encoders, connector->encoders + connector->count_encoders);
 
-bool gbm_egl_device_impl::update_texture(oes_texture& texture, const void* data)
-{
-#if 1
-    // mmap fast
-    if (data && texture.bo)
-    {
-        const uint32_t height = gbm_bo_get_height(texture.bo);
-        const uint32_t stride = gbm_bo_get_stride(texture.bo);
-        int size = stride * height;
-        if (texture.format == TextureFormat::YUYV)
-            size /= 2;
-        void* address = mmap(0, size, PROT_WRITE, MAP_SHARED, drm.fd, texture.offset);
-        if (address != MAP_FAILED)
+        uint64_t vrr_capable = 0;
+        entry.vrr_capable = get_property_id(connector->connector_id, DRM_MODE_OBJECT_CONNECTOR, "vrr_capable", &vrr_capable) && vrr_capable;
+
+        for (int m = 0; m < connector->count_modes; ++m)
         {
-            memcpy(address, data, size);
-            munmap(address, size);
-            return true;
+            const drmModeModeInfo& info = connector->modes[m];
+            display_mode mode;
+            mode.hdisplay = info.hdisplay;
+            mode.vdisplay = info.vdisplay;
+            mode.vrefresh = info.vrefresh;
+            mode.clock = info.clock;
+            mode.htotal = info.htotal;
+            mode.vtotal = info.vtotal;
+            mode.flags = info.flags;
+            mode.type = info.type;
+            mode.name = info.name;
+            entry.modes.push_back(mode);
         }
-    }
-#else
-    // memcpy slow
-    if (data && texture.dma && texture.bo)
-    {
-        const uint32_t height = gbm_bo_get_height(texture.bo);
-        const uint32_t width = gbm_bo_get_width(texture.bo);
-        const uint32_t bpp = 2;
-        const uint32_t size = width * height * bpp;
-        memcpy(texture.dma, data, size);
+        std::cout << "connector " << entry.connector_id << " modes num: " << connector->count_modes << std::endl;
 
-        return true;
+        table.connectors.push_back(entry);
+        drmModeFreeConnector(connector);
     }
-#endif
-    return false;
+    return table;
 }
 
 
-gbm_egl_device_impl::~gbm_egl_device_impl()
+bool gbm_egl_device_impl::set_crtc(uint32_t fb_id)
 {
-    if (drm.crtc)
+    bool ret = false;
+    std::cout << "drmModeSetCrtc" << std::endl;
+    if (!drm.scaled)
     {
-        drmModeSetCrtc(drm.fd, drm.crtc->crtc_id, drm.crtc->buffer_id,
-                       drm.crtc->x, drm.crtc->y, &drm.connector->connector_id,
-                                    1, &drm.crtc->mode);
-        drmModeFreeCrtc(drm.crtc);
+        ret = drmModeSetCrtc(drm.fd, drm.crtc_id, fb_id, 
+                             0, 0, &drm.connector->connector_id, 1, drm.mode) == 0;
     }
-
-    if (gl.display)
+    else
     {
-        if (gl.surface)
-	        eglDestroySurface(gl.display, gl.surface);
-        if (gl.context)
-            eglDestroyContext(gl.display, gl.context);
-        eglTerminate(gl.display);
+        // the legacy call cannot scale, let the primary plane stretch the
+        // render size over the whole mode
+        uint32_t blob_id = 0;
+        if (drm.plane_id && drmSetClientCap(drm.fd, DRM_CLIENT_CAP_ATOMIC, 1) == 0 &&
+            drmModeCreatePropertyBlob(drm.fd, drm.mode, sizeof(*drm.mode), &blob_id) == 0)
+        {
+            const uint32_t connector = drm.connector->connector_id;
+            const uint32_t plane = drm.plane_id;
+            drmModeAtomicReq* req = drmModeAtomicAlloc();
+            auto add = [&](uint32_t object_id, uint32_t object_type, const char* name, uint64_t value){
+                drmModeAtomicAddProperty(req, object_id, get_property_id(object_id, object_type, name), value);
+            };
+            add(connector, DRM_MODE_OBJECT_CONNECTOR, "CRTC_ID", drm.crtc_id);
+            add(drm.crtc_id, DRM_MODE_OBJECT_CRTC, "MODE_ID", blob_id);
+            add(drm.crtc_id, DRM_MODE_OBJECT_CRTC, "ACTIVE", 1);
+            add(plane, DRM_MODE_OBJECT_PLANE, "FB_ID", fb_id);
+            add(plane, DRM_MODE_OBJECT_PLANE, "CRTC_ID", drm.crtc_id);
+            add(plane, DRM_MODE_OBJECT_PLANE, "SRC_X", 0);
+            add(plane, DRM_MODE_OBJECT_PLANE, "SRC_Y", 0);
+            add(plane, DRM_MODE_OBJECT_PLANE, "SRC_W", uint64_t(drm.render_width) << 16);
+            add(plane, DRM_MODE_OBJECT_PLANE, "SRC_H", uint64_t(drm.render_height) << 16);
+            add(plane, DRM_MODE_OBJECT_PLANE, "CRTC_X", 0);
+            add(plane, DRM_MODE_OBJECT_PLANE, "CRTC_Y", 0);
+            add(plane, DRM_MODE_OBJECT_PLANE, "CRTC_W", drm.mode->hdisplay);
+            add(plane, DRM_MODE_OBJECT_PLANE, "CRTC_H", drm.mode->vdisplay);
+            ret = drmModeAtomicCommit(drm.fd, req, DRM_MODE_ATOMIC_ALLOW_MODESET, nullptr) == 0;
+            drmModeAtomicFree(req);
+            drmModeDestroyPropertyBlob(drm.fd, blob_id);
+            if (!ret)
+                std::cerr << "scanout scaling rejected by the driver" << std::endl;
+        }
+        else
+        {
+            std::cerr << "scanout scaling needs atomic modesetting" << std::endl;
+        }
     }
 
-    if (gbm.surface)
-        gbm_surface_destroy(gbm.surface);
-    if (gbm.dev)
-        gbm_device_destroy(gbm.dev);
+    if (ret && drm.vrr_capable && gbm_egl_options::get().vrr)
+    {
+        const uint32_t vrr_enabled = get_property_id(drm.crtc_id, DRM_MODE_OBJECT_CRTC, "VRR_ENABLED");
+        if (vrr_enabled && drmModeObjectSetProperty(drm.fd, drm.crtc_id, DRM_MODE_OBJECT_CRTC, vrr_enabled, 1) == 0)
+            std::cout << "variable refresh rate enabled" << std::endl;
+        else
+            std::cerr << "failed to enable variable refresh rate" << std::endl;
+    }
 
-    if (drm.connector)
-        drmModeFreeConnector(drm.connector);
-    if (drm.encoder)
-        drmModeFreeEncoder(drm.encoder);
-    if (drm.resources)
-        drmModeFreeResources(drm.resources);
-    if (drm.fd > 0)
-        drmClose(drm.fd);
+    return ret;
 }
 
 
-bool gbm_egl_device_impl::create_impl(uint16_t resolution_w, uint16_t resolution_h)
+uint32_t gbm_egl_device_impl::get_property_id(uint32_t object_id, uint32_t object_type, const char* name, uint64_t* value)
 {
-    return init_drm(resolution_w, resolution_h) && 
-           init_gbm() && 
-           init_gl();
+    uint32_t id = 0;
+    drmModeObjectProperties* props = drmModeObjectGetProperties(drm.fd, object_id, object_type);
+    if (props)
+    {
+        for (uint32_t i = 0; i < props->count_props && !id; ++i)
+        {
+            drmModePropertyRes* prop = drmModeGetProperty(drm.fd, props->props[i]);
+            if (prop)
+            {
+                if (strcmp(prop->name, name) == 0)
+                {
+                    id = prop->prop_id;
+                    if (value)
+                        *value = props->prop_values[i];
+                }
+                drmModeFreeProperty(prop);
+            }
+        }
+        drmModeFreeObjectProperties(props);
+    }
+    return id;
 }
 
 
-void gbm_egl_device_impl::main_loop_impl()
+std::vector<uint64_t> gbm_egl_device_impl::plane_modifiers(uint32_t format)
 {
-    std::cout << "main_loop_impl" << std::endl;
-    eglSwapBuffers(gl.display, gl.surface);
+    std::vector<uint64_t> modifiers;
+    if (!drm.plane_id || !drm.fb_modifiers)
+        return modifiers;
 
-    gbm_bo* bo = gbm_surface_lock_front_buffer(gbm.surface);
-    drm_fb* fb = drm_fb_get_from_bo(bo);
-
-    // handle Ctrl+C
-    signal(SIGINT, [](int){ running = false; });
+    uint64_t blob_id = 0;
+    if (!get_property_id(drm.plane_id, DRM_MODE_OBJECT_PLANE, "IN_FORMATS", &blob_id) || !blob_id)
+        return modifiers;
 
-    // set mode:
-    std::cout << "drmModeSetCrtc" << std::endl;
-    if (!drmModeSetCrtc(drm.fd, drm.encoder->crtc_id, fb->fb_id, 
-        0, 0, &drm.connector->connector_id, 1, drm.mode))
-    {
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(0, &fds);
-        FD_SET(drm.fd, &fds);
-
-        drmEventContext evctx = { DRM_EVENT_CONTEXT_VERSION, 0, 
-                                  [](int fd, unsigned int frame, unsigned int sec, unsigned int usec, void* data){
-                                      int* waiting_for_flip = (int*)data;
-                                      *waiting_for_flip = 0;
-                                }};
-        begin_impl();
+    drmModePropertyBlobRes* blob = drmModeGetPropertyBlob(drm.fd, blob_id);
+    if (blob)
+    {
+        const drm_format_modifier_blob* header = (const drm_format_modifier_blob*)blob->data;
+        const uint32_t* formats = (const uint32_t*)((const char*)header + header->formats_offset);
+        const drm_format_modifier* mods = (const drm_format_modifier*)((const char*)header + header->modifiers_offset);
 
-        bool local_working = true;
-        while (local_working && running)
+        for (uint32_t f = 0; f < header->count_formats; ++f)
         {
-            update_impl();
-            render_impl();
-
-            eglSwapBuffers(gl.display, gl.surface);
-            gbm_bo* next_bo = gbm_surface_lock_front_buffer(gbm.surface);
-            fb = drm_fb_get_from_bo(next_bo);
-
-            // Here you could also update drm plane layers if you want hw composition
+            if (formats[f] != format)
+                continue;
 
-            int waiting_for_flip = 1;
-            if (drmModePageFlip(drm.fd, drm.encoder->crtc_id, fb->fb_id, 
-                DRM_MODE_PAGE_FLIP_EVENT, &waiting_for_flip))
+            // each entry covers a window of 64 formats starting at offset
+            for (uint32_t m = 0; m < header->count_modifiers; ++m)
             {
-                std::cerr << "failed to queue page flip: " << strerror(errno) << std::endl;
-                break;
+                if (f >= mods[m].offset && f < mods[m].offset + 64 &&
+                    (mods[m].formats & (1ull << (f - mods[m].offset))))
+                    modifiers.push_back(mods[m].modifier);
             }
+        }
+        drmModeFreePropertyBlob(blob);
+    }
+    return modifiers;
+}
 
-            while (waiting_for_flip)
-            {
-                int ret = select(drm.fd + 1, &fds, nullptr, nullptr, nullptr);
-                if (ret < 0)
-                {
-                    std::cerr << "select err: " << strerror(errno) << std::endl;
-                    running = false;
-                    break;
-                }
-                else if (ret == 0)
-                {
-                    std::cerr << "select timeout!" << std::endl;
-                    running = false;
-                    break;
-                }
-                else if (FD_ISSET(0, &fds))
-                {
-                    std::cout << "user interrupted!" << std::endl;
-                    running = false;
-                    break;
-                }
-                else
-                {
-                    drmHandleEvent(drm.fd, &evctx);
-                }
-            }
 
-            // release last buffer to render on again:
-            gbm_surface_release_buffer(gbm.surface, bo);
-            bo = next_bo;
-        }
+std::vector<uint64_t> gbm_egl_device_impl::egl_modifiers(uint32_t format, bool renderable)
+{
+    std::vector<uint64_t> modifiers;
+    const char* extensions = eglQueryString(gl.display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_EXT_image_dma_buf_import_modifiers"))
+        return modifiers;
 
-        end_impl();
-    }
-    else
+    auto query = (PFNEGLQUERYDMABUFMODIFIERSEXTPROC)eglGetProcAddress("eglQueryDmaBufModifiersEXT");
+    EGLint count = 0;
+    if (!query || !query(gl.display, format, 0, nullptr, nullptr, &count) || count <= 0)
+        return modifiers;
+
+    std::vector<EGLuint64KHR> list(count);
+    std::vector<EGLBoolean> external_only(count);
+    if (query(gl.display, format, count, list.data(), external_only.data(), &count))
     {
-        std::cerr << "failed to set mode: " << strerror(errno) << std::endl;
+        for (EGLint i = 0; i < count; ++i)
+        {
+            // external only images can be sampled but not rendered to
+            if (!renderable || !external_only[i])
+                modifiers.push_back(list[i]);
+        }
     }
+    return modifiers;
 }
 
 
-bool gbm_egl_device_impl::init_drm(uint16_t resolution_w, uint16_t resolution_h)
+std::vector<uint64_t> gbm_egl_device_impl::scanout_modifiers(uint32_t format, bool check_egl)
 {
-    bool ret = false;
-	int fd = open("/dev/dri/card0", O_RDWR);
-	if (fd >= 0)
+    std::vector<uint64_t> modifiers = plane_modifiers(format);
+    if (check_egl && !modifiers.empty())
     {
-        drmModeRes* resources = drmModeGetResources(fd);
-        if (resources)
+        const std::vector<uint64_t> renderable = egl_modifiers(format, true);
+        if (!renderable.empty())
         {
-            // find a connected connector:
-            std::cout << "resources connectors num: " << resources->count_connectors << std::endl;
-            for (int c = 0; c < resources->count_connectors && !ret; c++)
-            {
-                drmModeConnector* connector = drmModeGetConnector(fd, resources->connectors[c]);
-                std::cout << "connector modes num: " << connector->count_modes << std::endl;
-                if (connector->connection == DRM_MODE_CONNECTED)
-                {
-                    for (int m = 0; m < connector->count_modes && !ret; m++)
-                    {
-                        drmModeModeInfo* mode = &connector->modes[m];
-                        if (resolution_w == mode->hdisplay && 
-                            resolution_h == mode->vdisplay)
-                        {
-                            for (int e = 0; e < resources->count_encoders && !ret; e++)
-                            {
-                                drmModeEncoder* encoder = drmModeGetEncoder(fd, resources->encoders[e]);
-                                if (encoder->encoder_id == connector->encoder_id)
-                                {
-                                    drm.fd = fd;
-                                    drm.resources = resources;
-                                    drm.connector = connector;
-                                    drm.encoder = encoder;
-                                    drm.crtc = drmModeGetCrtc(drm.fd, encoder->crtc_id);
-                                    drm.mode = mode;
-                                    ret = true;
-                                    std::cout << "find encoder." << std::endl;
-                                    break;
-                                }
-                                if (!ret)
-                                    drmModeFreeEncoder(encoder);
-                            }
-                        }
-                    }
-                }
-                if (!ret)
-                    drmModeFreeConnector(connector);
-            }
+            modifiers.erase(std::remove_if(modifiers.begin(), modifiers.end(), [&](uint64_t modifier){
+                return std::find(renderable.begin(), renderable.end(), modifier) == renderable.end();
+            }), modifiers.end());
         }
     }
+    return modifiers;
+}
 
-    return ret;
+
+static const char* modifier_vendor(uint64_t modifier)
+{
+    if (modifier == DRM_FORMAT_MOD_INVALID)
+        return "implicit";
+    if (modifier == DRM_FORMAT_MOD_LINEAR)
+        return "linear";
+
+    switch (modifier >> 56)
+    {
+        case 0x01: return "intel";
+        case 0x02: return "amd";
+        case 0x03: return "nvidia";
+        case 0x04: return "samsung";
+        case 0x05: return "qcom";
+        case 0x06: return "vivante";
+        case 0x07: return "broadcom";
+        case 0x08: return (modifier >> 52 & 0xf) == 0 ? "arm afbc" : "arm";
+        case 0x09: return "allwinner";
+        case 0x0a: return "amlogic";
+        default:   return "unknown";
+    }
+}
+
+
+void gbm_egl_device_impl::log_buffer(const char* what, gbm_bo* bo)
+{
+    const uint32_t format = gbm_bo_get_format(bo);
+    const uint64_t modifier = gbm_bo_get_modifier(bo);
+    fprintf(stdout, "%s: %ux%u %.4s, %d plane(s), modifier 0x%016llx (%s)\n", what,
+                    gbm_bo_get_width(bo), gbm_bo_get_height(bo), (const char*)&format,
+                    gbm_bo_get_plane_count(bo), (unsigned long long)modifier, modifier_vendor(modifier));
 }
 
 
@@ -362,17 +2156,41 @@ bool gbm_egl_device_impl::init_gbm()
 {
     bool ret = false;
     gbm_device* dev = gbm_create_device(drm.fd);
+    if (dev && gbm_egl_options::get().present == present_mode::offscreen)
+    {
+        // render targets only, no window surface
+        gbm.dev = dev;
+        timeline.mark("gbm ready");
+        return true;
+    }
     if (dev)
     {
-        gbm_surface* surf = gbm_surface_create(dev, 
-            drm.mode->hdisplay, drm.mode->vdisplay, 
-            GBM_FORMAT_XRGB8888, 
-            GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+        // egl is not up yet, gbm only picks modifiers it can render to
+        gbm_surface* surf = nullptr;
+        const std::vector<uint64_t> modifiers = gbm_egl_options::get().modifiers ? 
+                                                plane_modifiers(GBM_FORMAT_XRGB8888) : std::vector<uint64_t>();
+        if (!modifiers.empty())
+        {
+            surf = gbm_surface_create_with_modifiers(dev, 
+                drm.render_width, drm.render_height, 
+                GBM_FORMAT_XRGB8888, 
+                modifiers.data(), modifiers.size());
+            if (!surf)
+                std::cerr << "gbm surface with modifiers failed, falling back to implicit layout" << std::endl;
+        }
+        if (!surf)
+        {
+            surf = gbm_surface_create(dev, 
+                drm.render_width, drm.render_height, 
+                GBM_FORMAT_XRGB8888, 
+                GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+        }
         if (surf)
         {
             gbm.dev = dev;
             gbm.surface = surf;
             ret = true;
+            timeline.mark("gbm ready");
         }
         else
         {
@@ -400,7 +2218,8 @@ bool gbm_egl_device_impl::init_gl()
     {
         std::cout << "EGL Version: "    << eglQueryString(eglDisplay, EGL_VERSION)    << std::endl;
         std::cout << "EGL Vendor: "     << eglQueryString(eglDisplay, EGL_VENDOR)     << std::endl;
-        std::cout << "EGL Extensions: " << eglQueryString(eglDisplay, EGL_EXTENSIONS) << std::endl;
+        if (gbm_egl_options::get().verbose)
+            std::cout << "EGL Extensions: " << eglQueryString(eglDisplay, EGL_EXTENSIONS) << std::endl;
 
         if (eglBindAPI(EGL_OPENGL_ES_API))
         {
@@ -421,8 +2240,10 @@ bool gbm_egl_device_impl::init_gl()
                 const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
                 if ((eglContext = eglCreateContext(eglDisplay, eglConfig, EGL_NO_CONTEXT, context_attribs)))
                 {
-                    EGLSurface eglSurface = nullptr;
-                    if ((eglSurface = eglCreateWindowSurface(eglDisplay, eglConfig, (EGLNativeWindowType)gbm.surface, nullptr)) != EGL_NO_SURFACE)
+                    // offscreen draws into fbos only, current without a surface
+                    // (EGL_KHR_surfaceless_context)
+                    EGLSurface eglSurface = EGL_NO_SURFACE;
+                    if (!gbm.surface || (eglSurface = eglCreateWindowSurface(eglDisplay, eglConfig, (EGLNativeWindowType)gbm.surface, nullptr)) != EGL_NO_SURFACE)
                     {
                         // connect the context to the surface
                         if (eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext))
@@ -432,13 +2253,36 @@ bool gbm_egl_device_impl::init_gl()
                             std::cout << "GL Vendor: "     << glGetString(GL_VENDOR)                    << std::endl;
                             std::cout << "GL Renderer: "   << glGetString(GL_RENDERER)                  << std::endl;
                             std::cout << "GLSL Version: "  << glGetString(GL_SHADING_LANGUAGE_VERSION)  << std::endl;
-                            std::cout << "GL Extensions: " << glGetString(GL_EXTENSIONS)                << std::endl;
+                            if (gbm_egl_options::get().verbose)
+                                std::cout << "GL Extensions: " << glGetString(GL_EXTENSIONS)            << std::endl;
 
                             gl.display = eglDisplay;
                             gl.config = eglConfig;
                             gl.context = eglContext;
                             gl.surface = eglSurface;
                             ret = true;
+                            timeline.mark("egl ready");
+
+                            gpu_timer.init();
+                            if (gbm_egl_options::get().upload_thread)
+                                uploader.init(eglDisplay, eglConfig, eglContext);
+                            if (gbm_egl_options::get().hud)
+                            {
+                                hud_enabled = hud.init();
+                                if (drm.mode && drm.mode->vrefresh)
+                                    hud.set_budget(1000.0 / drm.mode->vrefresh);
+                            }
+                            if (gbm_egl_options::get().governor)
+                            {
+                                // scaling needs glBlitFramebuffer from gles 3
+                                const char* version = (const char*)glGetString(GL_VERSION);
+                                if (version && strstr(version, "OpenGL ES 3"))
+                                    blit_framebuffer = (blit_framebuffer_proc)eglGetProcAddress("glBlitFramebuffer");
+                                governor.set_scaling(blit_framebuffer != nullptr);
+                                if (drm.mode && drm.mode->vrefresh)
+                                    governor.set_budget(1000.0 / drm.mode->vrefresh);
+                                governor_enabled = true;
+                            }
 
                             //create_texture(512, 512);
                         }
@@ -489,15 +2333,45 @@ gbm_egl_device_impl::drm_fb* gbm_egl_device_impl::drm_fb_get_from_bo(gbm_bo* bo)
 
         uint32_t width = gbm_bo_get_width(bo);
 	    uint32_t height = gbm_bo_get_height(bo);
-        uint32_t stride = gbm_bo_get_stride(bo);
-        uint32_t handle = gbm_bo_get_handle(bo).u32;
+        uint32_t format = gbm_bo_get_format(bo);
+        uint64_t modifier = gbm_bo_get_modifier(bo);
+
+        uint32_t handles[4] = {0}, strides[4] = {0}, offsets[4] = {0};
+        uint64_t modifiers[4] = {0};
+        const int planes = gbm_bo_get_plane_count(bo);
+        for (int i = 0; i < planes && i < 4; ++i)
+        {
+            handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+            strides[i] = gbm_bo_get_stride_for_plane(bo, i);
+            offsets[i] = gbm_bo_get_offset(bo, i);
+            modifiers[i] = modifier;
+        }
+
+        // explicit modifier first, then implicit layout, then the legacy call
+        int ret = -1;
+        if (drm.fb_modifiers && modifier != DRM_FORMAT_MOD_INVALID)
+            ret = drmModeAddFB2WithModifiers(fb->fd, width, height, format, handles, strides, offsets, 
+                                             modifiers, &fb->fb_id, DRM_MODE_FB_MODIFIERS);
+        if (ret && (modifier == DRM_FORMAT_MOD_INVALID || modifier == DRM_FORMAT_MOD_LINEAR))
+            ret = drmModeAddFB2(fb->fd, width, height, format, handles, strides, offsets, &fb->fb_id, 0);
+        // the legacy call cannot carry a modifier either, a tiled buffer
+        // would be scanned out as linear
+        if (ret && planes == 1 && (format == GBM_FORMAT_XRGB8888 || format == GBM_FORMAT_ARGB8888) &&
+            (modifier == DRM_FORMAT_MOD_INVALID || modifier == DRM_FORMAT_MOD_LINEAR))
+            ret = drmModeAddFB(fb->fd, width, height, 24, 32, strides[0], handles[0], &fb->fb_id);
 
-        if (drmModeAddFB(fb->fd, width, height, 24, 32, stride, handle, &fb->fb_id) == 0)
+        if (ret == 0)
         {
+            log_buffer("framebuffer", bo);
+            resource_created(resource_kind::fb, uint64_t(fb->fb_id), size_t(strides[0]) * height, "scanout");
+            // lives as long as the bo, surface buffers included
             gbm_bo_set_user_data(bo, fb, [](gbm_bo* bo, void* data){
                 drm_fb *fb = (drm_fb*)data;
                 if (fb->fb_id)
+                {
+                    resource_destroyed(resource_kind::fb, uint64_t(fb->fb_id));
                 	drmModeRmFB(fb->fd, fb->fb_id);
+                }
                 delete fb;
             });
         }
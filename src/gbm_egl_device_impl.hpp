@@ -6,7 +6,16 @@
 #include <gbm.h>
 #include <EGL/egl.h>
 #include <atomic>
+#include <vector>
 #include "gbm_egl_device_interface.hpp"
+#include "gbm_egl_stats.hpp"
+#include "gbm_egl_modeset.hpp"
+#include "gbm_egl_gpu_timer.hpp"
+#include "gbm_egl_uploader.hpp"
+#include "gbm_egl_task_pool.hpp"
+#include "gbm_egl_metrics.hpp"
+#include "gbm_egl_hud.hpp"
+#include "gbm_egl_governor.hpp"
 
 enum TextureFormat
 {
@@ -21,30 +30,93 @@ class gbm_egl_device_impl : public gbm_egl_device_interface
 protected:
     uint16_t get_resolution_width();
     uint16_t get_resolution_height();
+    // true when rendering into swapchain fbos, which scan out upside down
+    bool render_target_flipped();
+    // below 1 while the quality governor renders at a lower resolution
+    float render_scale() const;
 
     struct oes_texture
     {
         TextureFormat format = TextureFormat::Unknown;
         int bpp = 0;
+        int width = 0;
+        int height = 0;
+        size_t size = 0;        // of the dma mapping, one camera frame
         struct gbm_bo* bo = nullptr;
         void* image = nullptr;
         uint32_t id = 0;
         __u64 offset = 0;
         void* dma = nullptr;
+        uint64_t upload = 0;    // uploader ticket that binds the image
+        // source hash of each tile as written, with GBM_EGL_DIRTY_TILES
+        std::vector<uint64_t> tile_hashes;
+        int refresh_row = 0;    // tile row rewritten next whether changed or not
     };
     bool create_texture(int width, int height, oes_texture& out_texture, TextureFormat format);
     void destroy_texture(oes_texture& texture);
     bool update_texture(oes_texture& texture, const void* data);
 
+    // the part of a camera frame that is copied, in frame pixels. decimate
+    // keeps one pixel in 2 or 4 along both axes: depth blocks become their
+    // median or nearest valid depth, color keeps the top left pixel. rgb
+    // frames are cropped only.
+    struct ingest_window
+    {
+        int x = 0;
+        int y = 0;
+        int width = 0;          // 0 = the whole frame
+        int height = 0;
+        int decimate = 1;
+        bool depth_min = false;
+    };
+    // inside the frame and on whole yuyv pairs and decimation blocks, the
+    // texture for it is width / decimate x height / decimate
+    static ingest_window clamp_window(ingest_window window, int frame_width, int frame_height, TextureFormat format);
+    // only the window is read from data, a frame_width x frame_height frame.
+    // changed is false when dirty tile tracking found the frame identical to
+    // the one already in the texture.
+    bool update_texture(oes_texture& texture, const void* data, int frame_width, int frame_height,
+                        const ingest_window& window, bool* changed = nullptr);
+
+    // textures keyed by (width, height, format). released ones are kept for
+    // reuse, so switching between stream profiles allocates nothing
+    bool acquire_texture(int width, int height, oes_texture& out_texture, TextureFormat format);
+    void release_texture(oes_texture& texture);
+    // the image is bound, the texture can be sampled
+    bool texture_ready(const oes_texture& texture) const;
+
+    // gl work off the render thread, completions run at the start of a frame
+    texture_uploader& uploads() { return uploader; }
+    // cores for per-frame cpu work, update_texture splits its rows over them
+    task_pool& tasks() { return workers; }
+
+    // system clock time (ms, rs2 global time domain) at which the camera
+    // content currently held by the textures was captured
+    void set_source_timestamp(double timestamp_ms);
+
+    void mark_startup(const char* event);
+
+    // closes the previous gpu pass of the frame and times the next one
+    void gpu_pass(const char* name);
+
     virtual ~gbm_egl_device_impl();
 
     static std::atomic_bool running;
 
+    metric_counter& camera_frames_total = metrics_counter("gbm_egl_camera_frames_total", "Framesets received from the camera.");
+    metric_counter& camera_dropped_total = metrics_counter("gbm_egl_camera_frames_dropped_total", "Camera frames lost before they reached the textures.");
+
 private:
+    // runs before the display bring-up, for work that can overlap it
+    virtual void prepare_impl() {}
+    // drawn before anything else so the first scanout shows something sane
+    virtual void placeholder_impl();
     virtual void begin_impl() = 0;
     virtual void end_impl() = 0;
     virtual void update_impl() = 0;
     virtual void render_impl() = 0;
+    // the quality governor changed level, on the render thread between frames
+    virtual void quality_impl(const quality_level& level) {}
 
     virtual bool create_impl(uint16_t resolution_w, uint16_t resolution_h);
     virtual void main_loop_impl();
@@ -57,8 +129,35 @@ private:
         drmModeEncoder* encoder = nullptr;
         drmModeCrtcPtr crtc = nullptr;
         drmModeModeInfo* mode = nullptr;
+        uint32_t crtc_id = 0;
+        int crtc_index = -1;
+        uint16_t render_width = 0;      // differs from the mode when the plane scales
+        uint16_t render_height = 0;
+        bool scaled = false;
+        bool vrr_capable = false;
+        uint32_t plane_id = 0;
+        bool fb_modifiers = false;
+        uint32_t prop_fb_id = 0;
+        uint32_t prop_in_fence_fd = 0;
+        uint32_t prop_out_fence_ptr = 0;
     };
     bool init_drm(uint16_t resolution_w, uint16_t resolution_h);
+    display_table read_display_table();
+    bool set_crtc(uint32_t fb_id);
+    uint32_t get_property_id(uint32_t object_id, uint32_t object_type, const char* name, uint64_t* value = nullptr);
+
+    // format modifier negotiation, an empty list means implicit layout
+    std::vector<uint64_t> plane_modifiers(uint32_t format);
+    std::vector<uint64_t> egl_modifiers(uint32_t format, bool renderable);
+    std::vector<uint64_t> scanout_modifiers(uint32_t format, bool check_egl);
+    void log_buffer(const char* what, gbm_bo* bo);
+
+    // rewrites the tiles of the mapping whose source changed, returns the
+    // bytes written
+    static constexpr int tile_width = 64;
+    static constexpr int tile_height = 16;
+    size_t update_tiles(oes_texture& texture, uint8_t* dst, const uint8_t* origin, size_t src_stride,
+                        const ingest_window& window, bool& changed);
 
     struct gbm_info
     {
@@ -84,6 +183,140 @@ private:
     };
     drm_fb* drm_fb_get_from_bo(gbm_bo* bo);
 
+    struct flip_info
+    {
+        int waiting = 0;
+        bool async = false;
+        double render_start = 0;
+        double source_timestamp = 0;
+        gbm_egl_device_impl* device = nullptr;
+    };
+    bool handle_events(int timeout_ms);
+    void page_flip_done(const flip_info& flip, unsigned int sec, unsigned int usec);
+    void render_frame(double& frame_source_timestamp);
+    void update_hud();
+    void govern(double cpu_ms);
+    void report_stats(bool final);
+    void write_bench_json(const char* path);
+
+    // gbm_surface_lock_front_buffer / release_buffer in lockstep with each flip
+    void surface_loop();
+    bool async_flip_supported();
+    // single buffer scanned out while it is rendered to, tears by design
+    void front_buffer_loop();
+    // no display, a frame counts as shown once the gpu has finished it
+    void offscreen_loop();
+
+    // explicitly allocated scanout buffers rendered through fbos
+    struct render_target
+    {
+        struct gbm_bo* bo = nullptr;
+        void* image = nullptr;
+        uint32_t color_rb = 0;
+        uint32_t depth_rb = 0;
+        uint32_t fbo = 0;
+        drm_fb* fb = nullptr;
+        void* sync = nullptr;
+        int render_fence = -1;      // signals when rendering into it is done
+        int release_fence = -1;     // signals when it has left scanout
+        double render_start = 0;
+        double source_timestamp = 0;
+    };
+    void* create_bo_image(gbm_bo* bo);
+    // not scanout capable and without drm framebuffers for offscreen
+    bool create_render_targets(int count, bool scanout = true);
+    void destroy_render_targets();
+    void destroy_render_target(render_target& target);
+    void render_into_target(int index);
+    // a finished frame dropped before it was shown, its fences go with it
+    void discard_target(int index);
+    bool present_target(int index, flip_info& flip);
+    void swapchain_loop();
+
+    // lower resolution target the frame is rendered into and blitted up from
+    struct scaled_target
+    {
+        uint32_t texture = 0;
+        uint32_t depth_rb = 0;
+        uint32_t fbo = 0;
+        int width = 0;
+        int height = 0;
+    };
+    bool create_scaled_target(float scale);
+    void destroy_scaled_target();
+
+    // EGL_ANDROID_native_fence_sync fences passed through atomic commits
+    bool init_explicit_sync();
+    bool explicit_sync = false;
+    int32_t commit_out_fence = -1;
+
+    std::vector<render_target> targets;
+    scaled_target scaled;
+    bool flip_y = false;
+
+    // least recently released last, two stream profiles' worth
+    static constexpr size_t texture_pool_limit = 4;
+    std::vector<oes_texture> texture_pool;
+
+    startup_timeline timeline;
+    bool timeline_printed = false;
+
+    std::atomic<double> source_timestamp {0};
+    double last_source_timestamp = 0;
+    double last_flip_time = 0;
+    bool flip_timestamp_monotonic = false;
+    double last_report_time = 0;
+    uint64_t frames_rendered = 0;
+    uint64_t frames_flipped = 0;
+    uint64_t frames_replaced = 0;
+    uint64_t last_frames_rendered = 0;
+    uint64_t last_frames_flipped = 0;
+    uint64_t last_camera_bytes = 0;
+    uint64_t last_ingest_bytes = 0;
+    uint64_t last_tiles = 0;
+    uint64_t last_tiles_written = 0;
+    // first frame to the frame limit, for the bench results
+    double run_start = 0;
+    double run_end = 0;
+    std::vector<thread_cpu_time> thread_times;
+    gpu_pass_timer gpu_timer;
+    texture_uploader uploader;
+    task_pool workers;
+    perf_hud hud;
+    bool hud_enabled = false;
+    double hud_text_time = 0;
+    uint64_t hud_frames = 0;
+    double last_frame_start = 0;
+    quality_governor governor;
+    bool governor_enabled = false;
+    uint64_t governor_misses = 0;
+    latency_histogram cpu_update {"cpu update"};
+    latency_histogram cpu_render {"cpu render"};
+    latency_histogram cpu_hud {"cpu hud"};
+    latency_histogram glass_to_glass {"glass-to-glass"};
+    latency_histogram render_to_scanout {"render-to-scanout"};
+    latency_histogram fence_wait {"cpu-fence-wait"};
+    latency_histogram present_vsync {"present vsync"};
+    latency_histogram present_async {"present async"};
+    latency_histogram present_front {"present front"};
+
+    metric_counter& rendered_total = metrics_counter("gbm_egl_frames_rendered_total", "Frames rendered.");
+    metric_counter& flipped_total = metrics_counter("gbm_egl_frames_flipped_total", "Frames that reached the screen.");
+    metric_counter& replaced_total = metrics_counter("gbm_egl_frames_replaced_total", "Rendered frames replaced by a newer one before scanout.");
+    metric_counter& flip_misses_total = metrics_counter("gbm_egl_flip_misses_total", "Vblanks that went by without a new frame between two vsync flips.");
+    metric_counter& wakeups_total = metrics_counter("gbm_egl_event_wakeups_total", "Returns from select on the drm fd.");
+    metric_counter& uploaded_total = metrics_counter("gbm_egl_texture_updates_total", "Camera frames copied into textures.");
+    metric_counter& camera_bytes_total = metrics_counter("gbm_egl_camera_bytes_total", "Bytes of camera frames handed to the texture copy.");
+    metric_counter& ingest_bytes_total = metrics_counter("gbm_egl_ingest_bytes_total", "Bytes written into camera textures, after cropping and decimation.");
+    metric_counter& tiles_total = metrics_counter("gbm_egl_ingest_tiles_total", "Camera texture tiles hashed for changes.");
+    metric_counter& tiles_written_total = metrics_counter("gbm_egl_ingest_tiles_written_total", "Camera texture tiles rewritten, changed or due for a refresh.");
+    metric_counter& unchanged_total = metrics_counter("gbm_egl_texture_updates_unchanged_total", "Camera texture updates that found every tile unchanged.");
+    metric_gauge& queued_frames = metrics_gauge("gbm_egl_queued_frames", "Finished frames waiting for scanout.");
+    metric_gauge& upload_jobs = metrics_gauge("gbm_egl_upload_jobs", "Upload jobs submitted and not yet complete.");
+    metric_gauge& quality_level_gauge = metrics_gauge("gbm_egl_quality_level", "Quality governor level, 0 is full quality.");
+    metric_counter& quality_down_total = metrics_counter("gbm_egl_quality_steps_down_total", "Quality governor steps down after frames overran the refresh interval.");
+    metric_counter& quality_up_total = metrics_counter("gbm_egl_quality_steps_up_total", "Quality governor steps back up with headroom.");
+
     drm_info drm;
     gbm_info gbm;
     egl_info gl;
@@ -0,0 +1,107 @@
+#include "gbm_egl_governor.hpp"
+#include <stdio.h>
+#include <algorithm>
+
+// cheapest to give up first: pixels nobody looks at closely, then filter
+// detail, then camera motion
+static const quality_level levels[] = {
+    { "full quality",       1.0f,  false, false },
+    { "render 75%",         0.75f, false, false },
+    { "render 50%",         0.5f,  false, false },
+    { "filters half size",  0.5f,  true,  false },
+    { "camera fps halved",  0.5f,  true,  true  },
+};
+static const int levels_count = sizeof(levels) / sizeof(levels[0]);
+
+
+int quality_governor::level_count()
+{
+    return levels_count;
+}
+
+
+const quality_level& quality_governor::settings(int level)
+{
+    return levels[std::max(0, std::min(level, levels_count - 1))];
+}
+
+
+const quality_level& quality_governor::settings() const
+{
+    return settings(current);
+}
+
+
+bool quality_governor::usable(int level) const
+{
+    // a level that only changes the render scale does nothing without one
+    return scaling || level == 0 || levels[level].render_scale == levels[level - 1].render_scale;
+}
+
+
+bool quality_governor::update(double cpu_ms, double gpu_ms, int missed_vblanks)
+{
+    ++frames_at_level;
+    // a step up that held for a long time was the right call after all
+    if (went_up && frames_at_level >= calm_limit)
+        calm_needed = calm_frames, went_up = false;
+
+    // frames already queued still ran at the old level
+    if (settle > 0)
+    {
+        --settle;
+        return false;
+    }
+
+    const double work = std::max(cpu_ms, gpu_ms);
+    const bool over = missed_vblanks > 0 || work > budget_ms * 0.9;
+    const bool headroom = missed_vblanks == 0 && work < budget_ms * 0.5;
+
+    const int slot = frame++ % window;
+    overrun_count += int(over) - int(overrun[slot]);
+    overrun[slot] = over;
+
+    if (overrun_count >= overruns_down)
+    {
+        int down = current + 1;
+        while (down < levels_count && !usable(down))
+            ++down;
+        if (down < levels_count)
+        {
+            // the last step up did not hold, wait longer before the next one
+            if (went_up)
+                calm_needed = std::min(calm_needed * 2, calm_limit), went_up = false;
+            char why[96];
+            snprintf(why, sizeof(why), "%d of %d frames over %.1f ms", overrun_count, std::min(frame, window), budget_ms);
+            step(down, why);
+            return true;
+        }
+    }
+
+    calm = headroom ? calm + 1 : 0;
+    if (calm >= calm_needed && current > 0)
+    {
+        int up = current - 1;
+        while (up > 0 && !usable(up))
+            --up;
+        char why[96];
+        snprintf(why, sizeof(why), "%d frames under %.1f ms", calm, budget_ms * 0.5);
+        step(up, why);
+        went_up = true;
+        return true;
+    }
+    return false;
+}
+
+
+void quality_governor::step(int to, const char* why)
+{
+    current = to;
+    std::fill(overrun, overrun + window, false);
+    overrun_count = 0;
+    frame = 0;
+    calm = 0;
+    settle = settle_frames;
+    frames_at_level = 0;
+    snprintf(last_reason, sizeof(last_reason), "%s", why);
+}
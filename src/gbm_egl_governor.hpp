@@ -0,0 +1,61 @@
+#ifndef _gbm_egl_governor_hpp__
+#define _gbm_egl_governor_hpp__
+
+#include <stdint.h>
+
+// what a quality level turns down, each level keeps the ones before it
+struct quality_level
+{
+    const char* name;
+    float render_scale;         // of the render target, upscaled for scanout
+    bool reduced_filters;       // post-processing at half size
+    bool reduced_fps;           // camera at a lower frame rate
+};
+
+// steps quality down when frames keep overrunning the vblank budget and
+// back up when there is headroom. going up waits longer than going down,
+// and a step up that is undone right away doubles the wait for the next.
+class quality_governor
+{
+public:
+    void set_budget(double ms) { budget_ms = ms; }
+    // levels without a scaled render target are skipped when it is not available
+    void set_scaling(bool available) { scaling = available; }
+
+    // cpu and gpu time of one frame and the vblanks it missed, returns true
+    // when the level changed. gpu_ms is 0 without timer queries.
+    bool update(double cpu_ms, double gpu_ms, int missed_vblanks);
+
+    int level() const { return current; }
+    const quality_level& settings() const;
+    // why the last change was made
+    const char* reason() const { return last_reason; }
+
+    static int level_count();
+    static const quality_level& settings(int level);
+
+private:
+    bool usable(int level) const;
+    void step(int to, const char* why);
+
+    static constexpr int window = 30;           // frames looked at to go down
+    static constexpr int overruns_down = 3;     // of them over budget
+    static constexpr int settle_frames = 30;    // after a change, for gpu times to catch up
+    static constexpr int calm_frames = 120;     // in a row with headroom to go up
+    static constexpr int calm_limit = 120 * 16;
+
+    double budget_ms = 16.7;
+    bool scaling = true;
+    int current = 0;
+    bool overrun[window] = {};
+    int overrun_count = 0;
+    int frame = 0;
+    int settle = settle_frames;
+    int calm = 0;
+    int calm_needed = calm_frames;
+    uint64_t frames_at_level = 0;
+    bool went_up = false;
+    char last_reason[96] = "";
+};
+
+#endif
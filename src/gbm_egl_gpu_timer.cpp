@@ -0,0 +1,210 @@
+#include "gbm_egl_gpu_timer.hpp"
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <string.h>
+#include <iostream>
+
+static PFNGLGENQUERIESEXTPROC gen_queries = nullptr;
+static PFNGLDELETEQUERIESEXTPROC delete_queries = nullptr;
+static PFNGLBEGINQUERYEXTPROC begin_query = nullptr;
+static PFNGLENDQUERYEXTPROC end_query = nullptr;
+static PFNGLGETQUERYOBJECTUIVEXTPROC get_query_uiv = nullptr;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_ui64v = nullptr;
+
+
+bool gpu_pass_timer::init()
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query"))
+    {
+        std::cout << "no GL_EXT_disjoint_timer_query, gpu pass timing off" << std::endl;
+        return false;
+    }
+
+    gen_queries = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress("glGenQueriesEXT");
+    delete_queries = (PFNGLDELETEQUERIESEXTPROC)eglGetProcAddress("glDeleteQueriesEXT");
+    begin_query = (PFNGLBEGINQUERYEXTPROC)eglGetProcAddress("glBeginQueryEXT");
+    end_query = (PFNGLENDQUERYEXTPROC)eglGetProcAddress("glEndQueryEXT");
+    get_query_uiv = (PFNGLGETQUERYOBJECTUIVEXTPROC)eglGetProcAddress("glGetQueryObjectuivEXT");
+    get_query_ui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+    if (!gen_queries || !delete_queries || !begin_query || !end_query || !get_query_uiv || !get_query_ui64v)
+    {
+        std::cerr << "GL_EXT_disjoint_timer_query entry points missing" << std::endl;
+        return false;
+    }
+
+    for (frame_queries& frame : frames)
+    {
+        for (pass_query& query : frame.queries)
+            gen_queries(1, &query.id);
+    }
+
+    // clear a disjoint event left over from context creation
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    queries_supported = true;
+    return true;
+}
+
+
+void gpu_pass_timer::destroy()
+{
+    if (!queries_supported)
+        return;
+
+    for (frame_queries& frame : frames)
+    {
+        for (pass_query& query : frame.queries)
+            delete_queries(1, &query.id), query.id = 0;
+    }
+    queries_supported = false;
+}
+
+
+std::vector<const latency_histogram*> gpu_pass_timer::histograms() const
+{
+    std::vector<const latency_histogram*> all = { &frame_time };
+    for (const latency_histogram& pass : pass_times)
+        all.push_back(&pass);
+    return all;
+}
+
+
+const latency_histogram* gpu_pass_timer::pass_histogram(const char* name) const
+{
+    for (size_t i = 0; i < pass_names.size(); ++i)
+    {
+        if (strcmp(pass_names[i], name) == 0)
+            return &pass_times[i];
+    }
+    return nullptr;
+}
+
+
+int gpu_pass_timer::pass_index(const char* name)
+{
+    for (size_t i = 0; i < pass_names.size(); ++i)
+    {
+        if (pass_names[i] == name || strcmp(pass_names[i], name) == 0)
+            return i;
+    }
+
+    pass_names.push_back(name);
+    labels.push_back(std::string("gpu ") + name);
+    pass_times.emplace_back(labels.back().c_str());
+    return pass_names.size() - 1;
+}
+
+
+bool gpu_pass_timer::collect(frame_queries& frame)
+{
+    // queries complete in order, the last one tells for the whole frame
+    GLuint available = 0;
+    get_query_uiv(frame.queries[frame.count - 1].id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available)
+        return false;
+
+    uint64_t frame_ns = 0;
+    for (int i = 0; i < frame.count; ++i)
+    {
+        GLuint64 elapsed = 0;
+        get_query_ui64v(frame.queries[i].id, GL_QUERY_RESULT_EXT, &elapsed);
+        pass_times[frame.queries[i].pass].record(elapsed / 1000000.0);
+        frame_ns += elapsed;
+    }
+    frame_time.record(frame_ns / 1000000.0);
+    last_frame = frame_ns / 1000000.0;
+
+    frame.pending = false;
+    return true;
+}
+
+
+void gpu_pass_timer::begin_frame()
+{
+    if (!queries_supported)
+        return;
+    if (in_pass)
+        end_pass();
+
+    // a disjoint event (power state change, counter reset) makes every
+    // result in flight meaningless
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint)
+    {
+        for (frame_queries& frame : frames)
+        {
+            if (frame.pending)
+                frame.pending = false, ++frames_disjoint;
+        }
+    }
+
+    // oldest first, stop at the first frame the gpu has not finished
+    for (int i = 1; i <= frames_in_flight; ++i)
+    {
+        frame_queries& frame = frames[(current + i) % frames_in_flight];
+        if (frame.pending && !collect(frame))
+            break;
+    }
+
+    current = (current + 1) % frames_in_flight;
+    frame_queries& frame = frames[current];
+    if (frame.pending)
+        ++frames_dropped;
+    frame.pending = false;
+    frame.count = 0;
+}
+
+
+void gpu_pass_timer::begin_pass(const char* name)
+{
+    if (!queries_supported)
+        return;
+    if (in_pass)
+        end_pass();
+
+    frame_queries& frame = frames[current];
+    if (frame.count == max_passes)
+        return;
+
+    pass_query& query = frame.queries[frame.count++];
+    query.pass = pass_index(name);
+    begin_query(GL_TIME_ELAPSED_EXT, query.id);
+    frame.pending = true;
+    in_pass = true;
+}
+
+
+void gpu_pass_timer::end_pass()
+{
+    if (!in_pass)
+        return;
+
+    end_query(GL_TIME_ELAPSED_EXT);
+    in_pass = false;
+}
+
+
+void gpu_pass_timer::print() const
+{
+    if (!frame_time.count())
+        return;
+
+    frame_time.print();
+    for (const latency_histogram& pass : pass_times)
+        pass.print();
+    if (frames_disjoint || frames_dropped)
+        fprintf(stdout, "gpu timer: %llu frames disjoint, %llu not ready in time\n",
+                        (unsigned long long)frames_disjoint, (unsigned long long)frames_dropped);
+}
+
+
+void gpu_pass_timer::dump(FILE* file) const
+{
+    frame_time.dump(file);
+    for (const latency_histogram& pass : pass_times)
+        pass.dump(file);
+}
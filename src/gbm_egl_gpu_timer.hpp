@@ -0,0 +1,71 @@
+#ifndef _gbm_egl_gpu_timer_hpp__
+#define _gbm_egl_gpu_timer_hpp__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+#include "gbm_egl_stats.hpp"
+
+// gpu time per render pass through EXT_disjoint_timer_query. queries sit in
+// a ring a few frames deep and are only read once available, so the cpu
+// never waits for the gpu. frames that saw a disjoint event are thrown away.
+class gpu_pass_timer
+{
+public:
+    bool init();
+    void destroy();
+    bool supported() const { return queries_supported; }
+
+    // call with the context current, once per frame before the first pass
+    void begin_frame();
+    // passes must not nest, the name must be a string literal
+    void begin_pass(const char* name);
+    void end_pass();
+
+    void print() const;
+    void dump(FILE* file) const;
+
+    const latency_histogram& frame_histogram() const { return frame_time; }
+    // the most recent frame that completed, a few frames behind
+    double last_frame_ms() const { return last_frame; }
+    // nullptr until the pass was timed once
+    const latency_histogram* pass_histogram(const char* name) const;
+    // the frame and every pass timed so far
+    std::vector<const latency_histogram*> histograms() const;
+
+private:
+    static constexpr int frames_in_flight = 4;
+    static constexpr int max_passes = 16;
+
+    struct pass_query
+    {
+        uint32_t id = 0;
+        int pass = -1;
+    };
+    struct frame_queries
+    {
+        pass_query queries[max_passes];
+        int count = 0;
+        bool pending = false;
+    };
+
+    int pass_index(const char* name);
+    bool collect(frame_queries& frame);
+
+    bool queries_supported = false;
+    bool in_pass = false;
+    int current = 0;
+    frame_queries frames[frames_in_flight];
+
+    std::vector<const char*> pass_names;
+    std::deque<std::string> labels;
+    std::deque<latency_histogram> pass_times;
+    latency_histogram frame_time {"gpu frame"};
+    double last_frame = 0;
+    uint64_t frames_disjoint = 0;
+    uint64_t frames_dropped = 0;
+};
+
+#endif
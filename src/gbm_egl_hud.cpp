@@ -0,0 +1,245 @@
+#include "gbm_egl_hud.hpp"
+#include "gbm_egl_util.hpp"
+#include "gbm_egl_resources.hpp"
+#include <GLES2/gl2.h>
+#include <string.h>
+#include <algorithm>
+
+// 3x5 glyphs, one row per byte from the top, bit 2 is the left column.
+// the last cell is solid, quads of it draw the panel and the graph
+static const char glyph_chars[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/%";
+static const uint8_t glyph_rows[][5] = {
+    {0, 0, 0, 0, 0},                                            // space
+    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7}, {5, 5, 7, 1, 1},
+    {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1}, {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7},
+    {2, 5, 7, 5, 5}, {6, 5, 6, 5, 6}, {3, 4, 4, 4, 3}, {6, 5, 5, 5, 6}, {7, 4, 6, 4, 7},
+    {7, 4, 6, 4, 4}, {3, 4, 5, 5, 3}, {5, 5, 7, 5, 5}, {7, 2, 2, 2, 7}, {1, 1, 1, 5, 2},
+    {5, 5, 6, 5, 5}, {4, 4, 4, 4, 7}, {5, 7, 7, 5, 5}, {6, 5, 5, 5, 5}, {2, 5, 5, 5, 2},
+    {6, 5, 6, 4, 4}, {2, 5, 5, 6, 3}, {6, 5, 6, 5, 5}, {3, 4, 2, 1, 6}, {7, 2, 2, 2, 2},
+    {5, 5, 5, 5, 7}, {5, 5, 5, 5, 2}, {5, 5, 7, 7, 5}, {5, 5, 2, 5, 5}, {5, 5, 2, 2, 2},
+    {7, 1, 2, 4, 7},                                            // Z
+    {0, 0, 0, 0, 2}, {0, 2, 0, 2, 0}, {0, 0, 7, 0, 0}, {1, 1, 2, 4, 4}, {5, 1, 2, 4, 5},
+    {7, 7, 7, 7, 7},                                            // solid
+};
+static const int glyph_count = sizeof(glyph_rows) / sizeof(glyph_rows[0]);
+static_assert(sizeof(glyph_chars) == glyph_count, "a glyph for every char and the solid one");
+static const int solid_glyph = glyph_count - 1;
+
+// a cell is 4x6 texels, the glyph and a blank border against bleeding
+static const int cell_w = 4, cell_h = 6;
+static const int atlas_w = 256, atlas_h = 8;
+
+static const uint8_t text_color[4] = {255, 255, 255, 255};
+static const uint8_t panel_color[4] = {0, 0, 0, 160};
+static const uint8_t good_color[4] = {64, 224, 64, 255};
+static const uint8_t late_color[4] = {240, 64, 48, 255};
+static const uint8_t budget_color[4] = {160, 160, 160, 200};
+
+
+static int glyph_index(char c)
+{
+    const char* found = strchr(glyph_chars, c);
+    return found && c ? found - glyph_chars : 0;
+}
+
+
+bool perf_hud::init()
+{
+    static const char *vertex_shader_source =
+        "#version 300 es                                \n"
+        "layout(location = 0) in vec2 in_position;      \n"
+        "layout(location = 1) in vec2 in_TexCoord;      \n"
+        "layout(location = 2) in vec4 in_color;         \n"
+        "                                               \n"
+        "out vec2 vTexCoord;                            \n"
+        "out vec4 vColor;                               \n"
+        "                                               \n"
+        "void main()                                    \n"
+        "{                                              \n"
+        "    gl_Position = vec4(in_position, 0.0, 1.0); \n"
+        "    vTexCoord = in_TexCoord;                   \n"
+        "    vColor = in_color;                         \n"
+        "}                                              \n";
+
+    static const char *fragment_shader_source =
+        "#version 300 es                                \n"
+        "precision mediump float;                       \n"
+        "                                               \n"
+        "uniform sampler2D uAtlas;                      \n"
+        "                                               \n"
+        "in vec2 vTexCoord;                             \n"
+        "in vec4 vColor;                                \n"
+        "                                               \n"
+        "out vec4 o_FragColor;                          \n"
+        "                                               \n"
+        "void main()                                    \n"
+        "{                                              \n"
+        "    float coverage = texture(uAtlas, vTexCoord).r;         \n"
+        "    o_FragColor = vec4(vColor.rgb, vColor.a * coverage);   \n"
+        "}                                              \n";
+
+    program = create_program(vertex_shader_source, fragment_shader_source, "hud");
+    if (program == uint(-1))
+    {
+        program = 0;
+        return false;
+    }
+    u_atlas = glGetUniformLocation(program, "uAtlas");
+
+    std::vector<uint8_t> texels(atlas_w * atlas_h, 0);
+    for (int g = 0; g < glyph_count; ++g)
+    {
+        for (int row = 0; row < 5; ++row)
+        {
+            for (int col = 0; col < 3; ++col)
+            {
+                if (glyph_rows[g][row] & (4 >> col))
+                    texels[row * atlas_w + g * cell_w + col] = 255;
+            }
+        }
+    }
+    glGenTextures(1, &atlas);
+    resource_created(resource_kind::texture, uint64_t(atlas), texels.size(), "hud");
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, atlas_w, atlas_h, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &vbo);
+    return true;
+}
+
+
+void perf_hud::destroy()
+{
+    if (program)
+        destroy_program(program), program = 0;
+    if (atlas)
+    {
+        resource_destroyed(resource_kind::texture, uint64_t(atlas));
+        glDeleteTextures(1, &atlas), atlas = 0;
+    }
+    if (vbo)
+        glDeleteBuffers(1, &vbo), vbo = 0;
+}
+
+
+void perf_hud::set_text(const std::vector<std::string>& lines)
+{
+    text = lines;
+}
+
+
+void perf_hud::add_frame_time(double ms)
+{
+    frame_times[frame_index] = ms;
+    frame_index = (frame_index + 1) % graph_frames;
+}
+
+
+void perf_hud::quad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, const uint8_t color[4])
+{
+    // pixels from the top left to clip space
+    const float x0 = x * ndc_x - 1.0f, x1 = (x + w) * ndc_x - 1.0f;
+    const float y0 = y_sign * (1.0f - y * ndc_y), y1 = y_sign * (1.0f - (y + h) * ndc_y);
+    const vertex corners[4] = {
+        { x0, y0, u0, v0, {color[0], color[1], color[2], color[3]} },
+        { x1, y0, u1, v0, {color[0], color[1], color[2], color[3]} },
+        { x0, y1, u0, v1, {color[0], color[1], color[2], color[3]} },
+        { x1, y1, u1, v1, {color[0], color[1], color[2], color[3]} },
+    };
+    for (int i : { 0, 2, 1, 1, 2, 3 })
+        vertices.push_back(corners[i]);
+}
+
+
+void perf_hud::draw(int width, int height, bool flip_y)
+{
+    if (!program || width <= 0 || height <= 0)
+        return;
+
+    ndc_x = 2.0f / width;
+    ndc_y = 2.0f / height;
+    y_sign = flip_y ? -1.0f : 1.0f;
+
+    const int scale = height >= 1080 ? 3 : 2;
+    const int advance = cell_w * scale;
+    const int line_height = (cell_h + 1) * scale;
+    const int pad = 2 * scale;
+    const int bar_width = scale;
+    const int graph_height = 20 * scale;
+
+    size_t columns = 0;
+    for (const std::string& line : text)
+        columns = std::max(columns, line.size());
+    const int panel_w = std::max<int>(columns * advance, graph_frames * bar_width) + 2 * pad;
+    const int text_h = text.size() * line_height;
+    const int panel_h = text_h + graph_height + 3 * pad;
+
+    vertices.clear();
+    const float solid_u = (solid_glyph * cell_w + 1.5f) / atlas_w, solid_v = 2.5f / atlas_h;
+    quad(0, 0, panel_w, panel_h, solid_u, solid_v, solid_u, solid_v, panel_color);
+
+    for (size_t l = 0; l < text.size(); ++l)
+    {
+        const float y = pad + l * line_height;
+        for (size_t c = 0; c < text[l].size(); ++c)
+        {
+            const int g = glyph_index(text[l][c]);
+            if (g == 0)
+                continue;
+            const float u0 = float(g * cell_w) / atlas_w, u1 = float(g * cell_w + 3) / atlas_w;
+            quad(pad + c * advance, y, 3 * scale, 5 * scale, u0, 0.0f, u1, 5.0f / atlas_h, text_color);
+        }
+    }
+
+    // oldest frame on the left, the budget line halfway up
+    const float graph_top = text_h + 2 * pad;
+    const float graph_bottom = graph_top + graph_height;
+    quad(pad, graph_top + graph_height / 2, graph_frames * bar_width, 1, solid_u, solid_v, solid_u, solid_v, budget_color);
+    for (int k = 0; k < graph_frames; ++k)
+    {
+        const float ms = frame_times[(frame_index + k) % graph_frames];
+        if (ms <= 0.0f)
+            continue;
+        const float h = std::min(1.0f, float(ms / (2.0 * budget_ms))) * graph_height;
+        quad(pad + k * bar_width, graph_bottom - h, bar_width, h, solid_u, solid_v, solid_u, solid_v,
+             ms > budget_ms * 1.5 ? late_color : good_color);
+    }
+
+    // orphaned, so the driver never waits for last frame's draw to finish with it
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(vertex), vertices.data());
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (const GLvoid*)offsetof(vertex, x));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (const GLvoid*)offsetof(vertex, u));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex), (const GLvoid*)offsetof(vertex, color));
+    glEnableVertexAttribArray(2);
+
+    const bool depth_test = glIsEnabled(GL_DEPTH_TEST);
+    const bool cull_face = glIsEnabled(GL_CULL_FACE);
+    const bool blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(program);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glUniform1i(u_atlas, 0);
+    glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+
+    glDisableVertexAttribArray(2);
+    if (depth_test)
+        glEnable(GL_DEPTH_TEST);
+    if (cull_face)
+        glEnable(GL_CULL_FACE);
+    if (!blend)
+        glDisable(GL_BLEND);
+}
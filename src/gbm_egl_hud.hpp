@@ -0,0 +1,52 @@
+#ifndef _gbm_egl_hud_hpp__
+#define _gbm_egl_hud_hpp__
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// performance overlay: lines of text and a frame time graph, drawn with one
+// draw call from a glyph atlas and a single vertex buffer that is orphaned
+// and refilled every frame
+class perf_hud
+{
+public:
+    bool init();
+    void destroy();
+
+    // replaces the text, upper case letters, digits and . : - / %
+    void set_text(const std::vector<std::string>& lines);
+    // time of the last frame, the graph keeps the most recent ones
+    void add_frame_time(double ms);
+    // frame times above this are drawn red, the graph tops out at twice it
+    void set_budget(double ms) { budget_ms = ms; }
+
+    // in the top left corner of the bound width x height framebuffer
+    void draw(int width, int height, bool flip_y);
+
+private:
+    struct vertex
+    {
+        float x, y;
+        float u, v;
+        uint8_t color[4];
+    };
+    void quad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, const uint8_t color[4]);
+
+    static constexpr int graph_frames = 120;
+
+    uint program = 0;
+    uint atlas = 0;
+    uint vbo = 0;
+    int u_atlas = -1;
+    std::vector<std::string> text;
+    std::vector<vertex> vertices;
+    float frame_times[graph_frames] = {};
+    int frame_index = 0;
+    double budget_ms = 16.7;
+    float ndc_x = 0, ndc_y = 0;
+    float y_sign = 1;       // -1 when the target is scanned out upside down
+};
+
+#endif
@@ -1,16 +1,107 @@
 #include "gbm_egl_instance.hpp"
+#include "gbm_egl_trace.hpp"
+#include "gbm_egl_options.hpp"
+#include "gbm_egl_realtime.hpp"
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
+#include <math.h>
 #include <iostream>
+#include <algorithm>
+#include <string.h>
+#include <signal.h>
+#ifdef GBM_EGL_HAS_REALSENSE
 #include <librealsense2/rs.hpp>
+#endif
 
-#define RS_COLOR_WIDTH 1920
-#define RS_COLOR_HEIGHT 1080
-#define RS_DEPTH_WIDTH 1280
-#define RS_DEPTH_HEIGHT 720
-#define RS_FPS 30
+// gles 3.0, not in the gles2 headers
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
 
-static rs2::pipeline pipe;
+// generated frames, else the camera or a recording of it
+static bool synthetic_source()
+{
+	const char* source = gbm_egl_options::get().source;
+	return source && (strcmp(source, "synthetic") == 0 || strcmp(source, "static") == 0);
+}
+
+#ifdef GBM_EGL_HAS_REALSENSE
+static rs2::pipeline camera_pipe;
+
+
+static bool start_stream(const stream_profile& profile)
+{
+	rs2::config cfg;
+	// a recording loops, its streams have to match the profile
+	const char* source = gbm_egl_options::get().source;
+	if (source && !synthetic_source())
+		cfg.enable_device_from_file(source, true);
+	cfg.enable_stream(RS2_STREAM_COLOR, profile.color_width, profile.color_height, RS2_FORMAT_YUYV, profile.fps);
+	cfg.enable_stream(RS2_STREAM_DEPTH, profile.depth_width, profile.depth_height, RS2_FORMAT_Z16, profile.fps);
+	try
+	{
+		camera_pipe.start(cfg);
+		return true;
+	}
+	catch (const rs2::error& e)
+	{
+		std::cerr << "failed to start camera streams: " << e.what() << std::endl;
+		return false;
+	}
+}
+#endif
+
+// SIGUSR2 moves on to the next stream profile
+static std::atomic_int profile_switches {0};
+
+
+// "1920x1080+1280x720@30,640x480@90": color+depth, or one size for both
+// the same streams at a rate the camera offers, at most half the original
+static stream_profile at_fps(stream_profile profile, bool reduced)
+{
+	if (reduced)
+	{
+		for (int fps : { 60, 30, 15, 6 })
+		{
+			if (fps <= profile.fps / 2)
+			{
+				profile.fps = fps;
+				break;
+			}
+		}
+	}
+	return profile;
+}
+
+
+static std::vector<stream_profile> parse_profiles(const char* list)
+{
+	std::vector<stream_profile> profiles;
+	for (const char* p = list; p && *p; )
+	{
+		stream_profile profile;
+		int consumed = 0;
+		if (sscanf(p, "%dx%d+%dx%d@%d%n", &profile.color_width, &profile.color_height,
+		           &profile.depth_width, &profile.depth_height, &profile.fps, &consumed) == 5)
+			profiles.push_back(profile);
+		else if (sscanf(p, "%dx%d@%d%n", &profile.color_width, &profile.color_height, &profile.fps, &consumed) == 3)
+		{
+			profile.depth_width = profile.color_width;
+			profile.depth_height = profile.color_height;
+			profiles.push_back(profile);
+		}
+		else
+			std::cerr << "ignoring stream profile " << p << std::endl;
+
+		p = strchr(p, ',');
+		if (p)
+			++p;
+	}
+
+	if (profiles.empty())
+		profiles.push_back(stream_profile());
+	return profiles;
+}
 
 gbm_egl_device_interface* gbm_egl_instance::new_instance()
 {
@@ -30,6 +121,13 @@ void gbm_egl_instance::begin_impl()
 
     float aspect = (float)get_resolution_height() / (float)get_resolution_width();
 	projection_matrix.frustum(-2.8f, +2.8f, -2.8f * aspect, +2.8f * aspect, 6.0f, 10.0f);
+	if (render_target_flipped())
+	{
+		// mirror clip space y, which also turns the winding around
+		for (int i = 0; i < 4; ++i)
+			projection_matrix.m[i][1] = -projection_matrix.m[i][1];
+		glFrontFace(GL_CW);
+	}
 
     generic_program = create_generic_program();
 	{
@@ -37,14 +135,6 @@ void gbm_egl_instance::begin_impl()
 //		u_mvp = glGetUniformLocation(generic_program, "mvp");
 		GLuint samplerLoc = glGetUniformLocation(generic_program, "uTex");
 		glUniform1i(samplerLoc, 0);
-		if (create_texture(RS_COLOR_WIDTH, RS_COLOR_HEIGHT, color_texture, TextureFormat::YUYV))
-		{
-			glBindTexture(GL_TEXTURE_EXTERNAL_OES, color_texture.id);
-			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			glTexParameterf(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameterf(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		}
 	}
 
 	z16_program = create_z16_program();
@@ -53,79 +143,456 @@ void gbm_egl_instance::begin_impl()
 //		u_mvp = glGetUniformLocation(z16_program, "mvp");
 		GLuint samplerLoc = glGetUniformLocation(z16_program, "uTex");
 		glUniform1i(samplerLoc, 0);
-		if (create_texture(RS_DEPTH_WIDTH, RS_DEPTH_HEIGHT, depth_texture, TextureFormat::Depth16))
-		{
-			glBindTexture(GL_TEXTURE_EXTERNAL_OES, depth_texture.id);
-			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-			glTexParameterf(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameterf(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		}
 	}
 
+	texture2d_program = create_texture2d_program();
+	{
+		glUseProgram(texture2d_program);
+		glUniform1i(glGetUniformLocation(texture2d_program, "uTex"), 0);
+	}
+
+	acquire_stream_textures(profiles[texture_profile]);
+	pending_profile = texture_profile;
+
     cube_vbo = create_geometry_cube();
+	if (gbm_egl_options::get().mesh)
+	{
+		// copying a large mesh into buffers takes a while, the cube stands in
+		const char* path = gbm_egl_options::get().mesh;
+		std::shared_ptr<gl_mesh> loaded = std::make_shared<gl_mesh>();
+		uploads().submit([path, loaded](){ load_mesh(path, *loaded); },
+		                 [this, loaded](){ mesh = *loaded; });
+	}
+
+	// the camera was started in prepare_impl, frames flow once it is up
+	processing_thread = std::thread([this](){
+		if (camera_startup.joinable())
+			camera_startup.join();
+		if (!camera_streaming && !synthetic_source())
+			return;
+		trace_thread_name("camera processing");
+
+		apply_ingest_profile(profiles[0].fps);
+
+		if (synthetic_source())
+		{
+			synthetic_loop();
+			return;
+		}
+
+#ifdef GBM_EGL_HAS_REALSENSE
+		bool first_frame = true;
+		unsigned long long last_frame_number = 0;
+		int active = 0;
+		int handled_switches = profile_switches;
+		const double cycle_ms = gbm_egl_options::get().profile_cycle * 1000.0;
+		double switch_time = monotonic_ms();
+		bool switching = false;
+		bool low_fps = false;
+		bool handled_fps = false;
+		int retry_ms = 0;
+		while (running)
+		{
+			if (!camera_streaming)
+			{
+				// nothing came back up, the last profile that worked is tried
+				// again, backing off to once every 5 s
+				retry_ms = std::min(retry_ms ? retry_ms * 2 : 100, 5000);
+				const double retry_time = monotonic_ms() + retry_ms;
+				while (running && monotonic_ms() < retry_time)
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				if (!running)
+					break;
+				camera_streaming = start_stream(at_fps(profiles[active], low_fps));
+				if (!camera_streaming)
+					continue;
+				retry_ms = 0;
+				switch_time = monotonic_ms();
+				switching = true;
+			}
+
+			int next = active;
+			if (profile_switches != handled_switches)
+				handled_switches = profile_switches, next = (active + 1) % profiles.size();
+			else if (cycle_ms > 0 && monotonic_ms() - switch_time > cycle_ms)
+				next = (active + 1) % profiles.size();
+
+			if (next != active)
+			{
+				// the render thread swaps the textures while the camera restarts
+				trace_span span("stream switch");
+				switch_time = monotonic_ms();
+				camera_pipe.stop();
+				if (!start_stream(at_fps(profiles[next], low_fps)))
+				{
+					// the camera does not support it, stay with what worked
+					camera_streaming = start_stream(at_fps(profiles[active], low_fps));
+					if (!camera_streaming)
+						std::cerr << "camera streams did not come back, retrying" << std::endl;
+					switch_time = monotonic_ms();
+					continue;
+				}
+				requested_profile = next;
+				while (running && ready_profile != next)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				active = next;
+				switching = true;
+			}
+			else if (reduced_fps != handled_fps)
+			{
+				// same resolutions, the textures stay as they are
+				trace_span span("camera fps change");
+				handled_fps = reduced_fps;
+				switch_time = monotonic_ms();
+				camera_pipe.stop();
+				if (start_stream(at_fps(profiles[active], handled_fps)))
+					low_fps = handled_fps;
+				else
+					camera_streaming = start_stream(at_fps(profiles[active], low_fps));
+				if (!camera_streaming)
+				{
+					std::cerr << "camera streams did not come back, retrying" << std::endl;
+					continue;
+				}
+				switching = true;
+			}
 
-	// realsense
-	rs2::context ctx;
-	auto devicelist = ctx.query_devices();
-	if (devicelist.size() > 0)
-	{
-		rs2::log_to_console(RS2_LOG_SEVERITY_WARN);
-		rs2::device dev = devicelist.front();
-		fprintf(stdout, "\nRealsense Device info---\n"
-		                "    Name              : %s\n"
-						"    Serial Number     : %s\n"
-						"    Firmware Version  : %s\n"
-						"    USB Type          : %s\n"
-						"    Stream Color      : %d, %d\n"
-						"    Stream Depth      : %d, %d\n"
-						"    FPS               : %d\n",
-							dev.get_info(RS2_CAMERA_INFO_NAME),
-							dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER),
-							dev.get_info(RS2_CAMERA_INFO_FIRMWARE_VERSION),
-							dev.get_info(RS2_CAMERA_INFO_USB_TYPE_DESCRIPTOR),
-							RS_COLOR_WIDTH, RS_COLOR_HEIGHT, 
-							RS_DEPTH_WIDTH, RS_DEPTH_HEIGHT, 
-							RS_FPS);
-
-		rs2::config cfg;
-		cfg.enable_stream(RS2_STREAM_COLOR, RS_COLOR_WIDTH, RS_COLOR_HEIGHT, RS2_FORMAT_YUYV, RS_FPS);
-		cfg.enable_stream(RS2_STREAM_DEPTH, RS_DEPTH_WIDTH, RS_DEPTH_HEIGHT, RS2_FORMAT_Z16, RS_FPS);
-		pipe.start(cfg);
-
-    	processing_thread = std::thread([&](){
-			while (running)
+			apply_ingest_profile(at_fps(profiles[active], low_fps).fps);
+
+			// a camera that goes away throws instead of timing out
+			rs2::frameset fs;
+			bool arrived = false;
+			try
+			{
+				arrived = camera_pipe.try_wait_for_frames(&fs, 1000);
+			}
+			catch (const rs2::error& e)
 			{
-				rs2::frameset fs;
-				if (pipe.try_wait_for_frames(&fs, 1000))
+				std::cerr << "camera streams failed: " << e.what() << ", restarting" << std::endl;
+				try
 				{
-					rs2::frame color_frame = fs.get_color_frame();
-					update_texture(color_texture, color_frame.get_data());
+					camera_pipe.stop();
+				}
+				catch (const rs2::error&)
+				{
+				}
+				camera_streaming = false;
+				continue;
+			}
+			if (arrived)
+			{
+				trace_counter("camera frame", fs.get_frame_number());
+				camera_frames_total.add();
+				// gaps in the numbering were dropped by the camera or librealsense
+				const unsigned long long number = fs.get_frame_number();
+				if (last_frame_number && number > last_frame_number + 1 && !switching)
+					camera_dropped_total.add(number - last_frame_number - 1);
+				last_frame_number = number;
+				rs2::frame color_frame = fs.get_color_frame();
+				rs2::frame depth_frame = fs.get_depth_frame();
+				ingest_frameset(profiles[active], color_frame.get_data(), color_frame.get_data_size(),
+				                depth_frame.get_data(), depth_frame.get_data_size());
 
-					rs2::frame depth_frame = fs.get_depth_frame();
-					update_texture(depth_texture, depth_frame.get_data());
+				if (switching)
+				{
+					const stream_profile profile = at_fps(profiles[active], low_fps);
+					fprintf(stdout, "stream profile %dx%d+%dx%d@%d live after %.1f ms\n",
+					                profile.color_width, profile.color_height,
+					                profile.depth_width, profile.depth_height, profile.fps,
+					                monotonic_ms() - switch_time);
+					switching = false;
 				}
+
+				// both domains are host system clock, the oldest frame bounds latency
+				if (color_frame.get_frame_timestamp_domain() != RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK &&
+					depth_frame.get_frame_timestamp_domain() != RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK)
+					set_source_timestamp(std::min(color_frame.get_timestamp(), depth_frame.get_timestamp()));
+
+				if (first_frame)
+					mark_startup("first camera frame"), first_frame = false;
 			}
+		}
+#endif
+	});
+}
+
+
+void gbm_egl_instance::ingest_frameset(const stream_profile& profile, const void* color, size_t color_size,
+                                       const void* depth, size_t depth_size)
+{
+	// both streams at once, published together once both are in
+	bool color_fits = color_size == size_t(profile.color_width) * profile.color_height * 2;
+	bool depth_fits = depth_size == size_t(profile.depth_width) * profile.depth_height * 2;
+	bool color_changed = true;
+	bool depth_changed = true;
+	task_group streams;
+	if (color_fits)
+		tasks().run(streams, [&](){
+			color_fits = update_texture(color_texture, color, profile.color_width, profile.color_height,
+			                            color_ingest, &color_changed);
 		});
+	if (depth_fits)
+		tasks().run(streams, [&](){
+			depth_fits = update_texture(depth_texture, depth, profile.depth_width, profile.depth_height,
+			                            depth_ingest, &depth_changed);
+		});
+	tasks().wait(streams);
+	// the cached layers only need rendering again for a frame that differs
+	if (color_fits && color_changed)
+		++color_frames;
+	else if (!color_fits)
+		camera_dropped_total.add();
+	if (depth_fits && depth_changed)
+		++depth_frames;
+	else if (!depth_fits)
+		camera_dropped_total.add();
+}
+
+
+void gbm_egl_instance::synthetic_loop()
+{
+	// a bar sweeping over gradients, or the first of those frames over and
+	// over, made up front so producing a frame costs nothing
+	const int phases = strcmp(gbm_egl_options::get().source, "static") == 0 ? 1 : 8;
+	std::vector<std::vector<uint8_t>> colors;
+	std::vector<std::vector<uint16_t>> depths;
+	auto make_frames = [&](const stream_profile& profile){
+		const int cw = profile.color_width, ch = profile.color_height;
+		const int dw = profile.depth_width, dh = profile.depth_height;
+		colors.assign(phases, std::vector<uint8_t>(size_t(cw) * ch * 2));
+		depths.assign(phases, std::vector<uint16_t>(size_t(dw) * dh));
+		for (int phase = 0; phase < phases; ++phase)
+		{
+			const int color_bar = phase * cw / phases;
+			for (int y = 0; y < ch; ++y)
+			{
+				uint8_t* row = colors[phase].data() + size_t(y) * cw * 2;
+				for (int x = 0; x + 1 < cw; x += 2)
+				{
+					const bool bar = x >= color_bar && x < color_bar + cw / 16;
+					const uint8_t luma = bar ? 235 : uint8_t(16 + (x + y) * 200 / (cw + ch));
+					row[x * 2 + 0] = luma;
+					row[x * 2 + 1] = uint8_t(x * 255 / cw);
+					row[x * 2 + 2] = luma;
+					row[x * 2 + 3] = uint8_t(y * 255 / ch);
+				}
+			}
+			// a floor sloping away, the bar in front of it, and a few holes
+			const int depth_bar = phase * dw / phases;
+			for (int y = 0; y < dh; ++y)
+			{
+				uint16_t* row = depths[phase].data() + size_t(y) * dw;
+				for (int x = 0; x < dw; ++x)
+				{
+					const bool bar = x >= depth_bar && x < depth_bar + dw / 16;
+					row[x] = (x * 7 + y * 13) % 97 == 0 ? 0 : uint16_t(bar ? 600 : 1000 + y * 4000 / dh);
+				}
+			}
+		}
+		std::cout << (phases == 1 ? "static" : "synthetic") << " camera frames "
+		          << cw << "x" << ch << "+" << dw << "x" << dh << "@" << profile.fps << std::endl;
+	};
+	int active = 0;
+	make_frames(profiles[active]);
+	mark_startup("camera streaming");
+
+	// profiles switch like they do with the camera, on SIGUSR2 or every
+	// GBM_EGL_PROFILE_CYCLE seconds
+	int handled_switches = profile_switches;
+	const double cycle_ms = gbm_egl_options::get().profile_cycle * 1000.0;
+	double switch_time = monotonic_ms();
+	bool first_frame = true;
+	double next = monotonic_ms();
+	for (uint64_t number = 0; running; ++number)
+	{
+		int wanted = active;
+		if (profile_switches != handled_switches)
+			handled_switches = profile_switches, wanted = (active + 1) % profiles.size();
+		else if (cycle_ms > 0 && monotonic_ms() - switch_time > cycle_ms)
+			wanted = (active + 1) % profiles.size();
+		if (wanted != active)
+		{
+			trace_span span("stream switch");
+			requested_profile = wanted;
+			make_frames(profiles[wanted]);
+			while (running && ready_profile != wanted)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			active = wanted;
+			switch_time = next = monotonic_ms();
+		}
+		const stream_profile& profile = profiles[active];
+		apply_ingest_profile(at_fps(profile, reduced_fps).fps);
+
+		const double now = monotonic_ms();
+		if (next > now)
+			std::this_thread::sleep_for(std::chrono::microseconds(int64_t((next - now) * 1000.0)));
+		// a camera does not catch up on frames it missed either
+		next = std::max(next, now) + 1000.0 / at_fps(profile, reduced_fps).fps;
+
+		trace_counter("camera frame", number);
+		camera_frames_total.add();
+		const double captured = realtime_ms();
+		const int phase = number % phases;
+		ingest_frameset(profile, colors[phase].data(), colors[phase].size(),
+		                depths[phase].data(), depths[phase].size() * sizeof(uint16_t));
+		set_source_timestamp(captured);
+
+		if (first_frame)
+			mark_startup("first camera frame"), first_frame = false;
+	}
+}
+
+
+void gbm_egl_instance::apply_ingest_profile(int fps)
+{
+	// short bursts once per camera frame, they come before the render
+	// thread so a frame is never held up behind a draw
+	const auto& options = gbm_egl_options::get();
+	thread_profile ingest;
+	ingest.policy = parse_rt_policy(options.realtime);
+	// only a deadline reservation depends on the rate
+	if (ingest_fps && (ingest.policy != rt_policy::deadline || fps == ingest_fps))
+		return;
+	ingest_fps = fps;
+	ingest.priority = 51;
+	ingest.period_ms = 1000.0 / fps;
+	ingest.runtime_ms = ingest.period_ms * 0.25;
+	ingest.cpu = options.ingest_cpu;
+	apply_thread_profile("camera processing", ingest);
+}
+
+
+gbm_egl_instance::~gbm_egl_instance()
+{
+	// begin_impl never ran if the display could not be brought up
+	if (camera_startup.joinable())
+		camera_startup.join();
+#ifdef GBM_EGL_HAS_REALSENSE
+	if (camera_streaming)
+		camera_pipe.stop();
+#endif
+}
+
+
+void gbm_egl_instance::prepare_impl()
+{
+	const auto& options = gbm_egl_options::get();
+	profiles = parse_profiles(options.profiles);
+
+	auto parse_window = [](const char* roi, int decimate, bool depth_min){
+		ingest_window window;
+		if (roi && sscanf(roi, "%d,%d,%d,%d", &window.x, &window.y, &window.width, &window.height) != 4)
+		{
+			std::cerr << "ignoring region of interest " << roi << ", expected x,y,w,h" << std::endl;
+			window = ingest_window();
+		}
+		window.decimate = decimate;
+		window.depth_min = depth_min;
+		return window;
+	};
+	color_ingest = parse_window(options.color_roi, options.color_decimate, false);
+	depth_ingest = parse_window(options.depth_roi, options.depth_decimate, options.depth_min);
+	signal(SIGUSR2, [](int){ ++profile_switches; });
+
+	if (synthetic_source())
+	{
+		// no camera to bring up, frames are made on the processing thread
+		return;
 	}
+
+	// enumeration and stream start take seconds, overlap them with the
+	// drm / egl bring-up instead of running them after it
+#ifdef GBM_EGL_HAS_REALSENSE
+	camera_startup = std::thread([this](){
+		trace_thread_name("camera startup");
+		trace_span span("camera startup");
+		if (gbm_egl_options::get().source)
+		{
+			// a recording, nothing to enumerate
+			camera_streaming = start_stream(profiles[0]);
+			if (camera_streaming)
+				mark_startup("camera streaming");
+			return;
+		}
+		rs2::context ctx;
+		auto devicelist = ctx.query_devices();
+		mark_startup("camera enumerated");
+		if (devicelist.size() > 0)
+		{
+			rs2::log_to_console(RS2_LOG_SEVERITY_WARN);
+			rs2::device dev = devicelist.front();
+			fprintf(stdout, "\nRealsense Device info---\n"
+			                "    Name              : %s\n"
+							"    Serial Number     : %s\n"
+							"    Firmware Version  : %s\n"
+							"    USB Type          : %s\n"
+							"    Stream Color      : %d, %d\n"
+							"    Stream Depth      : %d, %d\n"
+							"    FPS               : %d\n",
+								dev.get_info(RS2_CAMERA_INFO_NAME),
+								dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER),
+								dev.get_info(RS2_CAMERA_INFO_FIRMWARE_VERSION),
+								dev.get_info(RS2_CAMERA_INFO_USB_TYPE_DESCRIPTOR),
+								profiles[0].color_width, profiles[0].color_height, 
+								profiles[0].depth_width, profiles[0].depth_height, 
+								profiles[0].fps);
+
+			camera_streaming = start_stream(profiles[0]);
+			if (camera_streaming)
+				mark_startup("camera streaming");
+		}
+	});
+#else
+	std::cout << "built without RealSense, no camera" << std::endl;
+#endif
+}
+
+
+void gbm_egl_instance::placeholder_impl()
+{
+    glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 
 void gbm_egl_instance::end_impl()
 {
 	processing_thread.join();
-	pipe.stop();
+#ifdef GBM_EGL_HAS_REALSENSE
+	if (camera_streaming)
+		camera_pipe.stop();
+#endif
+	camera_streaming = false;
 
+	uploads().finish();
 	destroy_geometry(cube_vbo);
-	destroy_texture(color_texture);
-	destroy_texture(depth_texture);
+	destroy_mesh(mesh);
+	release_texture(color_texture);
+	release_texture(depth_texture);
 	destroy_program(generic_program);
 	destroy_program(z16_program);
+	destroy_program(texture2d_program);
+	color_fx.destroy();
+	depth_fx.destroy();
+	color_preview.destroy();
+	postfx_release_programs();
+
+	for (const cached_layer* layer : { &color_layer, &depth_layer, &preview_layer })
+		if (layer->renders)
+			fprintf(stdout, "%s: %llu renders, %llu cache hits\n", layer->name,
+			                (unsigned long long)layer->renders, (unsigned long long)layer->hits);
 }
 
 
 void gbm_egl_instance::update_impl()
 {
+	const int wanted = requested_profile;
+	if (wanted != texture_profile)
+		switch_stream_textures(wanted);
+	if (pending_profile >= 0 && texture_ready(color_texture) && texture_ready(depth_texture))
+		setup_stream_textures();
+	select_preview();
+
     ++count;
 
     color_matrix.identity();
@@ -142,25 +609,312 @@ void gbm_egl_instance::update_impl()
 }
 
 
+static const char* sharpen_glsl =
+	"    vec4 c = in0(uv);\n"
+	"    vec4 blur = in0(uv + vec2(texel.x, 0.0)) + in0(uv - vec2(texel.x, 0.0)) +\n"
+	"                in0(uv + vec2(0.0, texel.y)) + in0(uv - vec2(0.0, texel.y));\n"
+	"    return vec4(clamp(c.rgb * 2.0 - blur.rgb * 0.25, 0.0, 1.0), 1.0);";
+
+// same unpacking as the z16 program
+static const char* z16_glsl =
+	"    ivec3 v = ivec3(c0.rgb * 255.0);\n"
+	"    return vec4(float((v.r << 11) | (v.g << 5) | v.b) / 65535.0);";
+
+static const char* sobel_glsl =
+	"    float tl = in0(uv + texel * vec2(-1.0, -1.0)).r;\n"
+	"    float t  = in0(uv + texel * vec2( 0.0, -1.0)).r;\n"
+	"    float tr = in0(uv + texel * vec2( 1.0, -1.0)).r;\n"
+	"    float l  = in0(uv + texel * vec2(-1.0,  0.0)).r;\n"
+	"    float r  = in0(uv + texel * vec2( 1.0,  0.0)).r;\n"
+	"    float bl = in0(uv + texel * vec2(-1.0,  1.0)).r;\n"
+	"    float b  = in0(uv + texel * vec2( 0.0,  1.0)).r;\n"
+	"    float br = in0(uv + texel * vec2( 1.0,  1.0)).r;\n"
+	"    float gx = (tr + 2.0 * r + br) - (tl + 2.0 * l + bl);\n"
+	"    float gy = (bl + 2.0 * b + br) - (tl + 2.0 * t + tr);\n"
+	"    return vec4(clamp(length(vec2(gx, gy)) * 64.0, 0.0, 1.0));";
+
+static const char* edge_color_glsl =
+	"    return vec4(0.0, c0.r, 0.0, c0.r);";
+
+static const char* overlay_glsl =
+	"    return vec4(mix(c0.rgb, c1.rgb, c1.a), 1.0);";
+
+// uv is the corner shared by the 2x2 source texels of a half size pixel
+static const char* box_glsl =
+	"    return 0.25 * (in0(uv + texel * vec2(-0.5, -0.5)) + in0(uv + texel * vec2(0.5, -0.5)) +\n"
+	"                   in0(uv + texel * vec2(-0.5,  0.5)) + in0(uv + texel * vec2(0.5,  0.5)));";
+
+
+gbm_egl_device_impl::ingest_window gbm_egl_instance::color_window(const stream_profile& profile) const
+{
+	return clamp_window(color_ingest, profile.color_width, profile.color_height, TextureFormat::YUYV);
+}
+
+
+gbm_egl_device_impl::ingest_window gbm_egl_instance::depth_window(const stream_profile& profile) const
+{
+	return clamp_window(depth_ingest, profile.depth_width, profile.depth_height, TextureFormat::Depth16);
+}
+
+
+bool gbm_egl_instance::acquire_stream_textures(const stream_profile& profile)
+{
+	// only the windows are copied, the textures are no larger
+	const ingest_window color = color_window(profile);
+	const ingest_window depth = depth_window(profile);
+	bool ok = acquire_texture(color.width / color.decimate, color.height / color.decimate, color_texture, TextureFormat::YUYV);
+	ok = acquire_texture(depth.width / depth.decimate, depth.height / depth.decimate, depth_texture, TextureFormat::Depth16) && ok;
+	return ok;
+}
+
+
+void gbm_egl_instance::setup_stream_textures()
+{
+	for (const oes_texture* texture : { &color_texture, &depth_texture })
+	{
+		if (!texture->id)
+			continue;
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture->id);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameterf(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameterf(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+
+	build_filters();
+
+	ready_profile = pending_profile;
+	pending_profile = -1;
+}
+
+
+void gbm_egl_instance::switch_stream_textures(int profile)
+{
+	trace_span span("switch stream textures");
+	release_texture(color_texture);
+	release_texture(depth_texture);
+	acquire_stream_textures(profiles[profile]);
+
+	// the graphs read the old textures, their programs stay cached and
+	// new ones are built once the textures are ready
+	reset_filters();
+
+	texture_profile = profile;
+	pending_profile = profile;
+}
+
+
+void gbm_egl_instance::build_filters()
+{
+	if (gbm_egl_options::get().postfx)
+		build_postfx(gbm_egl_options::get().postfx);
+	if (gbm_egl_options::get().preview_pyramid)
+		build_preview();
+}
+
+
+void gbm_egl_instance::reset_filters()
+{
+	color_fx.reset();
+	depth_fx.reset();
+	color_preview.reset();
+	use_preview = false;
+	preview_level = -1;
+	color_reads_depth = false;
+	color_layer.invalidate();
+	depth_layer.invalidate();
+	preview_layer.invalidate();
+}
+
+
+void gbm_egl_instance::quality_impl(const quality_level& level)
+{
+	reduced_fps = level.reduced_fps;
+
+	const int divisor = level.reduced_filters ? 2 : 1;
+	if (divisor == postfx_divisor)
+		return;
+	postfx_divisor = divisor;
+	// otherwise setup_stream_textures builds them at this size
+	if (pending_profile < 0 && gbm_egl_options::get().postfx)
+	{
+		reset_filters();
+		build_filters();
+	}
+}
+
+
+void gbm_egl_instance::build_postfx(const char* effects)
+{
+	const bool sharpen = strstr(effects, "sharpen");
+	const bool edges = strstr(effects, "edges");
+	const bool overlay = strstr(effects, "overlay");
+
+	if (sharpen || overlay)
+	{
+		int color = color_fx.source(color_texture.id, GL_TEXTURE_EXTERNAL_OES, color_texture.width, color_texture.height);
+		if (sharpen)
+			color = color_fx.neighbourhood("sharpen", sharpen_glsl, color);
+		if (overlay)
+		{
+			int depth = color_fx.source(depth_texture.id, GL_TEXTURE_EXTERNAL_OES, depth_texture.width, depth_texture.height);
+			depth = color_fx.point("z16", z16_glsl, { depth });
+			depth = color_fx.neighbourhood("sobel", sobel_glsl, depth);
+			depth = color_fx.point("edge color", edge_color_glsl, { depth });
+			color = color_fx.point("overlay", overlay_glsl, { color, depth });
+			color_reads_depth = true;
+		}
+		color_fx.compile(color, color_texture.width / postfx_divisor, color_texture.height / postfx_divisor);
+	}
+
+	if (edges)
+	{
+		int depth = depth_fx.source(depth_texture.id, GL_TEXTURE_EXTERNAL_OES, depth_texture.width, depth_texture.height);
+		depth = depth_fx.point("z16", z16_glsl, { depth });
+		depth = depth_fx.neighbourhood("sobel", sobel_glsl, depth);
+		depth = depth_fx.point("edge color", edge_color_glsl, { depth });
+		depth_fx.compile(depth, depth_texture.width / postfx_divisor, depth_texture.height / postfx_divisor);
+	}
+}
+
+
+void gbm_egl_instance::build_preview()
+{
+	int color = color_fx.pass_count()
+		? color_preview.source(color_fx.output_texture(), GL_TEXTURE_2D, color_texture.width / postfx_divisor, color_texture.height / postfx_divisor)
+		: color_preview.source(color_texture.id, GL_TEXTURE_EXTERNAL_OES, color_texture.width, color_texture.height);
+	color = color_preview.neighbourhood("box 2x2", box_glsl, color);
+	if (!color_preview.compile(color, color_texture.width / 2, color_texture.height / 2))
+	{
+		color_preview.reset();
+		return;
+	}
+
+	// the 1/4 and 1/8 levels are generated from it, the sampler picks
+	// whichever matches the footprint of each pixel
+	glBindTexture(GL_TEXTURE_2D, color_preview.output_texture());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 2);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	preview_level = -1;
+}
+
+
+void gbm_egl_instance::select_preview()
+{
+	if (!color_texture.width)
+		return;
+
+	// a face of the cube (or the mesh's unit sphere) spans two units at the
+	// distance of the model, projected onto the screen height
+	const float distance = fabsf(color_matrix.m[3][2]);
+	const float face = fabsf(projection_matrix.m[1][1]) / distance * get_resolution_height() * render_scale();
+	const float ratio = color_texture.width / std::max(face, 1.0f);
+	const int level = !color_preview.pass_count() || ratio < 2.0f ? 0 : std::min(3, int(log2f(ratio)));
+
+	// texels read per screen pixel, a proxy for the sampling bandwidth. a
+	// texel counts as 4 bytes, a face as face x face pixels
+	const float full = ratio * ratio;
+	const float scaled = std::max(1.0f, full / float(1 << (2 * level)));
+	color_sampled_bytes = uint64_t(face * face * scaled * 4.0f);
+	if (level == preview_level)
+		return;
+	preview_level = level;
+	use_preview = level > 0;
+
+	if (color_preview.pass_count())
+		fprintf(stdout, "color %dx%d on a %.0f px face: %.1f texels per pixel at full size, %.1f from the 1/%d level\n",
+		                color_texture.width, color_texture.height, face, full, scaled, 1 << level);
+	else
+		fprintf(stdout, "color %dx%d on a %.0f px face: %.1f texels per pixel, no preview pyramid\n",
+		                color_texture.width, color_texture.height, face, full);
+}
+
+
+bool cached_layer::stale(uint64_t input)
+{
+	if (valid && frames == input && gbm_egl_options::get().layer_cache)
+	{
+		++hits;
+		hits_total.add();
+		return false;
+	}
+	valid = true;
+	frames = input;
+	++renders;
+	renders_total.add();
+	return true;
+}
+
+
 void gbm_egl_instance::render_impl()
 {
+	// the layers at camera rate, each when a frame it reads has changed
+	const uint color = color_frames, depth = depth_frames;
+	const uint64_t color_input = color_reads_depth ? uint64_t(color) << 32 | depth : color;
+	if (color_fx.pass_count() && color_layer.stale(color_input))
+	{
+		gpu_pass(color_layer.name);
+		color_fx.run();
+	}
+	if (depth_fx.pass_count() && depth_layer.stale(depth))
+	{
+		gpu_pass(depth_layer.name);
+		depth_fx.run();
+	}
+	// built from the color layer when there is one
+	if (use_preview && preview_layer.stale(color_input))
+	{
+		gpu_pass(preview_layer.name);
+		color_preview.run();
+		glBindTexture(GL_TEXTURE_2D, color_preview.output_texture());
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+
+	// then the composition at display rate: the cubes move every frame and
+	// sample the layers as they are
+	gpu_pass("clear");
     glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glActiveTexture(GL_TEXTURE0);
 
-	ESMatrix mvp;
-
-	glUseProgram(generic_program);
-	mvp = ESMatrix::multiply(color_matrix, projection_matrix);
-	u_mvp = glGetUniformLocation(generic_program, "mvp");
-	glUniformMatrix4fv(u_mvp, 1, GL_FALSE, &mvp.m[0][0]);
-	glBindTexture(GL_TEXTURE_EXTERNAL_OES, color_texture.id);
-    draw_cube(cube_vbo);
-
-	glUseProgram(z16_program);
-	mvp = ESMatrix::multiply(depth_matrix, projection_matrix);
-	u_mvp = glGetUniformLocation(z16_program, "mvp");
-	glUniformMatrix4fv(u_mvp, 1, GL_FALSE, &mvp.m[0][0]);
-	glBindTexture(GL_TEXTURE_EXTERNAL_OES, depth_texture.id);
-    draw_cube(cube_vbo);
+	ESMatrix models[2] = { color_matrix, depth_matrix };
+	if (mesh.vbo)
+	{
+		models[0] = ESMatrix::multiply(mesh.unit, color_matrix);
+		models[1] = ESMatrix::multiply(mesh.unit, depth_matrix);
+	}
+	ESMatrix mvp[2];
+	ESMatrix::multiply(models, projection_matrix, mvp, 2);
+
+	gpu_pass("color cube");
+	const uint color_program = (color_fx.pass_count() || use_preview) ? texture2d_program : generic_program;
+	glUseProgram(color_program);
+	u_mvp = glGetUniformLocation(color_program, "mvp");
+	glUniformMatrix4fv(u_mvp, 1, GL_FALSE, &mvp[0].m[0][0]);
+	if (use_preview)
+		glBindTexture(GL_TEXTURE_2D, color_preview.output_texture());
+	else if (color_fx.pass_count())
+		glBindTexture(GL_TEXTURE_2D, color_fx.output_texture());
+	else
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, pending_profile < 0 ? color_texture.id : 0);
+	if (mesh.vbo)
+		draw_mesh(mesh);
+	else
+		draw_cube(cube_vbo);
+	color_sampled_bytes_total.add(color_sampled_bytes);
+
+	gpu_pass("depth cube");
+	const uint depth_program = depth_fx.pass_count() ? texture2d_program : z16_program;
+	glUseProgram(depth_program);
+	u_mvp = glGetUniformLocation(depth_program, "mvp");
+	glUniformMatrix4fv(u_mvp, 1, GL_FALSE, &mvp[1].m[0][0]);
+	if (depth_fx.pass_count())
+		glBindTexture(GL_TEXTURE_2D, depth_fx.output_texture());
+	else
+		glBindTexture(GL_TEXTURE_EXTERNAL_OES, pending_profile < 0 ? depth_texture.id : 0);
+	if (mesh.vbo)
+		draw_mesh(mesh);
+	else
+		draw_cube(cube_vbo);
 }
@@ -3,26 +3,110 @@
 
 #include "gbm_egl_device_impl.hpp"
 #include "gbm_egl_util.hpp"
+#include "gbm_egl_mesh.hpp"
+#include "gbm_egl_postfx.hpp"
+#include <memory>
 #include <thread>
+#include <vector>
+
+// camera stream settings, GBM_EGL_PROFILES lists the ones to switch between
+struct stream_profile
+{
+    int color_width = 1920;
+    int color_height = 1080;
+    int depth_width = 1280;
+    int depth_height = 720;
+    int fps = 30;
+};
+
+// a filter graph's output kept between display frames. camera frames come
+// in at 30 fps, the display runs at 60 or more, so the graph only runs when
+// the frames it reads have changed and the cubes sample what it left behind.
+struct cached_layer
+{
+    cached_layer(const char* pass_name, metric_counter& render_counter, metric_counter& hit_counter)
+        : name(pass_name), renders_total(render_counter), hits_total(hit_counter) {}
+
+    // true when the layer has to be rendered for these input frames,
+    // always with GBM_EGL_LAYER_CACHE=0
+    bool stale(uint64_t input);
+    void invalidate() { valid = false; }
+
+    const char* name;           // its gpu pass
+    metric_counter& renders_total;
+    metric_counter& hits_total;
+    uint64_t frames = 0;        // input frame counters it was rendered from
+    bool valid = false;
+    uint64_t renders = 0;
+    uint64_t hits = 0;
+};
 
 class gbm_egl_instance : public gbm_egl_device_impl
 {
 public:
-    ~gbm_egl_instance() = default;
+    ~gbm_egl_instance();
 
 private:
     virtual gbm_egl_device_interface* new_instance();
+    virtual void prepare_impl();
+    virtual void placeholder_impl();
     virtual void begin_impl();
     virtual void end_impl();
     virtual void update_impl();
     virtual void render_impl();
+    virtual void quality_impl(const quality_level& level);
+
+    // postfx and the preview pyramid for the current textures
+    void build_filters();
+    void reset_filters();
+    void build_postfx(const char* effects);
+    void build_preview();
+    void select_preview();
+    bool acquire_stream_textures(const stream_profile& profile);
+    // the windows of a profile's frames that reach the textures
+    ingest_window color_window(const stream_profile& profile) const;
+    ingest_window depth_window(const stream_profile& profile) const;
+    void switch_stream_textures(int profile);
+    // once the upload thread bound the new images
+    void setup_stream_textures();
+    // one color + depth frameset of a profile into the textures
+    void ingest_frameset(const stream_profile& profile, const void* color, size_t color_size,
+                         const void* depth, size_t depth_size);
+    // GBM_EGL_SOURCE=synthetic|static in place of the camera
+    void synthetic_loop();
+    // scheduling of the processing thread, a deadline period follows the
+    // camera frame rate
+    void apply_ingest_profile(int fps);
 
 private:
 	int u_mvp;
 
     uint generic_program;
     uint z16_program;
+    uint texture2d_program;
     uint cube_vbo;
+    gl_mesh mesh;
+    postfx_graph color_fx;
+    postfx_graph depth_fx;
+    // color at 1/2 size, its mipmaps are the 1/4 and 1/8 levels. rebuilt
+    // once per camera frame, not once per display frame
+    postfx_graph color_preview;
+    // bumped for every camera frame that differs from the one before
+    std::atomic_uint color_frames {0};
+    std::atomic_uint depth_frames {0};
+    metric_counter& layer_renders_total = metrics_counter("gbm_egl_layer_renders_total", "Cached layers rendered for a new camera frame.");
+    metric_counter& layer_hits_total = metrics_counter("gbm_egl_layer_cache_hits_total", "Display frames that reused a cached layer.");
+    cached_layer color_layer {"color layer", layer_renders_total, layer_hits_total};
+    cached_layer depth_layer {"depth layer", layer_renders_total, layer_hits_total};
+    cached_layer preview_layer {"preview layer", layer_renders_total, layer_hits_total};
+    bool color_reads_depth = false; // overlay
+    bool use_preview = false;
+    int preview_level = -1;         // 0 is full size
+    // color texture bytes the color cube reads per frame, estimated from
+    // its size on screen and the level it samples
+    uint64_t color_sampled_bytes = 0;
+    metric_counter& color_sampled_bytes_total = metrics_counter("gbm_egl_color_sampled_bytes_total", "Estimated bytes of color texture sampled by the color cube.");
+    int postfx_divisor = 1;         // 2 while the governor reduces filters
     oes_texture color_texture;
     oes_texture depth_texture;
 
@@ -31,7 +115,22 @@ private:
     ESMatrix projection_matrix;
     ESMatrix mvp_matrix;
 
+    // the processing thread restarts the camera and asks for matching
+    // textures, which the render thread swaps in from the pool
+    std::vector<stream_profile> profiles;
+    ingest_window color_ingest;
+    ingest_window depth_ingest;
+    int texture_profile = 0;
+    int pending_profile = -1;       // acquired, images not bound yet
+    std::atomic_int requested_profile {0};
+    std::atomic_int ready_profile {0};
+    // governor asks for a lower camera frame rate at the same resolutions
+    std::atomic_bool reduced_fps {false};
+
+    std::thread camera_startup;
+    std::atomic_bool camera_streaming {false};
     std::thread processing_thread;
+    int ingest_fps = 0;             // the rate the processing thread runs at
 };
 
 #endif
@@ -0,0 +1,167 @@
+#include "gbm_egl_kernels.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <initializer_list>
+#if defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+static void copy_scalar(void* dst, const void* src, size_t size)
+{
+    memcpy(dst, src, size);
+}
+
+
+static void rgb_to_rgbx_scalar(uint8_t* dst, const uint8_t* src, size_t pixels)
+{
+    for (size_t i = 0; i < pixels; ++i, dst += 4, src += 3)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 0xff;
+    }
+}
+
+
+static void mat4_multiply_scalar(float* out, const float* a, const float* b, size_t count)
+{
+    for (size_t n = 0; n < count; ++n, out += 16, a += 16)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                out[i * 4 + j] = a[i * 4 + 0] * b[0 * 4 + j] +
+                                 a[i * 4 + 1] * b[1 * 4 + j] +
+                                 a[i * 4 + 2] * b[2 * 4 + j] +
+                                 a[i * 4 + 3] * b[3 * 4 + j];
+            }
+        }
+    }
+}
+
+
+static void z16_min_2x2_scalar(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    // 0 - 1 wraps around to the largest value, so min skips it
+    for (size_t i = 0; i < width; ++i, a += 2, b += 2)
+    {
+        const uint16_t top = std::min<uint16_t>(a[0] - 1, a[1] - 1);
+        const uint16_t bottom = std::min<uint16_t>(b[0] - 1, b[1] - 1);
+        dst[i] = std::min(top, bottom) + 1;
+    }
+}
+
+
+static void z16_median_2x2_scalar(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    for (size_t i = 0; i < width; ++i, a += 2, b += 2)
+    {
+        const uint16_t low = std::max(std::min(a[0], a[1]), std::min(b[0], b[1]));
+        const uint16_t high = std::min(std::max(a[0], a[1]), std::max(b[0], b[1]));
+        dst[i] = (uint32_t(low) + high + 1) >> 1;
+    }
+}
+
+
+static inline uint32_t hash_step(uint32_t h, uint32_t word)
+{
+    h ^= word;
+    return (h << 13 | h >> 19) * 16777619u;
+}
+
+
+static void hash_lanes_scalar(uint32_t* lanes, const void* src, size_t size)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    uint32_t word;
+    for (; size >= 64; size -= 64, s += 64)
+    {
+        for (int i = 0; i < hash_lane_count; ++i)
+        {
+            memcpy(&word, s + 4 * i, 4);
+            lanes[i] = hash_step(lanes[i], word);
+        }
+    }
+    int lane = 0;
+    for (; size >= 4; size -= 4, s += 4, ++lane)
+    {
+        memcpy(&word, s, 4);
+        lanes[lane] = hash_step(lanes[lane], word);
+    }
+    if (size)
+    {
+        word = 0;
+        memcpy(&word, s, size);
+        lanes[0] = hash_step(lanes[0], word);
+    }
+}
+
+
+uint64_t tile_hash(const void* src, size_t stride, size_t row_bytes, int rows, const kernel_table& table)
+{
+    uint32_t lanes[hash_lane_count];
+    for (int i = 0; i < hash_lane_count; ++i)
+        lanes[i] = 2166136261u + i;
+    const uint8_t* row = (const uint8_t*)src;
+    const auto hash = table.hash_lanes;
+    for (int y = 0; y < rows; ++y, row += stride)
+        hash(lanes, row, row_bytes);
+
+    // 64 bit fnv-1a over the lanes, with the size so equal bytes in a
+    // differently shaped region do not match
+    uint64_t h = 14695981039346656037ull ^ (uint64_t(row_bytes) << 32 | uint32_t(rows));
+    for (int i = 0; i < hash_lane_count; ++i)
+        h = (h ^ lanes[i]) * 1099511628211ull;
+    return h;
+}
+
+
+const kernel_table* kernels_scalar()
+{
+    static const kernel_table table = { "scalar", copy_scalar, rgb_to_rgbx_scalar, mat4_multiply_scalar,
+                                        z16_min_2x2_scalar, z16_median_2x2_scalar, hash_lanes_scalar };
+    return &table;
+}
+
+
+static const kernel_table* detect_kernels()
+{
+    const kernel_table* best = kernels_scalar();
+#if defined(__aarch64__)
+    if ((getauxval(AT_HWCAP) & HWCAP_ASIMD) && kernels_neon())
+        best = kernels_neon();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1") && kernels_sse41())
+        best = kernels_sse41();
+    if (__builtin_cpu_supports("avx2") && kernels_avx2())
+        best = kernels_avx2();
+#endif
+
+    const char* forced = getenv("GBM_EGL_KERNELS");
+    if (forced && *forced)
+    {
+        for (const kernel_table* table : { kernels_scalar(), kernels_neon(), kernels_sse41(), kernels_avx2() })
+        {
+            // only allow going down to something this cpu also runs
+            if (table && strcmp(table->name, forced) == 0 && (table == kernels_scalar() || table == best ||
+                (table == kernels_sse41() && best == kernels_avx2())))
+                best = table;
+        }
+    }
+
+    fprintf(stdout, "cpu kernels: %s\n", best->name);
+    return best;
+}
+
+
+const kernel_table& kernels()
+{
+    static const kernel_table* table = detect_kernels();
+    return *table;
+}
@@ -0,0 +1,52 @@
+#ifndef _gbm_egl_kernels_hpp__
+#define _gbm_egl_kernels_hpp__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hot cpu kernels, compiled once per instruction set and picked at startup
+struct kernel_table
+{
+    const char* name;
+
+    // bulk copy into write combined (dma mapped) memory
+    void (*copy)(void* dst, const void* src, size_t size);
+
+    // packed 24 bit rgb to 32 bit rgbx, x = 0xff
+    void (*rgb_to_rgbx)(uint8_t* dst, const uint8_t* src, size_t pixels);
+
+    // out[i] = a[i] * b for count row major 4x4 matrices (ESMatrix layout)
+    void (*mat4_multiply)(float* out, const float* a, const float* b, size_t count);
+
+    // 2x2 blocks of 16 bit depth to one value each, from rows a and b of
+    // 2 * width samples. min keeps the nearest valid depth (0 = none), only
+    // a block without any comes out 0. median is the rounded up mean of the
+    // middle two, invalid samples included.
+    void (*z16_min_2x2)(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width);
+    void (*z16_median_2x2)(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width);
+
+    // feeds size bytes into hash_lane_count running 32 bit hashes: 32 bit word i
+    // of each 64 byte block goes to lane i as h = rotl(h ^ word, 13) * 16777619,
+    // the words of a shorter tail to lanes 0, 1, .. and its last bytes to lane
+    // 0. the rotate brings high bits down, a multiply alone never does and two
+    // flips of bit 31 in one lane would cancel. every variant gives the same
+    // lanes.
+    void (*hash_lanes)(uint32_t* lanes, const void* src, size_t size);
+};
+
+static constexpr int hash_lane_count = 16;
+
+// best variant the cpu supports, GBM_EGL_KERNELS=scalar|neon|sse4.1|avx2 overrides
+const kernel_table& kernels();
+
+// one hash of a rows x row_bytes region, stride bytes apart, for telling
+// whether it changed. a change is missed with a chance of about 2^-32.
+uint64_t tile_hash(const void* src, size_t stride, size_t row_bytes, int rows, const kernel_table& table = kernels());
+
+// variants, nullptr when not built for this architecture
+const kernel_table* kernels_scalar();
+const kernel_table* kernels_neon();
+const kernel_table* kernels_sse41();
+const kernel_table* kernels_avx2();
+
+#endif
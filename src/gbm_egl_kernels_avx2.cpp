@@ -0,0 +1,154 @@
+#include "gbm_egl_kernels.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__AVX2__)
+#include <immintrin.h>
+#include <string.h>
+
+static void copy_avx2(void* dst, const void* src, size_t size)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // align the destination, then stream whole lines past the cache
+    const size_t head = (32 - ((uintptr_t)d & 31)) & 31;
+    if (head > size)
+    {
+        memcpy(d, s, size);
+        return;
+    }
+    memcpy(d, s, head);
+    d += head, s += head, size -= head;
+
+    for (; size >= 64; size -= 64, d += 64, s += 64)
+    {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(s + 0));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(s + 32));
+        _mm256_stream_si256((__m256i*)(d + 0), v0);
+        _mm256_stream_si256((__m256i*)(d + 32), v1);
+    }
+    _mm_sfence();
+    memcpy(d, s, size);
+}
+
+
+static void rgb_to_rgbx_avx2(uint8_t* dst, const uint8_t* src, size_t pixels)
+{
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32(int(0xff000000));
+
+    // each lane takes 4 pixels from its own 12 byte window
+    for (; pixels >= 10; pixels -= 8, dst += 32, src += 24)
+    {
+        const __m128i lo = _mm_loadu_si128((const __m128i*)src);
+        const __m128i hi = _mm_loadu_si128((const __m128i*)(src + 12));
+        const __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alpha));
+    }
+    kernels_scalar()->rgb_to_rgbx(dst, src, pixels);
+}
+
+
+static void mat4_multiply_avx2(float* out, const float* a, const float* b, size_t count)
+{
+    // two result rows per register, b rows duplicated into both lanes
+    const __m256 b0 = _mm256_broadcast_ps((const __m128*)(b + 0));
+    const __m256 b1 = _mm256_broadcast_ps((const __m128*)(b + 4));
+    const __m256 b2 = _mm256_broadcast_ps((const __m128*)(b + 8));
+    const __m256 b3 = _mm256_broadcast_ps((const __m128*)(b + 12));
+
+    for (size_t n = 0; n < count; ++n, out += 16, a += 16)
+    {
+        for (int i = 0; i < 4; i += 2)
+        {
+            const float* r0 = a + i * 4;
+            const float* r1 = r0 + 4;
+            __m256 r = _mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(r0[0]), _mm_set1_ps(r1[0])), b0);
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(r0[1]), _mm_set1_ps(r1[1])), b1));
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(r0[2]), _mm_set1_ps(r1[2])), b2));
+            r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(r0[3]), _mm_set1_ps(r1[3])), b3));
+            _mm256_storeu_ps(out + i * 4, r);
+        }
+    }
+}
+
+
+// even and odd samples of 32, packus works per 128 bit lane so the
+// results come out in 64 bit chunks 0 2 1 3 until reordered
+static inline void deinterleave_avx2(const uint16_t* row, __m256i& even, __m256i& odd)
+{
+    const __m256i low = _mm256_set1_epi32(0xffff);
+    const __m256i v0 = _mm256_loadu_si256((const __m256i*)row);
+    const __m256i v1 = _mm256_loadu_si256((const __m256i*)(row + 16));
+    even = _mm256_packus_epi32(_mm256_and_si256(v0, low), _mm256_and_si256(v1, low));
+    odd = _mm256_packus_epi32(_mm256_srli_epi32(v0, 16), _mm256_srli_epi32(v1, 16));
+}
+
+
+static void z16_min_2x2_avx2(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    for (; width >= 16; width -= 16, dst += 16, a += 32, b += 32)
+    {
+        __m256i a0, a1, b0, b1;
+        deinterleave_avx2(a, a0, a1);
+        deinterleave_avx2(b, b0, b1);
+        const __m256i top = _mm256_min_epu16(_mm256_sub_epi16(a0, one), _mm256_sub_epi16(a1, one));
+        const __m256i bottom = _mm256_min_epu16(_mm256_sub_epi16(b0, one), _mm256_sub_epi16(b1, one));
+        const __m256i result = _mm256_add_epi16(_mm256_min_epu16(top, bottom), one);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_permute4x64_epi64(result, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    kernels_scalar()->z16_min_2x2(dst, a, b, width);
+}
+
+
+static void z16_median_2x2_avx2(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    for (; width >= 16; width -= 16, dst += 16, a += 32, b += 32)
+    {
+        __m256i a0, a1, b0, b1;
+        deinterleave_avx2(a, a0, a1);
+        deinterleave_avx2(b, b0, b1);
+        const __m256i low = _mm256_max_epu16(_mm256_min_epu16(a0, a1), _mm256_min_epu16(b0, b1));
+        const __m256i high = _mm256_min_epu16(_mm256_max_epu16(a0, a1), _mm256_max_epu16(b0, b1));
+        const __m256i result = _mm256_avg_epu16(low, high);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_permute4x64_epi64(result, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    kernels_scalar()->z16_median_2x2(dst, a, b, width);
+}
+
+
+static void hash_lanes_avx2(uint32_t* lanes, const void* src, size_t size)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    const __m256i prime = _mm256_set1_epi32(16777619);
+    __m256i h0 = _mm256_loadu_si256((const __m256i*)(lanes + 0));
+    __m256i h1 = _mm256_loadu_si256((const __m256i*)(lanes + 8));
+    for (; size >= 64; size -= 64, s += 64)
+    {
+        const __m256i x0 = _mm256_xor_si256(h0, _mm256_loadu_si256((const __m256i*)(s + 0)));
+        const __m256i x1 = _mm256_xor_si256(h1, _mm256_loadu_si256((const __m256i*)(s + 32)));
+        h0 = _mm256_mullo_epi32(_mm256_or_si256(_mm256_slli_epi32(x0, 13), _mm256_srli_epi32(x0, 19)), prime);
+        h1 = _mm256_mullo_epi32(_mm256_or_si256(_mm256_slli_epi32(x1, 13), _mm256_srli_epi32(x1, 19)), prime);
+    }
+    _mm256_storeu_si256((__m256i*)(lanes + 0), h0);
+    _mm256_storeu_si256((__m256i*)(lanes + 8), h1);
+    kernels_scalar()->hash_lanes(lanes, s, size);
+}
+
+
+const kernel_table* kernels_avx2()
+{
+    static const kernel_table table = { "avx2", copy_avx2, rgb_to_rgbx_avx2, mat4_multiply_avx2,
+                                        z16_min_2x2_avx2, z16_median_2x2_avx2, hash_lanes_avx2 };
+    return &table;
+}
+
+#else
+
+const kernel_table* kernels_avx2()
+{
+    return nullptr;
+}
+
+#endif
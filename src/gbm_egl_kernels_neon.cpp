@@ -0,0 +1,131 @@
+#include "gbm_egl_kernels.hpp"
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <string.h>
+
+static void copy_neon(void* dst, const void* src, size_t size)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // whole 64 byte lines keep the write combining buffers full
+    for (; size >= 64; size -= 64, d += 64, s += 64)
+    {
+        const uint8x16_t v0 = vld1q_u8(s + 0);
+        const uint8x16_t v1 = vld1q_u8(s + 16);
+        const uint8x16_t v2 = vld1q_u8(s + 32);
+        const uint8x16_t v3 = vld1q_u8(s + 48);
+        vst1q_u8(d + 0, v0);
+        vst1q_u8(d + 16, v1);
+        vst1q_u8(d + 32, v2);
+        vst1q_u8(d + 48, v3);
+    }
+    memcpy(d, s, size);
+}
+
+
+static void rgb_to_rgbx_neon(uint8_t* dst, const uint8_t* src, size_t pixels)
+{
+    for (; pixels >= 16; pixels -= 16, dst += 64, src += 48)
+    {
+        uint8x16x3_t rgb = vld3q_u8(src);
+        uint8x16x4_t rgbx;
+        rgbx.val[0] = rgb.val[0];
+        rgbx.val[1] = rgb.val[1];
+        rgbx.val[2] = rgb.val[2];
+        rgbx.val[3] = vdupq_n_u8(0xff);
+        vst4q_u8(dst, rgbx);
+    }
+    kernels_scalar()->rgb_to_rgbx(dst, src, pixels);
+}
+
+
+static void mat4_multiply_neon(float* out, const float* a, const float* b, size_t count)
+{
+    const float32x4_t b0 = vld1q_f32(b + 0);
+    const float32x4_t b1 = vld1q_f32(b + 4);
+    const float32x4_t b2 = vld1q_f32(b + 8);
+    const float32x4_t b3 = vld1q_f32(b + 12);
+
+    for (size_t n = 0; n < count; ++n, out += 16, a += 16)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            const float32x4_t row = vld1q_f32(a + i * 4);
+            float32x4_t r = vmulq_laneq_f32(b0, row, 0);
+            r = vfmaq_laneq_f32(r, b1, row, 1);
+            r = vfmaq_laneq_f32(r, b2, row, 2);
+            r = vfmaq_laneq_f32(r, b3, row, 3);
+            vst1q_f32(out + i * 4, r);
+        }
+    }
+}
+
+
+static void z16_min_2x2_neon(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    const uint16x8_t one = vdupq_n_u16(1);
+    for (; width >= 8; width -= 8, dst += 8, a += 16, b += 16)
+    {
+        // val[0] even samples, val[1] odd ones
+        const uint16x8x2_t top = vld2q_u16(a);
+        const uint16x8x2_t bottom = vld2q_u16(b);
+        const uint16x8_t t = vminq_u16(vsubq_u16(top.val[0], one), vsubq_u16(top.val[1], one));
+        const uint16x8_t u = vminq_u16(vsubq_u16(bottom.val[0], one), vsubq_u16(bottom.val[1], one));
+        vst1q_u16(dst, vaddq_u16(vminq_u16(t, u), one));
+    }
+    kernels_scalar()->z16_min_2x2(dst, a, b, width);
+}
+
+
+static void z16_median_2x2_neon(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    for (; width >= 8; width -= 8, dst += 8, a += 16, b += 16)
+    {
+        const uint16x8x2_t top = vld2q_u16(a);
+        const uint16x8x2_t bottom = vld2q_u16(b);
+        const uint16x8_t low = vmaxq_u16(vminq_u16(top.val[0], top.val[1]), vminq_u16(bottom.val[0], bottom.val[1]));
+        const uint16x8_t high = vminq_u16(vmaxq_u16(top.val[0], top.val[1]), vmaxq_u16(bottom.val[0], bottom.val[1]));
+        vst1q_u16(dst, vrhaddq_u16(low, high));
+    }
+    kernels_scalar()->z16_median_2x2(dst, a, b, width);
+}
+
+
+static void hash_lanes_neon(uint32_t* lanes, const void* src, size_t size)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    const uint32x4_t prime = vdupq_n_u32(16777619);
+    uint32x4_t h[4];
+    for (int i = 0; i < 4; ++i)
+        h[i] = vld1q_u32(lanes + 4 * i);
+    for (; size >= 64; size -= 64, s += 64)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            const uint32x4_t x = veorq_u32(h[i], vreinterpretq_u32_u8(vld1q_u8(s + 16 * i)));
+            h[i] = vmulq_u32(vsriq_n_u32(vshlq_n_u32(x, 13), x, 19), prime);
+        }
+    }
+    for (int i = 0; i < 4; ++i)
+        vst1q_u32(lanes + 4 * i, h[i]);
+    kernels_scalar()->hash_lanes(lanes, s, size);
+}
+
+
+const kernel_table* kernels_neon()
+{
+    static const kernel_table table = { "neon", copy_neon, rgb_to_rgbx_neon, mat4_multiply_neon,
+                                        z16_min_2x2_neon, z16_median_2x2_neon, hash_lanes_neon };
+    return &table;
+}
+
+#else
+
+const kernel_table* kernels_neon()
+{
+    return nullptr;
+}
+
+#endif
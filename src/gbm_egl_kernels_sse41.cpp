@@ -0,0 +1,152 @@
+#include "gbm_egl_kernels.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#include <string.h>
+
+static void copy_sse41(void* dst, const void* src, size_t size)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    // align the destination, then stream whole lines past the cache
+    const size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+    if (head > size)
+    {
+        memcpy(d, s, size);
+        return;
+    }
+    memcpy(d, s, head);
+    d += head, s += head, size -= head;
+
+    for (; size >= 64; size -= 64, d += 64, s += 64)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(s + 0));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(s + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(s + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i*)(s + 48));
+        _mm_stream_si128((__m128i*)(d + 0), v0);
+        _mm_stream_si128((__m128i*)(d + 16), v1);
+        _mm_stream_si128((__m128i*)(d + 32), v2);
+        _mm_stream_si128((__m128i*)(d + 48), v3);
+    }
+    _mm_sfence();
+    memcpy(d, s, size);
+}
+
+
+static void rgb_to_rgbx_sse41(uint8_t* dst, const uint8_t* src, size_t pixels)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha = _mm_set1_epi32(int(0xff000000));
+
+    // 16 byte loads read 4 bytes past the 12 consumed, stop early enough
+    for (; pixels >= 6; pixels -= 4, dst += 16, src += 12)
+    {
+        __m128i rgb = _mm_loadu_si128((const __m128i*)src);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+    }
+    kernels_scalar()->rgb_to_rgbx(dst, src, pixels);
+}
+
+
+static void mat4_multiply_sse41(float* out, const float* a, const float* b, size_t count)
+{
+    const __m128 b0 = _mm_loadu_ps(b + 0);
+    const __m128 b1 = _mm_loadu_ps(b + 4);
+    const __m128 b2 = _mm_loadu_ps(b + 8);
+    const __m128 b3 = _mm_loadu_ps(b + 12);
+
+    for (size_t n = 0; n < count; ++n, out += 16, a += 16)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            const float* row = a + i * 4;
+            __m128 r = _mm_mul_ps(_mm_set1_ps(row[0]), b0);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[1]), b1));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[2]), b2));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[3]), b3));
+            _mm_storeu_ps(out + i * 4, r);
+        }
+    }
+}
+
+
+// even and odd samples of 16, packus keeps them in order
+static inline void deinterleave_sse41(const uint16_t* row, __m128i& even, __m128i& odd)
+{
+    const __m128i low = _mm_set1_epi32(0xffff);
+    const __m128i v0 = _mm_loadu_si128((const __m128i*)row);
+    const __m128i v1 = _mm_loadu_si128((const __m128i*)(row + 8));
+    even = _mm_packus_epi32(_mm_and_si128(v0, low), _mm_and_si128(v1, low));
+    odd = _mm_packus_epi32(_mm_srli_epi32(v0, 16), _mm_srli_epi32(v1, 16));
+}
+
+
+static void z16_min_2x2_sse41(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    for (; width >= 8; width -= 8, dst += 8, a += 16, b += 16)
+    {
+        __m128i a0, a1, b0, b1;
+        deinterleave_sse41(a, a0, a1);
+        deinterleave_sse41(b, b0, b1);
+        const __m128i top = _mm_min_epu16(_mm_sub_epi16(a0, one), _mm_sub_epi16(a1, one));
+        const __m128i bottom = _mm_min_epu16(_mm_sub_epi16(b0, one), _mm_sub_epi16(b1, one));
+        _mm_storeu_si128((__m128i*)dst, _mm_add_epi16(_mm_min_epu16(top, bottom), one));
+    }
+    kernels_scalar()->z16_min_2x2(dst, a, b, width);
+}
+
+
+static void z16_median_2x2_sse41(uint16_t* dst, const uint16_t* a, const uint16_t* b, size_t width)
+{
+    for (; width >= 8; width -= 8, dst += 8, a += 16, b += 16)
+    {
+        __m128i a0, a1, b0, b1;
+        deinterleave_sse41(a, a0, a1);
+        deinterleave_sse41(b, b0, b1);
+        const __m128i low = _mm_max_epu16(_mm_min_epu16(a0, a1), _mm_min_epu16(b0, b1));
+        const __m128i high = _mm_min_epu16(_mm_max_epu16(a0, a1), _mm_max_epu16(b0, b1));
+        _mm_storeu_si128((__m128i*)dst, _mm_avg_epu16(low, high));
+    }
+    kernels_scalar()->z16_median_2x2(dst, a, b, width);
+}
+
+
+static void hash_lanes_sse41(uint32_t* lanes, const void* src, size_t size)
+{
+    const uint8_t* s = (const uint8_t*)src;
+    const __m128i prime = _mm_set1_epi32(16777619);
+    __m128i h[4];
+    for (int i = 0; i < 4; ++i)
+        h[i] = _mm_loadu_si128((const __m128i*)(lanes + 4 * i));
+    for (; size >= 64; size -= 64, s += 64)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            const __m128i x = _mm_xor_si128(h[i], _mm_loadu_si128((const __m128i*)(s + 16 * i)));
+            h[i] = _mm_mullo_epi32(_mm_or_si128(_mm_slli_epi32(x, 13), _mm_srli_epi32(x, 19)), prime);
+        }
+    }
+    for (int i = 0; i < 4; ++i)
+        _mm_storeu_si128((__m128i*)(lanes + 4 * i), h[i]);
+    kernels_scalar()->hash_lanes(lanes, s, size);
+}
+
+
+const kernel_table* kernels_sse41()
+{
+    static const kernel_table table = { "sse4.1", copy_sse41, rgb_to_rgbx_sse41, mat4_multiply_sse41,
+                                        z16_min_2x2_sse41, z16_median_2x2_sse41, hash_lanes_sse41 };
+    return &table;
+}
+
+#else
+
+const kernel_table* kernels_sse41()
+{
+    return nullptr;
+}
+
+#endif
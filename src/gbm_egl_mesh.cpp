@@ -0,0 +1,113 @@
+#include "gbm_egl_mesh.hpp"
+#include "gbm_egl_mesh_format.hpp"
+#include "gbm_egl_stats.hpp"
+#include "gbm_egl_resources.hpp"
+#include <GLES2/gl2.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <iostream>
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+
+bool load_mesh(const char* path, gl_mesh& out)
+{
+    const double start = monotonic_ms();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cerr << "failed to open mesh " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "failed to map mesh " << path << std::endl;
+        return false;
+    }
+    resource_created(resource_kind::mapping, data, st.st_size, "mesh file");
+    // the driver copies both sections front to back
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    const mesh_file_header* header = validate_mesh_file(data, st.st_size);
+    if (!header)
+    {
+        std::cerr << path << " is not a valid mesh file" << std::endl;
+        resource_destroyed(resource_kind::mapping, data);
+        munmap(data, st.st_size);
+        return false;
+    }
+
+    const bool index32 = header->flags & mesh_flag_index32;
+    const uint8_t* base = (const uint8_t*)data;
+    glGenBuffers(1, &out.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, out.vbo);
+    glBufferData(GL_ARRAY_BUFFER, size_t(header->vertex_count) * header->vertex_stride, base + header->vertex_offset, GL_STATIC_DRAW);
+    glGenBuffers(1, &out.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, out.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size_t(header->index_count) * (index32 ? 4 : 2), base + header->index_offset, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    out.index_count = header->index_count;
+    out.index_type = index32 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+    float center[3], extent[3], radius = 0.0f;
+    for (int k = 0; k < 3; ++k)
+    {
+        extent[k] = header->position_max[k] - header->position_min[k];
+        center[k] = header->position_min[k] + extent[k] * 0.5f;
+        radius += extent[k] * extent[k] * 0.25f;
+    }
+    radius = radius > 0.0f ? sqrtf(radius) : 1.0f;
+
+    out.dequantize.identity();
+    out.dequantize.translate(header->position_min[0], header->position_min[1], header->position_min[2]);
+    out.dequantize.scale(extent[0] / 65535.0f, extent[1] / 65535.0f, extent[2] / 65535.0f);
+
+    ESMatrix fit;
+    fit.identity();
+    fit.scale(1.0f / radius, 1.0f / radius, 1.0f / radius);
+    fit.translate(-center[0], -center[1], -center[2]);
+    out.unit = ESMatrix::multiply(out.dequantize, fit);
+
+    std::cout << "mesh " << path << ": " << header->index_count / 3 << " triangles, "
+              << header->vertex_count << " vertices, " << st.st_size / 1024 << " KiB, loaded in "
+              << monotonic_ms() - start << " ms" << std::endl;
+
+    resource_destroyed(resource_kind::mapping, data);
+    munmap(data, st.st_size);
+    return true;
+}
+
+
+void draw_mesh(const gl_mesh& mesh)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(mesh_vertex), (const GLvoid*)offsetof(mesh_vertex, position));
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(mesh_vertex), (const GLvoid*)offsetof(mesh_vertex, uv));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+    glDrawElements(GL_TRIANGLES, mesh.index_count, mesh.index_type, nullptr);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+
+void destroy_mesh(gl_mesh& mesh)
+{
+    if (mesh.vbo)
+        glDeleteBuffers(1, &mesh.vbo);
+    if (mesh.ibo)
+        glDeleteBuffers(1, &mesh.ibo);
+    mesh = gl_mesh();
+}
@@ -0,0 +1,26 @@
+#ifndef _gbm_egl_mesh_hpp__
+#define _gbm_egl_mesh_hpp__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "gbm_egl_util.hpp"
+
+// a mesh file (gbm_egl_mesh_format.hpp) uploaded into gl buffers. vertices
+// use attribute 0 (position) and 1 (uv) like the cube.
+struct gl_mesh
+{
+    uint vbo = 0;
+    uint ibo = 0;
+    uint32_t index_count = 0;
+    uint32_t index_type = 0;
+    // quantized positions back to model space
+    ESMatrix dequantize;
+    // quantized positions into a unit sphere around the origin
+    ESMatrix unit;
+};
+
+bool load_mesh(const char* path, gl_mesh& out);
+void draw_mesh(const gl_mesh& mesh);
+void destroy_mesh(gl_mesh& mesh);
+
+#endif
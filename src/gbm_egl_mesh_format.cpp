@@ -0,0 +1,705 @@
+#include "gbm_egl_mesh_format.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+static bool read_file(const char* path, std::string& out)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        std::cerr << "failed to open " << path << std::endl;
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    out.resize(size > 0 ? size : 0);
+    const bool ok = size >= 0 && fread(&out[0], 1, out.size(), file) == out.size();
+    fclose(file);
+    if (!ok)
+        std::cerr << "failed to read " << path << std::endl;
+    return ok;
+}
+
+
+bool read_obj(const char* path, mesh_source& out)
+{
+    std::string text;
+    if (!read_file(path, text))
+        return false;
+
+    std::vector<float> positions, uvs;
+    // one output vertex per distinct position/uv pair
+    std::unordered_map<uint64_t, uint32_t> vertices;
+    std::vector<uint32_t> face;
+    out = mesh_source();
+
+    const char* p = text.c_str();
+    const char* end = p + text.size();
+    int line = 0;
+    while (p < end)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        ++line;
+
+        while (p < eol && (*p == ' ' || *p == '\t'))
+            ++p;
+
+        if (p[0] == 'v' && p[1] == ' ')
+        {
+            char* next = (char*)p + 2;
+            for (int i = 0; i < 3; ++i)
+                positions.push_back(strtof(next, &next));
+        }
+        else if (p[0] == 'v' && p[1] == 't' && p[2] == ' ')
+        {
+            char* next = (char*)p + 3;
+            uvs.push_back(strtof(next, &next));
+            uvs.push_back(strtof(next, &next));
+        }
+        else if (p[0] == 'f' && p[1] == ' ')
+        {
+            face.clear();
+            char* next = (char*)p + 2;
+            while (next < eol)
+            {
+                while (next < eol && (*next == ' ' || *next == '\t' || *next == '\r'))
+                    ++next;
+                if (next >= eol)
+                    break;
+
+                long v = strtol(next, &next, 10), vt = 0;
+                if (*next == '/')
+                {
+                    ++next;
+                    if (*next != '/')
+                        vt = strtol(next, &next, 10);
+                    if (*next == '/')
+                        strtol(next + 1, &next, 10);
+                }
+
+                // 1 based, negative counts back from the last one
+                v = v < 0 ? long(positions.size() / 3) + v : v - 1;
+                vt = vt < 0 ? long(uvs.size() / 2) + vt : vt - 1;
+                if (v < 0 || v >= long(positions.size() / 3) || vt >= long(uvs.size() / 2))
+                {
+                    std::cerr << path << ":" << line << ": index out of range" << std::endl;
+                    return false;
+                }
+
+                const uint64_t key = (uint64_t(v) << 32) | uint32_t(vt + 1);
+                auto found = vertices.find(key);
+                if (found == vertices.end())
+                {
+                    const uint32_t index = out.positions.size() / 3;
+                    out.positions.insert(out.positions.end(), &positions[v * 3], &positions[v * 3] + 3);
+                    out.uvs.push_back(vt >= 0 ? uvs[vt * 2 + 0] : 0.0f);
+                    out.uvs.push_back(vt >= 0 ? uvs[vt * 2 + 1] : 0.0f);
+                    found = vertices.emplace(key, index).first;
+                }
+                face.push_back(found->second);
+            }
+
+            // polygons as fans
+            for (size_t i = 2; i < face.size(); ++i)
+            {
+                out.indices.push_back(face[0]);
+                out.indices.push_back(face[i - 1]);
+                out.indices.push_back(face[i]);
+            }
+        }
+
+        p = eol + 1;
+    }
+
+    if (uvs.empty())
+        out.uvs.clear();
+    return !out.indices.empty();
+}
+
+
+namespace
+{
+    struct ply_property
+    {
+        std::string name;
+        std::string type;
+        std::string count_type;     // set for list properties
+    };
+
+    struct ply_element
+    {
+        std::string name;
+        size_t count = 0;
+        std::vector<ply_property> properties;
+    };
+
+    int ply_type_size(const std::string& type)
+    {
+        if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+            return 1;
+        if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+            return 2;
+        if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" || type == "float32")
+            return 4;
+        if (type == "double" || type == "float64")
+            return 8;
+        return 0;
+    }
+
+    // reads one scalar from the body, ascii or binary little endian
+    struct ply_reader
+    {
+        const char* p;
+        const char* end;
+        bool binary;
+        bool failed = false;
+
+        double read(const std::string& type)
+        {
+            if (!binary)
+            {
+                char* next = nullptr;
+                const double value = strtod(p, &next);
+                if (next == p)
+                    failed = true;
+                p = next;
+                return value;
+            }
+
+            const int size = ply_type_size(type);
+            if (size == 0 || end - p < size)
+            {
+                failed = true;
+                return 0;
+            }
+
+            uint8_t raw[8];
+            memcpy(raw, p, size);
+            p += size;
+            if (type == "char" || type == "int8")       return *(int8_t*)raw;
+            if (type == "uchar" || type == "uint8")     return *(uint8_t*)raw;
+            if (type == "short" || type == "int16")     return *(int16_t*)raw;
+            if (type == "ushort" || type == "uint16")   return *(uint16_t*)raw;
+            if (type == "int" || type == "int32")       return *(int32_t*)raw;
+            if (type == "uint" || type == "uint32")     return *(uint32_t*)raw;
+            if (type == "float" || type == "float32")   return *(float*)raw;
+            return *(double*)raw;
+        }
+    };
+}
+
+
+bool read_ply(const char* path, mesh_source& out)
+{
+    std::string text;
+    if (!read_file(path, text))
+        return false;
+
+    const size_t header_end = text.find("end_header");
+    if (text.compare(0, 3, "ply") != 0 || header_end == std::string::npos)
+    {
+        std::cerr << path << ": not a ply file" << std::endl;
+        return false;
+    }
+
+    bool binary = false;
+    std::vector<ply_element> elements;
+    size_t pos = text.find('\n') + 1;
+    while (pos < header_end)
+    {
+        size_t eol = text.find('\n', pos);
+        std::string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        char a[64] = {0}, b[64] = {0}, c[64] = {0}, d[64] = {0};
+        const int n = sscanf(line.c_str(), "%63s %63s %63s %63s", a, b, c, d);
+        if (n >= 2 && strcmp(a, "format") == 0)
+        {
+            if (strcmp(b, "binary_little_endian") == 0)
+                binary = true;
+            else if (strcmp(b, "ascii") != 0)
+            {
+                std::cerr << path << ": unsupported ply format " << b << std::endl;
+                return false;
+            }
+        }
+        else if (n >= 3 && strcmp(a, "element") == 0)
+        {
+            elements.emplace_back();
+            elements.back().name = b;
+            elements.back().count = strtoull(c, nullptr, 10);
+        }
+        else if (n >= 3 && strcmp(a, "property") == 0 && !elements.empty())
+        {
+            // property <type> <name> | property list <count type> <type> <name>
+            ply_property property;
+            if (strcmp(b, "list") == 0)
+            {
+                char e[64] = {0};
+                sscanf(line.c_str(), "%*s %*s %*s %*s %63s", e);
+                property.count_type = c;
+                property.type = d;
+                property.name = e;
+            }
+            else
+            {
+                property.type = b;
+                property.name = c;
+            }
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    ply_reader reader;
+    reader.p = text.c_str() + text.find('\n', header_end) + 1;
+    reader.end = text.c_str() + text.size();
+    reader.binary = binary;
+    out = mesh_source();
+
+    bool has_uv = false;
+    for (const ply_element& element : elements)
+    {
+        const bool vertex = element.name == "vertex";
+        const bool face = element.name == "face";
+        if (vertex)
+        {
+            for (const ply_property& property : element.properties)
+            {
+                if (property.name == "u" || property.name == "s" || property.name == "texture_u" || property.name == "texture_s")
+                    has_uv = true;
+            }
+            out.positions.reserve(element.count * 3);
+            if (has_uv)
+                out.uvs.reserve(element.count * 2);
+        }
+
+        std::vector<uint32_t> polygon;
+        for (size_t i = 0; i < element.count && !reader.failed; ++i)
+        {
+            float position[3] = {0}, uv[2] = {0};
+            for (const ply_property& property : element.properties)
+            {
+                if (!property.count_type.empty())
+                {
+                    const size_t count = reader.read(property.count_type);
+                    polygon.clear();
+                    for (size_t k = 0; k < count; ++k)
+                        polygon.push_back(reader.read(property.type));
+                    if (face && (property.name == "vertex_indices" || property.name == "vertex_index"))
+                    {
+                        for (size_t k = 2; k < polygon.size(); ++k)
+                        {
+                            out.indices.push_back(polygon[0]);
+                            out.indices.push_back(polygon[k - 1]);
+                            out.indices.push_back(polygon[k]);
+                        }
+                    }
+                    continue;
+                }
+
+                const double value = reader.read(property.type);
+                const std::string& name = property.name;
+                if (name == "x")                                                position[0] = value;
+                else if (name == "y")                                           position[1] = value;
+                else if (name == "z")                                           position[2] = value;
+                else if (name == "u" || name == "s" || name == "texture_u" || name == "texture_s")     uv[0] = value;
+                else if (name == "v" || name == "t" || name == "texture_v" || name == "texture_t")     uv[1] = value;
+            }
+
+            if (vertex)
+            {
+                out.positions.insert(out.positions.end(), position, position + 3);
+                if (has_uv)
+                    out.uvs.insert(out.uvs.end(), uv, uv + 2);
+            }
+        }
+    }
+
+    if (reader.failed)
+    {
+        std::cerr << path << ": truncated ply body" << std::endl;
+        return false;
+    }
+
+    const uint32_t vertex_count = out.positions.size() / 3;
+    for (uint32_t index : out.indices)
+    {
+        if (index >= vertex_count)
+        {
+            std::cerr << path << ": index out of range" << std::endl;
+            return false;
+        }
+    }
+    return !out.indices.empty();
+}
+
+
+namespace
+{
+    const int forsyth_cache_size = 32;
+
+    float forsyth_score(int cache_position, uint32_t remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cache_position >= 0)
+        {
+            // the last triangle's vertices score the same so that strips
+            // are not favoured over fans
+            if (cache_position < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - (cache_position - 3) / float(forsyth_cache_size - 3), 1.5f);
+        }
+        // finish off vertices with few triangles left first
+        return score + 2.0f / sqrtf(float(remaining));
+    }
+}
+
+
+void optimize_vertex_cache(std::vector<uint32_t>& indices, uint32_t vertex_count)
+{
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    // triangles using each vertex, the live ones first in each range
+    std::vector<uint32_t> remaining(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; ++i)
+        ++remaining[indices[i]];
+    std::vector<uint32_t> first(vertex_count + 1, 0);
+    for (uint32_t v = 0; v < vertex_count; ++v)
+        first[v + 1] = first[v] + remaining[v];
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < triangle_count * 3; ++i)
+        adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_score(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; ++v)
+        vertex_score[v] = forsyth_score(-1, remaining[v]);
+
+    std::vector<bool> emitted(triangle_count, false);
+
+    std::vector<uint32_t> ordered;
+    ordered.reserve(triangle_count * 3);
+    uint32_t cache[forsyth_cache_size + 3];
+    int cache_used = 0;
+    size_t scan = 0;
+    int64_t best = -1;
+
+    while (ordered.size() < triangle_count * 3)
+    {
+        // nothing useful in the cache, continue with the next untouched triangle
+        if (best < 0)
+        {
+            while (emitted[scan])
+                ++scan;
+            best = scan;
+        }
+
+        const uint32_t* triangle = &indices[best * 3];
+        emitted[best] = true;
+        ordered.insert(ordered.end(), triangle, triangle + 3);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t v = triangle[k];
+            uint32_t* begin = &adjacency[first[v]];
+            uint32_t* last = begin + remaining[v] - 1;
+            for (uint32_t* t = begin; t <= last; ++t)
+            {
+                if (*t == uint32_t(best))
+                {
+                    std::swap(*t, *last);
+                    --remaining[v];
+                    break;
+                }
+            }
+        }
+
+        // the triangle's vertices move to the front, the rest shift back
+        uint32_t updated[forsyth_cache_size + 3];
+        int updated_count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (std::find(updated, updated + updated_count, triangle[k]) == updated + updated_count)
+                updated[updated_count++] = triangle[k];
+        }
+        for (int i = 0; i < cache_used; ++i)
+        {
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+                updated[updated_count++] = cache[i];
+        }
+
+        for (int i = 0; i < updated_count; ++i)
+        {
+            const uint32_t v = updated[i];
+            cache_position[v] = i < forsyth_cache_size ? i : -1;
+            vertex_score[v] = forsyth_score(cache_position[v], remaining[v]);
+        }
+        cache_used = std::min(updated_count, forsyth_cache_size);
+        for (int i = 0; i < cache_used; ++i)
+            cache[i] = updated[i];
+
+        // only triangles around vertices whose score changed need a rescore
+        best = -1;
+        float best_score = -1.0f;
+        for (int i = 0; i < updated_count; ++i)
+        {
+            const uint32_t v = updated[i];
+            for (uint32_t j = first[v]; j < first[v] + remaining[v]; ++j)
+            {
+                const uint32_t t = adjacency[j];
+                const float score = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best = t;
+                }
+            }
+        }
+    }
+
+    indices.swap(ordered);
+}
+
+
+double average_cache_miss_ratio(const std::vector<uint32_t>& indices, uint32_t vertex_count, int cache_size)
+{
+    if (indices.size() < 3)
+        return 0;
+
+    // fifo, as most hardware post-transform caches behave
+    std::vector<uint64_t> inserted(vertex_count, 0);
+    uint64_t misses = 0;
+    for (uint32_t v : indices)
+    {
+        if (inserted[v] == 0 || misses - inserted[v] >= uint64_t(cache_size))
+        {
+            ++misses;
+            inserted[v] = misses;
+        }
+    }
+    return double(misses) / (indices.size() / 3);
+}
+
+
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t biased = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (biased == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+    const int exponent = int(biased) - 127 + 15;
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    uint32_t half;
+    uint32_t rest, halfway;
+    if (exponent <= 0)
+    {
+        // subnormal half
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        half = (exponent << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+
+    // round to nearest even, a carry into the exponent is still correct
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    return sign | half;
+}
+
+
+static size_t align64(size_t value)
+{
+    return (value + 63) & ~size_t(63);
+}
+
+
+bool write_mesh_file(const char* path, const mesh_source& source, mesh_build_info* info)
+{
+    const uint32_t source_vertices = source.positions.size() / 3;
+    const bool has_uv = source.uvs.size() == size_t(source_vertices) * 2;
+    if (source.indices.empty() || source.indices.size() % 3)
+    {
+        std::cerr << "mesh has no triangles" << std::endl;
+        return false;
+    }
+    for (uint32_t index : source.indices)
+    {
+        if (index >= source_vertices)
+        {
+            std::cerr << "mesh index out of range" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<uint32_t> indices = source.indices;
+    const double acmr_before = average_cache_miss_ratio(indices, source_vertices);
+    optimize_vertex_cache(indices, source_vertices);
+
+    // vertices in first use order so that fetches walk memory forward,
+    // unreferenced ones are dropped
+    std::vector<uint32_t> remap(source_vertices, ~0u);
+    uint32_t vertex_count = 0;
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] == ~0u)
+            remap[index] = vertex_count++;
+        index = remap[index];
+    }
+
+    float bounds_min[3] = { HUGE_VALF, HUGE_VALF, HUGE_VALF };
+    float bounds_max[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+    for (uint32_t v = 0; v < source_vertices; ++v)
+    {
+        if (remap[v] == ~0u)
+            continue;
+        for (int k = 0; k < 3; ++k)
+        {
+            bounds_min[k] = std::min(bounds_min[k], source.positions[v * 3 + k]);
+            bounds_max[k] = std::max(bounds_max[k], source.positions[v * 3 + k]);
+        }
+    }
+
+    std::vector<mesh_vertex> vertices(vertex_count);
+    for (uint32_t v = 0; v < source_vertices; ++v)
+    {
+        if (remap[v] == ~0u)
+            continue;
+
+        mesh_vertex& out = vertices[remap[v]];
+        for (int k = 0; k < 3; ++k)
+        {
+            const float extent = bounds_max[k] - bounds_min[k];
+            const float t = extent > 0 ? (source.positions[v * 3 + k] - bounds_min[k]) / extent : 0.0f;
+            out.position[k] = uint16_t(lrintf(t * 65535.0f));
+        }
+        out.pad = 0;
+        out.uv[0] = float_to_half(has_uv ? source.uvs[v * 2 + 0] : 0.0f);
+        out.uv[1] = float_to_half(has_uv ? source.uvs[v * 2 + 1] : 0.0f);
+    }
+
+    mesh_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, mesh_file_magic, sizeof(header.magic));
+    header.version = mesh_file_version;
+    header.flags = vertex_count > 65536 ? mesh_flag_index32 : 0;
+    header.vertex_count = vertex_count;
+    header.index_count = indices.size();
+    header.vertex_stride = sizeof(mesh_vertex);
+    header.vertex_offset = align64(sizeof(header));
+    header.index_offset = align64(header.vertex_offset + vertices.size() * sizeof(mesh_vertex));
+    memcpy(header.position_min, bounds_min, sizeof(bounds_min));
+    memcpy(header.position_max, bounds_max, sizeof(bounds_max));
+
+    const size_t index_size = (header.flags & mesh_flag_index32) ? 4 : 2;
+    std::vector<uint8_t> file(align64(header.index_offset + indices.size() * index_size), 0);
+    memcpy(&file[0], &header, sizeof(header));
+    memcpy(&file[header.vertex_offset], vertices.data(), vertices.size() * sizeof(mesh_vertex));
+    if (index_size == 4)
+    {
+        memcpy(&file[header.index_offset], indices.data(), indices.size() * 4);
+    }
+    else
+    {
+        uint16_t* out = (uint16_t*)&file[header.index_offset];
+        for (size_t i = 0; i < indices.size(); ++i)
+            out[i] = indices[i];
+    }
+
+    FILE* output = fopen(path, "wb");
+    if (!output)
+    {
+        std::cerr << "failed to create " << path << std::endl;
+        return false;
+    }
+    const bool ok = fwrite(file.data(), 1, file.size(), output) == file.size();
+    if (fclose(output) != 0 || !ok)
+    {
+        std::cerr << "failed to write " << path << std::endl;
+        return false;
+    }
+
+    if (info)
+    {
+        info->vertex_count = vertex_count;
+        info->triangle_count = indices.size() / 3;
+        info->acmr_before = acmr_before;
+        info->acmr_after = average_cache_miss_ratio(indices, vertex_count);
+        info->file_size = file.size();
+    }
+    return true;
+}
+
+
+const mesh_file_header* validate_mesh_file(const void* data, size_t size)
+{
+    if (size < sizeof(mesh_file_header))
+        return nullptr;
+
+    const mesh_file_header* header = (const mesh_file_header*)data;
+    const size_t index_size = (header->flags & mesh_flag_index32) ? 4 : 2;
+    if (memcmp(header->magic, mesh_file_magic, sizeof(header->magic)) != 0 ||
+        header->version != mesh_file_version ||
+        header->vertex_stride != sizeof(mesh_vertex) ||
+        header->index_count % 3 != 0 ||
+        header->vertex_offset % 4 != 0 || header->index_offset % 4 != 0)
+        return nullptr;
+
+    // counts are 32 bit, the products cannot overflow 64 bits
+    if (header->vertex_offset > size || uint64_t(header->vertex_count) * header->vertex_stride > size - header->vertex_offset ||
+        header->index_offset > size || uint64_t(header->index_count) * index_size > size - header->index_offset)
+        return nullptr;
+
+    // one pass over the indices, the gpu would read past the vertex buffer
+    // for any that is out of range. max instead of a branch per index
+    const uint8_t* indices = (const uint8_t*)data + header->index_offset;
+    uint32_t largest = 0;
+    if (index_size == 4)
+    {
+        for (uint32_t i = 0; i < header->index_count; ++i)
+            largest = std::max(largest, ((const uint32_t*)indices)[i]);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < header->index_count; ++i)
+            largest = std::max<uint32_t>(largest, ((const uint16_t*)indices)[i]);
+    }
+    if (header->index_count && largest >= header->vertex_count)
+        return nullptr;
+
+    return header;
+}
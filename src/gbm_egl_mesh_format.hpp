@@ -0,0 +1,77 @@
+#ifndef _gbm_egl_mesh_format_hpp__
+#define _gbm_egl_mesh_format_hpp__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// binary mesh file, little endian. the header is followed by the vertex and
+// index sections, each 64 byte aligned, laid out exactly as the gpu wants
+// them so a mapping of the file goes to glBufferData without any parsing.
+static const char mesh_file_magic[4] = { 'G', 'M', 'S', 'H' };
+static const uint32_t mesh_file_version = 1;
+
+enum mesh_file_flags : uint32_t
+{
+    mesh_flag_index32 = 1,      // uint32 indices, uint16 otherwise
+};
+
+struct mesh_file_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t flags;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t vertex_stride;
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    float position_min[3];      // quantized 0..65535 spans min..max
+    float position_max[3];
+};
+static_assert(sizeof(mesh_file_header) == 64, "mesh header layout");
+
+struct mesh_vertex
+{
+    uint16_t position[3];       // unorm16 over the bounding box
+    uint16_t pad;
+    uint16_t uv[2];             // half float, may wrap outside 0..1
+};
+static_assert(sizeof(mesh_vertex) == 12, "mesh vertex layout");
+
+// unpacked geometry as read from an interchange format, indexed triangles
+struct mesh_source
+{
+    std::vector<float> positions;   // xyz
+    std::vector<float> uvs;         // uv per vertex, empty when there are none
+    std::vector<uint32_t> indices;
+};
+
+bool read_obj(const char* path, mesh_source& out);
+// ascii and binary_little_endian
+bool read_ply(const char* path, mesh_source& out);
+
+// reorders triangles for post-transform cache reuse (Forsyth's
+// linear-speed vertex cache optimisation)
+void optimize_vertex_cache(std::vector<uint32_t>& indices, uint32_t vertex_count);
+// average cache misses per triangle for a fifo cache of cache_size entries
+double average_cache_miss_ratio(const std::vector<uint32_t>& indices, uint32_t vertex_count, int cache_size = 16);
+
+struct mesh_build_info
+{
+    uint32_t vertex_count = 0;
+    uint32_t triangle_count = 0;
+    double acmr_before = 0;
+    double acmr_after = 0;
+    size_t file_size = 0;
+};
+// optimizes, quantizes and writes source as a mesh file
+bool write_mesh_file(const char* path, const mesh_source& source, mesh_build_info* info = nullptr);
+
+// header of a mapped mesh file when it is well formed and every index
+// names a vertex, nullptr otherwise
+const mesh_file_header* validate_mesh_file(const void* data, size_t size);
+
+uint16_t float_to_half(float value);
+
+#endif
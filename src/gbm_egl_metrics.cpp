@@ -0,0 +1,301 @@
+#include "gbm_egl_metrics.hpp"
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// built on first use, metrics are registered from static initializers too
+struct metrics_registry
+{
+    std::mutex lock;        // registration and scrapes, updates never take it
+    std::deque<metric_counter> counters;
+    std::deque<metric_gauge> gauges;
+    std::vector<const latency_histogram*> histograms;
+};
+
+static metrics_registry& registry()
+{
+    static metrics_registry instance;
+    return instance;
+}
+
+static std::atomic_bool metrics_running {false};
+static std::thread metrics_server;
+static int listen_fd = -1;
+static std::string unix_path;
+
+
+metric_counter& metrics_counter(const char* name, const char* help)
+{
+    metrics_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (metric_counter& counter : r.counters)
+    {
+        if (strcmp(counter.name, name) == 0)
+            return counter;
+    }
+    r.counters.emplace_back(name, help);
+    return r.counters.back();
+}
+
+
+metric_gauge& metrics_gauge(const char* name, const char* help)
+{
+    metrics_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    for (metric_gauge& gauge : r.gauges)
+    {
+        if (strcmp(gauge.name, name) == 0)
+            return gauge;
+    }
+    r.gauges.emplace_back(name, help);
+    return r.gauges.back();
+}
+
+
+void metrics_histogram(const latency_histogram& histogram)
+{
+    metrics_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.histograms.push_back(&histogram);
+}
+
+
+// "glass-to-glass" -> gbm_egl_glass_to_glass_seconds
+static std::string histogram_name(const char* label)
+{
+    std::string name = "gbm_egl_";
+    for (const char* c = label; *c; ++c)
+        name += isalnum((unsigned char)*c) ? char(tolower((unsigned char)*c)) : '_';
+    return name + "_seconds";
+}
+
+
+std::string metrics_text()
+{
+    metrics_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::string text;
+    char line[256];
+
+    for (const metric_counter& counter : r.counters)
+    {
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+                 counter.name, counter.help, counter.name, counter.name,
+                 (unsigned long long)counter.value.load(std::memory_order_relaxed));
+        text += line;
+    }
+
+    for (const metric_gauge& gauge : r.gauges)
+    {
+        snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+                 gauge.name, gauge.help, gauge.name, gauge.name,
+                 (long long)gauge.value.load(std::memory_order_relaxed));
+        text += line;
+    }
+
+    for (const latency_histogram* histogram : r.histograms)
+    {
+        const std::string name = histogram_name(histogram->name());
+        const uint64_t count = histogram->count();
+        snprintf(line, sizeof(line), "# HELP %s %s latency\n# TYPE %s summary\n",
+                 name.c_str(), histogram->name(), name.c_str());
+        text += line;
+        for (double q : { 0.5, 0.9, 0.99, 0.999 })
+        {
+            if (count)
+                snprintf(line, sizeof(line), "%s{quantile=\"%g\"} %.6f\n", name.c_str(), q, histogram->quantile(q) / 1000.0);
+            else
+                snprintf(line, sizeof(line), "%s{quantile=\"%g\"} NaN\n", name.c_str(), q);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "%s_sum %.6f\n%s_count %llu\n",
+                 name.c_str(), histogram->mean() * count / 1000.0, name.c_str(), (unsigned long long)count);
+        text += line;
+    }
+    return text;
+}
+
+
+static std::string json_histogram(const latency_histogram& histogram)
+{
+    char line[320];
+    const uint64_t count = histogram.count();
+    snprintf(line, sizeof(line), "\"%s\": {\"count\": %llu, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+                                 "\"p99\": %.4f, \"p999\": %.4f, \"max\": %.4f}",
+             histogram.name(), (unsigned long long)count, count ? histogram.mean() : 0.0,
+             count ? histogram.quantile(0.5) : 0.0, count ? histogram.quantile(0.9) : 0.0,
+             count ? histogram.quantile(0.99) : 0.0, count ? histogram.quantile(0.999) : 0.0,
+             count ? histogram.max() : 0.0);
+    return line;
+}
+
+
+std::string metrics_json(const std::vector<const latency_histogram*>& extra)
+{
+    metrics_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::string json = "{\n  \"counters\": {";
+    char line[256];
+
+    const char* separator = "\n    ";
+    for (const metric_counter& counter : r.counters)
+    {
+        snprintf(line, sizeof(line), "%s\"%s\": %llu", separator, counter.name,
+                 (unsigned long long)counter.value.load(std::memory_order_relaxed));
+        json += line;
+        separator = ",\n    ";
+    }
+
+    json += "\n  },\n  \"gauges\": {";
+    separator = "\n    ";
+    for (const metric_gauge& gauge : r.gauges)
+    {
+        snprintf(line, sizeof(line), "%s\"%s\": %lld", separator, gauge.name,
+                 (long long)gauge.value.load(std::memory_order_relaxed));
+        json += line;
+        separator = ",\n    ";
+    }
+
+    json += "\n  },\n  \"histograms_ms\": {";
+    separator = "\n    ";
+    std::vector<const latency_histogram*> histograms = r.histograms;
+    histograms.insert(histograms.end(), extra.begin(), extra.end());
+    for (const latency_histogram* histogram : histograms)
+    {
+        json += separator + json_histogram(*histogram);
+        separator = ",\n    ";
+    }
+    json += "\n  }\n}";
+    return json;
+}
+
+
+static void answer(int fd)
+{
+    // the request is not looked at beyond waiting for it, any path gets the metrics
+    char request[1024];
+    pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 1000) <= 0 || recv(fd, request, sizeof(request), 0) <= 0)
+        return;
+
+    const std::string body = metrics_text();
+    char header[160];
+    const int length = snprintf(header, sizeof(header),
+                                "HTTP/1.0 200 OK\r\n"
+                                "Content-Type: text/plain; version=0.0.4\r\n"
+                                "Content-Length: %zu\r\n"
+                                "Connection: close\r\n\r\n", body.size());
+    const std::string response = std::string(header, length) + body;
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        const ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        sent += n;
+    }
+}
+
+
+static void server_loop()
+{
+    // scrapes are never urgent
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+    while (metrics_running)
+    {
+        pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        answer(fd);
+        close(fd);
+    }
+}
+
+
+bool metrics_init(const char* address)
+{
+    if (!address || metrics_running)
+        return false;
+
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        unix_path = address + 5;
+        if (unix_path.empty() || unix_path.size() >= sizeof(addr.sun_path))
+        {
+            std::cerr << "bad metrics socket path " << address << std::endl;
+            return false;
+        }
+        strcpy(addr.sun_path, unix_path.c_str());
+        unlink(addr.sun_path);
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd >= 0 && bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+            close(listen_fd), listen_fd = -1;
+    }
+    else
+    {
+        // loopback only, nothing here is meant to leave the device
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const int reuse = 1;
+        if (listen_fd >= 0)
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (listen_fd >= 0 && bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+            close(listen_fd), listen_fd = -1;
+    }
+
+    if (listen_fd < 0 || listen(listen_fd, 4) != 0)
+    {
+        std::cerr << "failed to serve metrics on " << address << ": " << strerror(errno) << std::endl;
+        if (listen_fd >= 0)
+            close(listen_fd), listen_fd = -1;
+        return false;
+    }
+
+    std::cout << "metrics on " << (unix_path.empty() ? "127.0.0.1:" : "") << address << std::endl;
+    metrics_running = true;
+    metrics_server = std::thread(server_loop);
+    return true;
+}
+
+
+void metrics_shutdown()
+{
+    if (metrics_running)
+    {
+        metrics_running = false;
+        metrics_server.join();
+        close(listen_fd);
+        listen_fd = -1;
+        if (!unix_path.empty())
+            unlink(unix_path.c_str());
+    }
+
+    // their owners go away after this
+    metrics_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.histograms.clear();
+}
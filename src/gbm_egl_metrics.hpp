@@ -0,0 +1,54 @@
+#ifndef _gbm_egl_metrics_hpp__
+#define _gbm_egl_metrics_hpp__
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "gbm_egl_stats.hpp"
+
+// pipeline metrics in prometheus text format. counters and gauges are one
+// atomic each and histograms are the latency_histograms the pipeline keeps
+// anyway, so the hot path pays a relaxed atomic add and nothing else. a
+// low priority thread answers scrapes.
+struct metric_counter
+{
+    metric_counter(const char* metric_name, const char* metric_help) : name(metric_name), help(metric_help) {}
+    void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+
+    const char* name;
+    const char* help;
+    std::atomic<uint64_t> value {0};
+};
+
+struct metric_gauge
+{
+    metric_gauge(const char* metric_name, const char* metric_help) : name(metric_name), help(metric_help) {}
+    void set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+
+    const char* name;
+    const char* help;
+    std::atomic<int64_t> value {0};
+};
+
+// registered once and kept for the life of the process, asking for a name
+// again returns the same metric. names and help must be string literals.
+metric_counter& metrics_counter(const char* name, const char* help);
+metric_gauge& metrics_gauge(const char* name, const char* help);
+// exported as a summary in seconds named after the label, the histogram
+// must stay alive until metrics_shutdown()
+void metrics_histogram(const latency_histogram& histogram);
+
+// everything registered, in the text exposition format
+std::string metrics_text();
+
+// the same and the extra histograms as one json object, counters and gauges
+// by name, histograms by label with quantiles in milliseconds
+std::string metrics_json(const std::vector<const latency_histogram*>& extra = {});
+
+// serves GET requests for metrics_text(), address is a tcp port on the
+// loopback interface or unix:<path>
+bool metrics_init(const char* address);
+void metrics_shutdown();
+
+#endif
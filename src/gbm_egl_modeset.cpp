@@ -0,0 +1,276 @@
+#include "gbm_egl_modeset.hpp"
+#include <sstream>
+
+// drm_mode.h values, kept here so the policy has no libdrm dependency
+#define MODE_FLAG_INTERLACE (1 << 4)
+#define MODE_FLAG_DBLSCAN   (1 << 5)
+#define MODE_TYPE_PREFERRED (1 << 3)
+
+uint32_t display_mode::refresh_mhz() const
+{
+    if (!clock || !htotal || !vtotal)
+        return vrefresh * 1000;
+
+    uint64_t mhz = uint64_t(clock) * 1000000 / htotal / vtotal;
+    if (flags & MODE_FLAG_INTERLACE)
+        mhz *= 2;
+    if (flags & MODE_FLAG_DBLSCAN)
+        mhz /= 2;
+    return uint32_t(mhz);
+}
+
+
+static bool find_crtc(const display_table& table, const display_connector& connector, mode_selection& selection)
+{
+    // keep whatever already drives the connector
+    for (const display_encoder& encoder : table.encoders)
+    {
+        if (encoder.encoder_id == connector.encoder_id && encoder.crtc_id)
+        {
+            for (size_t i = 0; i < table.crtcs.size(); ++i)
+            {
+                if (table.crtcs[i] == encoder.crtc_id)
+                {
+                    selection.encoder_id = encoder.encoder_id;
+                    selection.crtc_id = encoder.crtc_id;
+                    selection.crtc_index = int(i);
+                    return true;
+                }
+            }
+        }
+    }
+
+    // otherwise a compatible crtc that no other encoder is using
+    for (uint32_t encoder_id : connector.encoders)
+    {
+        for (const display_encoder& encoder : table.encoders)
+        {
+            if (encoder.encoder_id != encoder_id)
+                continue;
+
+            for (size_t i = 0; i < table.crtcs.size() && i < 32; ++i)
+            {
+                if (!(encoder.possible_crtcs & (1u << i)))
+                    continue;
+
+                bool busy = false;
+                for (const display_encoder& other : table.encoders)
+                    busy |= other.encoder_id != encoder_id && other.crtc_id == table.crtcs[i];
+
+                if (!busy)
+                {
+                    selection.encoder_id = encoder_id;
+                    selection.crtc_id = table.crtcs[i];
+                    selection.crtc_index = int(i);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+bool select_display_mode(const display_table& table, const mode_policy& policy, mode_selection& out_selection)
+{
+    // lower is better, compared field by field
+    struct score
+    {
+        int size_class = 0;         // 0 exact / preferred size, 1 scaled
+        uint32_t refresh = 0;       // distance to the target refresh
+        int preferred = 0;
+        uint32_t area = 0;
+
+        bool operator<(const score& o) const
+        {
+            if (size_class != o.size_class) return size_class < o.size_class;
+            if (refresh != o.refresh)       return refresh < o.refresh;
+            if (preferred != o.preferred)   return preferred < o.preferred;
+            return area < o.area;
+        }
+    };
+
+    bool found = false;
+    score best;
+    mode_selection selection;
+
+    for (size_t c = 0; c < table.connectors.size(); ++c)
+    {
+        const display_connector& connector = table.connectors[c];
+        if (!connector.connected || connector.modes.empty())
+            continue;
+
+        mode_selection candidate;
+        if (!find_crtc(table, connector, candidate))
+            continue;
+
+        // without a requested size the preferred mode decides it
+        uint16_t width = policy.width;
+        uint16_t height = policy.height;
+        if (!width || !height)
+        {
+            const display_mode* preferred = &connector.modes[0];
+            for (const display_mode& mode : connector.modes)
+            {
+                if (mode.type & MODE_TYPE_PREFERRED)
+                {
+                    preferred = &mode;
+                    break;
+                }
+            }
+            width = preferred->hdisplay;
+            height = preferred->vdisplay;
+        }
+
+        for (size_t m = 0; m < connector.modes.size(); ++m)
+        {
+            const display_mode& mode = connector.modes[m];
+            if (mode.flags & MODE_FLAG_INTERLACE)
+                continue;
+
+            score s;
+            if (mode.hdisplay == width && mode.vdisplay == height)
+                s.size_class = 0;
+            else if (policy.allow_scaling && mode.hdisplay >= width && mode.vdisplay >= height)
+                s.size_class = 1;
+            else
+                continue;
+
+            const uint32_t refresh = mode.refresh_mhz();
+            if (policy.refresh_hz)
+            {
+                const uint32_t target = policy.refresh_hz * 1000;
+                s.refresh = refresh > target ? refresh - target : target - refresh;
+            }
+            else
+            {
+                s.refresh = UINT32_MAX - refresh;
+            }
+            s.preferred = (mode.type & MODE_TYPE_PREFERRED) ? 0 : 1;
+            s.area = uint32_t(mode.hdisplay) * mode.vdisplay;
+
+            if (!found || s < best)
+            {
+                found = true;
+                best = s;
+                selection = candidate;
+                selection.connector = int(c);
+                selection.mode = int(m);
+                selection.render_width = width;
+                selection.render_height = height;
+                selection.scaled = s.size_class != 0;
+            }
+        }
+    }
+
+    if (found)
+        out_selection = selection;
+    return found;
+}
+
+
+uint32_t select_primary_plane(const display_table& table, int crtc_index)
+{
+    if (crtc_index < 0 || crtc_index >= 32)
+        return 0;
+    for (const display_plane& plane : table.planes)
+    {
+        if (plane.type == plane_type::primary && (plane.possible_crtcs & (1u << crtc_index)))
+            return plane.plane_id;
+    }
+    return 0;
+}
+
+
+std::string serialize_display_table(const display_table& table)
+{
+    std::ostringstream out;
+    for (uint32_t crtc : table.crtcs)
+        out << "crtc " << crtc << "\n";
+
+    for (const display_encoder& encoder : table.encoders)
+        out << "encoder " << encoder.encoder_id << " " << encoder.crtc_id << " " << encoder.possible_crtcs << "\n";
+
+    for (const display_plane& plane : table.planes)
+        out << "plane " << plane.plane_id << " " << plane.possible_crtcs << " " << uint32_t(plane.type) << "\n";
+
+    for (const display_connector& connector : table.connectors)
+    {
+        out << "connector " << connector.connector_id << " " << connector.connected << " "
+            << connector.encoder_id << " " << connector.vrr_capable;
+        for (uint32_t encoder_id : connector.encoders)
+            out << " " << encoder_id;
+        out << "\n";
+
+        for (const display_mode& mode : connector.modes)
+            out << "mode " << mode.hdisplay << " " << mode.vdisplay << " " << mode.vrefresh << " "
+                << mode.clock << " " << mode.htotal << " " << mode.vtotal << " "
+                << mode.flags << " " << mode.type << " " << (mode.name.empty() ? "-" : mode.name) << "\n";
+    }
+    return out.str();
+}
+
+
+bool parse_display_table(const std::string& text, display_table& out_table)
+{
+    display_table table;
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string record;
+        if (!(fields >> record) || record[0] == '#')
+            continue;
+
+        if (record == "crtc")
+        {
+            uint32_t crtc = 0;
+            if (!(fields >> crtc))
+                return false;
+            table.crtcs.push_back(crtc);
+        }
+        else if (record == "encoder")
+        {
+            display_encoder encoder;
+            if (!(fields >> encoder.encoder_id >> encoder.crtc_id >> encoder.possible_crtcs))
+                return false;
+            table.encoders.push_back(encoder);
+        }
+        else if (record == "plane")
+        {
+            display_plane plane;
+            uint32_t type = 0;
+            if (!(fields >> plane.plane_id >> plane.possible_crtcs >> type) || type > uint32_t(plane_type::cursor))
+                return false;
+            plane.type = plane_type(type);
+            table.planes.push_back(plane);
+        }
+        else if (record == "connector")
+        {
+            display_connector connector;
+            if (!(fields >> connector.connector_id >> connector.connected >> connector.encoder_id >> connector.vrr_capable))
+                return false;
+            uint32_t encoder_id = 0;
+            while (fields >> encoder_id)
+                connector.encoders.push_back(encoder_id);
+            table.connectors.push_back(connector);
+        }
+        else if (record == "mode")
+        {
+            display_mode mode;
+            if (table.connectors.empty() ||
+                !(fields >> mode.hdisplay >> mode.vdisplay >> mode.vrefresh >> mode.clock
+                         >> mode.htotal >> mode.vtotal >> mode.flags >> mode.type >> mode.name))
+                return false;
+            table.connectors.back().modes.push_back(mode);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    out_table = table;
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef _gbm_egl_modeset_hpp__
+#define _gbm_egl_modeset_hpp__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// plain copies of the drm connector / encoder / mode tables, so the mode
+// selection policy can run (and be replayed from a dump) without hardware
+
+struct display_mode
+{
+    uint16_t hdisplay = 0;
+    uint16_t vdisplay = 0;
+    uint32_t vrefresh = 0;
+    uint32_t clock = 0;
+    uint16_t htotal = 0;
+    uint16_t vtotal = 0;
+    uint32_t flags = 0;
+    uint32_t type = 0;
+    std::string name;
+
+    // refresh rate in mHz from the timings, falls back to vrefresh
+    uint32_t refresh_mhz() const;
+};
+
+struct display_encoder
+{
+    uint32_t encoder_id = 0;
+    uint32_t crtc_id = 0;
+    uint32_t possible_crtcs = 0;
+};
+
+struct display_connector
+{
+    uint32_t connector_id = 0;
+    bool connected = false;
+    uint32_t encoder_id = 0;
+    bool vrr_capable = false;
+    std::vector<uint32_t> encoders;
+    std::vector<display_mode> modes;    // same order as drmModeConnector::modes
+};
+
+// DRM_PLANE_TYPE_* values
+enum class plane_type : uint32_t
+{
+    overlay = 0,
+    primary = 1,
+    cursor = 2
+};
+
+struct display_plane
+{
+    uint32_t plane_id = 0;
+    uint32_t possible_crtcs = 0;        // bit i is table.crtcs[i]
+    plane_type type = plane_type::overlay;
+};
+
+struct display_table
+{
+    std::vector<uint32_t> crtcs;
+    std::vector<display_encoder> encoders;
+    std::vector<display_connector> connectors;
+    std::vector<display_plane> planes;  // universal planes, empty if unknown
+};
+
+struct mode_policy
+{
+    uint16_t width = 0;             // 0 = take the preferred mode size
+    uint16_t height = 0;
+    uint32_t refresh_hz = 0;        // 0 = highest available
+    bool allow_scaling = false;     // render at width x height, scan out a larger mode
+};
+
+struct mode_selection
+{
+    int connector = -1;             // index into display_table::connectors
+    int mode = -1;                  // index into display_connector::modes
+    uint32_t encoder_id = 0;
+    uint32_t crtc_id = 0;
+    int crtc_index = -1;
+    uint16_t render_width = 0;
+    uint16_t render_height = 0;
+    bool scaled = false;
+};
+
+bool select_display_mode(const display_table& table, const mode_policy& policy, mode_selection& out_selection);
+
+// the first primary plane that can feed the crtc, 0 if there is none
+uint32_t select_primary_plane(const display_table& table, int crtc_index);
+
+// one record per line: crtc / encoder / plane / connector / mode (of the
+// last connector), # starts a comment
+std::string serialize_display_table(const display_table& table);
+bool parse_display_table(const std::string& text, display_table& out_table);
+
+#endif
@@ -0,0 +1,77 @@
+#include "gbm_egl_options.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+static bool env_flag(const char* name)
+{
+    const char* value = getenv(name);
+    return value && *value && strcmp(value, "0") != 0;
+}
+
+
+static int env_int(const char* name, int fallback)
+{
+    const char* value = getenv(name);
+    return value && *value ? atoi(value) : fallback;
+}
+
+
+const gbm_egl_options& gbm_egl_options::get()
+{
+    static const gbm_egl_options options = []{
+        gbm_egl_options o;
+        o.latency_barcode = env_flag("GBM_EGL_LATENCY_BARCODE");
+        o.stats_file = getenv("GBM_EGL_STATS_FILE");
+
+        const char* present = getenv("GBM_EGL_PRESENT");
+        if (present && strcmp(present, "fifo") == 0)
+            o.present = present_mode::fifo;
+        else if (present && strcmp(present, "mailbox") == 0)
+            o.present = present_mode::mailbox;
+        else if (present && strcmp(present, "async") == 0)
+            o.present = present_mode::async;
+        else if (present && strcmp(present, "front") == 0)
+            o.present = present_mode::front;
+        else if (present && strcmp(present, "offscreen") == 0)
+            o.present = present_mode::offscreen;
+        o.present_compare = env_int("GBM_EGL_PRESENT_COMPARE", 0);
+
+        o.swapchain_depth = env_int("GBM_EGL_SWAPCHAIN_DEPTH", 0);
+        o.modifiers = env_int("GBM_EGL_MODIFIERS", 1) != 0;
+        o.explicit_sync = env_flag("GBM_EGL_EXPLICIT_SYNC");
+        o.refresh = env_int("GBM_EGL_REFRESH", 0);
+        o.scaling = env_flag("GBM_EGL_SCALING");
+        o.vrr = env_int("GBM_EGL_VRR", 1) != 0;
+        o.modes_dump = getenv("GBM_EGL_MODES_DUMP");
+        o.mesh = getenv("GBM_EGL_MESH");
+        o.postfx = getenv("GBM_EGL_POSTFX");
+        o.profiles = getenv("GBM_EGL_PROFILES");
+        o.profile_cycle = env_int("GBM_EGL_PROFILE_CYCLE", 0);
+        o.source = getenv("GBM_EGL_SOURCE");
+        o.frames = env_int("GBM_EGL_FRAMES", 0);
+        o.bench_json = getenv("GBM_EGL_BENCH_JSON");
+        o.preview_pyramid = env_flag("GBM_EGL_PREVIEW_PYRAMID");
+        o.layer_cache = env_int("GBM_EGL_LAYER_CACHE", 1) != 0;
+        o.color_roi = getenv("GBM_EGL_COLOR_ROI");
+        o.depth_roi = getenv("GBM_EGL_DEPTH_ROI");
+        o.color_decimate = env_int("GBM_EGL_COLOR_DECIMATE", 1);
+        o.depth_decimate = env_int("GBM_EGL_DEPTH_DECIMATE", 1);
+        const char* depth_filter = getenv("GBM_EGL_DEPTH_FILTER");
+        o.depth_min = depth_filter && strcmp(depth_filter, "min") == 0;
+        o.dirty_tiles = env_flag("GBM_EGL_DIRTY_TILES");
+        o.trace_file = getenv("GBM_EGL_TRACE");
+        o.trace_paused = env_flag("GBM_EGL_TRACE_PAUSED");
+        o.upload_thread = env_int("GBM_EGL_UPLOAD_THREAD", 1) != 0;
+        o.workers = env_int("GBM_EGL_WORKERS", 0);
+        o.realtime = getenv("GBM_EGL_RT");
+        o.render_cpu = env_int("GBM_EGL_RENDER_CPU", -1);
+        o.ingest_cpu = env_int("GBM_EGL_INGEST_CPU", -1);
+        o.lock_memory = env_flag("GBM_EGL_MLOCK");
+        o.governor = env_flag("GBM_EGL_GOVERNOR");
+        o.hud = env_flag("GBM_EGL_HUD");
+        o.metrics = getenv("GBM_EGL_METRICS");
+        o.verbose = env_flag("GBM_EGL_VERBOSE");
+        return o;
+    }();
+    return options;
+}
@@ -0,0 +1,154 @@
+#ifndef _gbm_egl_options_hpp__
+#define _gbm_egl_options_hpp__
+
+enum class present_mode
+{
+    surface,    // eglSwapBuffers on the gbm surface, one flip per frame
+    fifo,       // own scanout buffers, frames are shown in render order
+    mailbox,    // own scanout buffers, a newer frame replaces a queued one
+    async,      // like surface, but flips without waiting for vblank (tears)
+    front,      // render straight into the buffer being scanned out (tears)
+    offscreen   // no display, frames end in an fbo once the gpu is done
+};
+
+// runtime switches, read once from the environment
+struct gbm_egl_options
+{
+    // GBM_EGL_LATENCY_BARCODE=1: draw the camera timestamp of the displayed
+    // frame as a barcode, so an external camera can verify glass-to-glass latency
+    bool latency_barcode = false;
+
+    // GBM_EGL_STATS_FILE=<path>: dump latency histograms there on exit
+    const char* stats_file = nullptr;
+
+    // GBM_EGL_PRESENT=surface|fifo|mailbox|async|front|offscreen
+    present_mode present = present_mode::surface;
+
+    // GBM_EGL_PRESENT_COMPARE=<seconds>: with async, alternate between async
+    // and vsync flips at this interval and report both latency distributions
+    int present_compare = 0;
+
+    // GBM_EGL_SWAPCHAIN_DEPTH=<n>: scanout buffers for fifo/mailbox, 0 = default
+    int swapchain_depth = 0;
+
+    // GBM_EGL_MODIFIERS=0: skip format modifier negotiation, implicit layouts only
+    bool modifiers = true;
+
+    // GBM_EGL_EXPLICIT_SYNC=1: pass native fences through atomic commits
+    // (IN_FENCE_FD / OUT_FENCE_PTR) instead of waiting on the cpu, implies fifo
+    bool explicit_sync = false;
+
+    // GBM_EGL_REFRESH=<hz>: preferred refresh rate, 0 = highest available
+    int refresh = 0;
+
+    // GBM_EGL_SCALING=1: without an exact mode, render at the requested size
+    // and let the primary plane scale it up to a larger mode
+    bool scaling = false;
+
+    // GBM_EGL_VRR=0: leave VRR_ENABLED off on vrr capable connectors
+    bool vrr = true;
+
+    // GBM_EGL_MODES_DUMP=<path>: write the connector/mode tables there
+    const char* modes_dump = nullptr;
+
+    // GBM_EGL_MESH=<path>: draw this mesh file (tools/mesh_convert) instead of the cube
+    const char* mesh = nullptr;
+
+    // GBM_EGL_POSTFX=<effect,..>: camera post-processing, sharpen (color),
+    // edges (depth) and overlay (depth edges over color)
+    const char* postfx = nullptr;
+
+    // GBM_EGL_PREVIEW_PYRAMID=1: downsample each color frame into a 1/2, 1/4,
+    // 1/8 pyramid and sample that wherever the cube is small on screen
+    bool preview_pyramid = false;
+
+    // GBM_EGL_LAYER_CACHE=0: run postfx and the preview pyramid every display
+    // frame instead of once per changed camera frame
+    bool layer_cache = true;
+
+    // GBM_EGL_PROFILES=<color>[+<depth>]@<fps>,..: camera stream profiles,
+    // e.g. 1920x1080+1280x720@30,640x480@90, the first one is used at startup
+    // and SIGUSR2 switches to the next
+    const char* profiles = nullptr;
+
+    // GBM_EGL_SOURCE=synthetic|static|<file.bag>: instead of the camera, a
+    // generated moving pattern or still frame at the profile's size and
+    // rate, or a librealsense recording played back in a loop
+    const char* source = nullptr;
+
+    // GBM_EGL_FRAMES=<n>: stop after rendering that many frames
+    int frames = 0;
+
+    // GBM_EGL_BENCH_JSON=<path>: write throughput, stage latencies, counters
+    // and per-thread cpu time there as json on exit
+    const char* bench_json = nullptr;
+
+    // GBM_EGL_PROFILE_CYCLE=<seconds>: switch stream profiles at this interval
+    int profile_cycle = 0;
+
+    // GBM_EGL_COLOR_ROI=<x>,<y>,<w>,<h>, GBM_EGL_DEPTH_ROI=..: copy only that
+    // part of each camera frame into a smaller texture, in frame pixels and
+    // clipped to the frame of each profile
+    const char* color_roi = nullptr;
+    const char* depth_roi = nullptr;
+
+    // GBM_EGL_COLOR_DECIMATE=<n>, GBM_EGL_DEPTH_DECIMATE=<n>: keep one pixel
+    // in 2 or 4 along both axes while copying
+    int color_decimate = 1;
+    int depth_decimate = 1;
+
+    // GBM_EGL_DEPTH_FILTER=median|min: a decimated depth block becomes its
+    // median or its nearest valid depth
+    bool depth_min = false;
+
+    // GBM_EGL_DIRTY_TILES=1: hash camera frames in 64x16 texel tiles and only
+    // rewrite the tiles that changed since the frame before, for mostly
+    // static scenes
+    bool dirty_tiles = false;
+
+    // GBM_EGL_WORKERS=<n>: cores for the per-frame cpu work, 0 = one per big
+    // core, 1 = all of it on the camera processing thread
+    int workers = 0;
+
+    // GBM_EGL_UPLOAD_THREAD=0: bind images and upload on the render thread
+    // instead of a worker with a shared context
+    bool upload_thread = true;
+
+    // GBM_EGL_RT=fifo|deadline: real-time scheduling for the render and camera
+    // processing threads, needs CAP_SYS_NICE or an rtprio limit
+    const char* realtime = nullptr;
+
+    // GBM_EGL_RENDER_CPU=<n>, GBM_EGL_INGEST_CPU=<n>: pin the render and camera
+    // processing threads to those cores, -1 = anywhere
+    int render_cpu = -1;
+    int ingest_cpu = -1;
+
+    // GBM_EGL_MLOCK=1: lock all memory once running and prefault the texture
+    // mappings of each camera copy up front
+    bool lock_memory = false;
+
+    // GBM_EGL_TRACE=<path>: write chrome trace events there, SIGUSR1 toggles
+    // tracing at runtime, GBM_EGL_TRACE_PAUSED=1 starts with tracing off
+    const char* trace_file = nullptr;
+    bool trace_paused = false;
+
+    // GBM_EGL_GOVERNOR=1: when frames overrun the refresh interval, lower the
+    // render resolution, then the post-processing size, then the camera fps,
+    // and go back up once there is headroom again
+    bool governor = false;
+
+    // GBM_EGL_HUD=1: overlay fps, stage latencies, drops, gpu time and a
+    // frame time graph
+    bool hud = false;
+
+    // GBM_EGL_METRICS=<port>|unix:<path>: serve prometheus metrics on that
+    // loopback port or unix socket
+    const char* metrics = nullptr;
+
+    // GBM_EGL_VERBOSE=1: print the full EGL / GL extension lists at startup
+    bool verbose = false;
+
+    static const gbm_egl_options& get();
+};
+
+#endif
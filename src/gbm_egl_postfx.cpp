@@ -0,0 +1,414 @@
+#include "gbm_egl_postfx.hpp"
+#include "gbm_egl_util.hpp"
+#include "gbm_egl_resources.hpp"
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <iostream>
+#include <unordered_map>
+
+static std::unordered_map<std::string, uint> program_cache;
+
+
+static uint cached_program(const std::string& fragment_source)
+{
+    auto found = program_cache.find(fragment_source);
+    if (found != program_cache.end())
+        return found->second;
+
+    static const char *vertex_shader_source =
+        "#version 300 es                                \n"
+        "                                               \n"
+        "in vec2 in_position;                           \n"
+        "                                               \n"
+        "out vec2 vTexCoord;                            \n"
+        "                                               \n"
+        "void main()                                    \n"
+        "{                                              \n"
+        "    gl_Position = vec4(in_position, 0.0, 1.0); \n"
+        "    vTexCoord = in_position * 0.5 + 0.5;       \n"
+        "}                                              \n";
+
+    const uint program = create_program(vertex_shader_source, fragment_source.c_str(), "postfx");
+    if (program == uint(-1))
+        std::cerr << "postfx program:\n" << fragment_source << std::endl;
+    program_cache.emplace(fragment_source, program);
+    return program;
+}
+
+
+void postfx_release_programs()
+{
+    for (auto& entry : program_cache)
+        destroy_program(entry.second);
+    program_cache.clear();
+}
+
+
+postfx_graph::~postfx_graph()
+{
+    destroy();
+}
+
+
+int postfx_graph::source(uint texture, uint target, int width, int height)
+{
+    node n;
+    n.kind = node_kind::source;
+    n.name = "source";
+    n.texture = texture;
+    n.target = target;
+    n.width = width;
+    n.height = height;
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+
+int postfx_graph::point(const char* name, const char* glsl, std::initializer_list<int> inputs)
+{
+    for (int input : inputs)
+    {
+        if (input < 0 || input >= int(nodes.size()))
+            return -1;
+    }
+
+    node n;
+    n.kind = node_kind::point;
+    n.name = name;
+    n.glsl = glsl;
+    n.inputs = inputs;
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+
+int postfx_graph::neighbourhood(const char* name, const char* glsl, int input)
+{
+    if (input < 0 || input >= int(nodes.size()))
+        return -1;
+
+    node n;
+    n.kind = node_kind::neighbourhood;
+    n.name = name;
+    n.glsl = glsl;
+    n.inputs = { input };
+    nodes.push_back(n);
+    return nodes.size() - 1;
+}
+
+
+void postfx_graph::mark_roots(int n, bool sampled, int root, bool& changed)
+{
+    node& x = nodes[n];
+    if (x.kind == node_kind::source || (x.root && n != root))
+        return;
+
+    if (x.kind == node_kind::neighbourhood)
+    {
+        // sampling a sampled value would multiply the taps, render it once instead
+        if (sampled && n != root)
+        {
+            x.root = true;
+            changed = true;
+            return;
+        }
+        sampled = true;
+    }
+
+    for (int input : x.inputs)
+        mark_roots(input, sampled, root, changed);
+}
+
+
+void postfx_graph::order_passes(int root, std::vector<int>& order, std::vector<bool>& visited)
+{
+    if (visited[root])
+        return;
+    visited[root] = true;
+
+    // passes this one reads from go first
+    std::vector<int> stack(nodes[root].inputs);
+    std::vector<bool> seen(nodes.size(), false);
+    while (!stack.empty())
+    {
+        const int n = stack.back();
+        stack.pop_back();
+        if (seen[n])
+            continue;
+        seen[n] = true;
+
+        if (nodes[n].root)
+            order_passes(n, order, visited);
+        else
+            stack.insert(stack.end(), nodes[n].inputs.begin(), nodes[n].inputs.end());
+    }
+    order.push_back(root);
+}
+
+
+int postfx_graph::input_index(pass& p, int n)
+{
+    for (size_t i = 0; i < p.inputs.size(); ++i)
+    {
+        if (p.inputs[i].node == n)
+            return i;
+    }
+    p.inputs.push_back({ n, -1, -1 });
+    return p.inputs.size() - 1;
+}
+
+
+int postfx_graph::primary_input(pass& p, int n)
+{
+    do
+        n = nodes[n].inputs[0];
+    while (nodes[n].kind != node_kind::source && !nodes[n].root);
+    return input_index(p, n);
+}
+
+
+void postfx_graph::source_size(int n, int& width, int& height)
+{
+    while (nodes[n].kind != node_kind::source)
+        n = nodes[n].inputs[0];
+    width = nodes[n].width;
+    height = nodes[n].height;
+}
+
+
+void postfx_graph::emit_node(int n, pass& p, std::vector<bool>& emitted, std::string& code)
+{
+    if (emitted[n])
+        return;
+    emitted[n] = true;
+
+    const node& x = nodes[n];
+    const std::string fn = "n" + std::to_string(n);
+    if (x.kind == node_kind::source || (x.root && n != p.root))
+    {
+        const std::string k = std::to_string(input_index(p, n));
+        code += "vec4 " + fn + "(vec2 uv) { return texture(src" + k + ", uv); }\n\n";
+        return;
+    }
+
+    for (int input : x.inputs)
+        emit_node(input, p, emitted, code);
+
+    code += "// " + x.name + "\n";
+    if (x.kind == node_kind::point)
+    {
+        std::string params, args;
+        for (size_t i = 0; i < x.inputs.size(); ++i)
+        {
+            params += (i ? ", vec4 c" : "vec4 c") + std::to_string(i);
+            args += (i ? ", n" : "n") + std::to_string(x.inputs[i]) + "(uv)";
+        }
+        code += "vec4 " + fn + "_op(" + params + ")\n{\n" + x.glsl + "\n}\n";
+        code += "vec4 " + fn + "(vec2 uv) { return " + fn + "_op(" + args + "); }\n\n";
+    }
+    else
+    {
+        const std::string k = std::to_string(primary_input(p, n));
+        code += "#define in0(p) n" + std::to_string(x.inputs[0]) + "(p)\n";
+        code += "#define texel texel" + k + "\n";
+        code += "vec4 " + fn + "(vec2 uv)\n{\n" + x.glsl + "\n}\n";
+        code += "#undef in0\n#undef texel\n\n";
+    }
+}
+
+
+bool postfx_graph::build_pass(pass& p)
+{
+    std::vector<bool> emitted(nodes.size(), false);
+    std::string functions;
+    emit_node(p.root, p, emitted, functions);
+
+    bool external = false;
+    std::string uniforms;
+    for (size_t k = 0; k < p.inputs.size(); ++k)
+    {
+        const bool oes = nodes[p.inputs[k].node].target == GL_TEXTURE_EXTERNAL_OES;
+        external |= oes;
+        uniforms += std::string("uniform ") + (oes ? "samplerExternalOES" : "sampler2D") + " src" + std::to_string(k) + ";\n";
+        uniforms += "uniform vec2 texel" + std::to_string(k) + ";\n";
+    }
+
+    std::string source = "#version 300 es\n";
+    if (external)
+        source += "#extension GL_OES_EGL_image_external : require\n";
+    source += "precision mediump float;\n"
+              "precision highp int;\n"
+              "\n"
+              "in vec2 vTexCoord;\n"
+              "out vec4 o_FragColor;\n"
+              "\n";
+    source += uniforms + "\n" + functions;
+    source += "void main()\n{\n    o_FragColor = n" + std::to_string(p.root) + "(vTexCoord);\n}\n";
+
+    p.program = cached_program(source);
+    if (p.program == uint(-1))
+        return false;
+
+    for (size_t k = 0; k < p.inputs.size(); ++k)
+    {
+        p.inputs[k].location = glGetUniformLocation(p.program, ("src" + std::to_string(k)).c_str());
+        p.inputs[k].texel_location = glGetUniformLocation(p.program, ("texel" + std::to_string(k)).c_str());
+    }
+
+    glGenTextures(1, &p.texture);
+    resource_created(resource_kind::texture, uint64_t(p.texture), size_t(p.width) * p.height * 4, "postfx");
+    glBindTexture(GL_TEXTURE_2D, p.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, p.width, p.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint framebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGenFramebuffers(1, &p.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, p.texture, 0);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (!complete)
+    {
+        std::cerr << "postfx target for " << nodes[p.root].name << " incomplete" << std::endl;
+        return false;
+    }
+
+    // later passes sample the result like any other texture
+    node& root = nodes[p.root];
+    root.texture = p.texture;
+    root.target = GL_TEXTURE_2D;
+    root.width = p.width;
+    root.height = p.height;
+    return true;
+}
+
+
+bool postfx_graph::compile(int output, int width, int height)
+{
+    destroy();
+    if (output < 0 || output >= int(nodes.size()) || nodes[output].kind == node_kind::source)
+        return false;
+
+    for (node& n : nodes)
+        n.root = false;
+    nodes[output].root = true;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t n = 0; n < nodes.size(); ++n)
+        {
+            if (nodes[n].root)
+                mark_roots(n, false, n, changed);
+        }
+    }
+
+    std::vector<int> order;
+    std::vector<bool> visited(nodes.size(), false);
+    order_passes(output, order, visited);
+
+    for (int root : order)
+    {
+        pass p;
+        p.root = root;
+        if (root == output)
+            p.width = width, p.height = height;
+        else
+            source_size(root, p.width, p.height);
+        passes.push_back(p);
+        if (!build_pass(passes.back()))
+        {
+            destroy();
+            return false;
+        }
+    }
+
+    static const float triangle[] = { -1.0f, -1.0f, 3.0f, -1.0f, -1.0f, 3.0f };
+    glGenBuffers(1, &quad_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+
+    std::cout << "postfx: " << nodes.size() << " nodes in " << passes.size() << " pass(es), "
+              << program_cache.size() << " programs cached" << std::endl;
+    return true;
+}
+
+
+void postfx_graph::run()
+{
+    if (passes.empty())
+        return;
+
+    GLint framebuffer = 0, viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    const GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    glBindBuffer(GL_ARRAY_BUFFER, quad_vbo);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0);
+
+    for (const pass& p : passes)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+        glViewport(0, 0, p.width, p.height);
+        glUseProgram(p.program);
+        for (size_t k = 0; k < p.inputs.size(); ++k)
+        {
+            const node& input = nodes[p.inputs[k].node];
+            glActiveTexture(GL_TEXTURE0 + k);
+            glBindTexture(input.target, input.texture);
+            glUniform1i(p.inputs[k].location, k);
+            glUniform2f(p.inputs[k].texel_location, 1.0f / input.width, 1.0f / input.height);
+        }
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if (depth_test)
+        glEnable(GL_DEPTH_TEST);
+    if (cull_face)
+        glEnable(GL_CULL_FACE);
+}
+
+
+void postfx_graph::reset()
+{
+    destroy();
+    nodes.clear();
+}
+
+
+uint postfx_graph::output_texture() const
+{
+    return passes.empty() ? 0 : passes.back().texture;
+}
+
+
+void postfx_graph::destroy()
+{
+    for (pass& p : passes)
+    {
+        if (p.fbo)
+            glDeleteFramebuffers(1, &p.fbo);
+        if (p.texture)
+        {
+            resource_destroyed(resource_kind::texture, uint64_t(p.texture));
+            glDeleteTextures(1, &p.texture);
+        }
+    }
+    passes.clear();
+
+    if (quad_vbo)
+        glDeleteBuffers(1, &quad_vbo), quad_vbo = 0;
+}
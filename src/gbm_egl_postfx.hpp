@@ -0,0 +1,88 @@
+#ifndef _gbm_egl_postfx_hpp__
+#define _gbm_egl_postfx_hpp__
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// post-processing graph over fullscreen passes. point-wise nodes are fused
+// into whatever pass consumes them, a neighbourhood node reads its input
+// chain by re-evaluating it at each tap, so a pass boundary (an fbo) is only
+// needed where a neighbourhood node samples another neighbourhood node.
+//
+// node snippets are glsl function bodies returning vec4:
+//   point:          c0, c1, .. are the input colors at this fragment
+//   neighbourhood:  in0(uv) samples the input anywhere, uv is the fragment
+//                   position and texel the size of one source pixel
+class postfx_graph
+{
+public:
+    ~postfx_graph();
+
+    // a texture rendered elsewhere, target is GL_TEXTURE_2D or GL_TEXTURE_EXTERNAL_OES
+    int source(uint texture, uint target, int width, int height);
+    int point(const char* name, const char* glsl, std::initializer_list<int> inputs);
+    int neighbourhood(const char* name, const char* glsl, int input);
+
+    // splits the graph into passes ending in output, rendered at width x height
+    bool compile(int output, int width, int height);
+    // renders all passes, keeps the bound framebuffer, viewport and state
+    void run();
+    // the rendered output, a GL_TEXTURE_2D
+    uint output_texture() const;
+    int pass_count() const { return passes.size(); }
+    void destroy();
+    // destroys and forgets all nodes, for building the graph anew
+    void reset();
+
+private:
+    enum class node_kind { source, point, neighbourhood };
+    struct node
+    {
+        node_kind kind;
+        std::string name;
+        std::string glsl;
+        std::vector<int> inputs;
+        uint texture = 0;
+        uint target = 0;
+        int width = 0;
+        int height = 0;
+        bool root = false;
+    };
+
+    struct pass_input
+    {
+        int node;
+        int location;
+        int texel_location;
+    };
+    struct pass
+    {
+        int root;
+        uint program = 0;
+        uint fbo = 0;
+        uint texture = 0;
+        int width = 0;
+        int height = 0;
+        std::vector<pass_input> inputs;
+    };
+
+    void mark_roots(int n, bool sampled, int root, bool& changed);
+    void order_passes(int root, std::vector<int>& order, std::vector<bool>& visited);
+    bool build_pass(pass& p);
+    void emit_node(int n, pass& p, std::vector<bool>& emitted, std::string& code);
+    int input_index(pass& p, int n);
+    int primary_input(pass& p, int n);
+    void source_size(int n, int& width, int& height);
+
+    std::vector<node> nodes;
+    std::vector<pass> passes;
+    uint quad_vbo = 0;
+};
+
+// programs are shared by all graphs, keyed by their generated source
+void postfx_release_programs();
+
+#endif
@@ -0,0 +1,177 @@
+#include "gbm_egl_realtime.hpp"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <iostream>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+
+// not in glibc before 2.41
+struct deadline_attr
+{
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+static const size_t huge_page = 2 * 1024 * 1024;
+
+
+rt_policy parse_rt_policy(const char* name)
+{
+    if (name && strcmp(name, "fifo") == 0)
+        return rt_policy::fifo;
+    if (name && strcmp(name, "deadline") == 0)
+        return rt_policy::deadline;
+    if (name && *name && strcmp(name, "0") != 0)
+        std::cerr << "unknown real-time policy " << name << ", expected fifo or deadline" << std::endl;
+    return rt_policy::none;
+}
+
+
+bool apply_thread_profile(const char* role, const thread_profile& profile)
+{
+    bool ok = true;
+    if (profile.cpu >= 0 && profile.policy != rt_policy::deadline)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(profile.cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            std::cerr << "failed to pin " << role << " thread to cpu " << profile.cpu << std::endl;
+            ok = false;
+        }
+    }
+
+    if (profile.policy == rt_policy::fifo)
+    {
+        // threads it starts later (camera restarts, librealsense) stay normal
+        sched_param param = {};
+        param.sched_priority = profile.priority;
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0)
+        {
+            std::cerr << "failed to run " << role << " thread at SCHED_FIFO " << profile.priority << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    else if (profile.policy == rt_policy::deadline)
+    {
+        deadline_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.sched_policy = SCHED_DEADLINE;
+        // without it a deadline thread cannot start threads at all
+        attr.sched_flags = SCHED_FLAG_RESET_ON_FORK;
+        attr.sched_runtime = uint64_t(profile.runtime_ms * 1000000.0);
+        attr.sched_deadline = attr.sched_period = uint64_t(profile.period_ms * 1000000.0);
+        if (syscall(SYS_sched_setattr, 0, &attr, 0) != 0)
+        {
+            std::cerr << "failed to run " << role << " thread at SCHED_DEADLINE " << profile.runtime_ms << "/"
+                      << profile.period_ms << " ms: " << strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        return ok;
+    }
+
+    std::cout << role << " thread: " << (profile.policy == rt_policy::fifo ? "SCHED_FIFO" : "SCHED_DEADLINE");
+    if (profile.cpu >= 0 && profile.policy != rt_policy::deadline)
+        std::cout << " on cpu " << profile.cpu;
+    std::cout << std::endl;
+    return ok;
+}
+
+
+bool lock_memory()
+{
+    // everything locked counts against RLIMIT_MEMLOCK, 8 MB by default.
+    // raised as far as we may, and with any limit left later mappings are
+    // not locked: under MCL_FUTURE the per-frame texture mappings would
+    // fail once it is used up
+    rlimit limit = {};
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    {
+        rlimit unlimited = { RLIM_INFINITY, RLIM_INFINITY };
+        if (setrlimit(RLIMIT_MEMLOCK, &unlimited) == 0)
+            limit = unlimited;
+        else if (limit.rlim_cur != limit.rlim_max)
+        {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_MEMLOCK, &limit);
+        }
+    }
+    int flags = MCL_CURRENT | MCL_FUTURE;
+    if (limit.rlim_cur != RLIM_INFINITY)
+    {
+        std::cerr << "RLIMIT_MEMLOCK is " << limit.rlim_cur / 1024 << " KiB, only memory mapped now is locked" << std::endl;
+        flags = MCL_CURRENT;
+    }
+    if (mlockall(flags) != 0)
+    {
+        std::cerr << "mlockall failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // the stack the frame loop will grow into, faulted while it does not matter
+    volatile uint8_t stack[256 * 1024];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+    return true;
+}
+
+
+void prefault(void* address, size_t size)
+{
+    const long page = sysconf(_SC_PAGESIZE);
+    volatile uint8_t* bytes = (volatile uint8_t*)address;
+    for (size_t i = 0; i < size; i += page)
+        bytes[i] = 0;
+}
+
+
+void* staging_alloc(size_t size, bool huge_pages)
+{
+    // whole huge pages either way, so staging_free need not know which it got
+    const size_t rounded = (size + huge_page - 1) & ~(huge_page - 1);
+    void* address = MAP_FAILED;
+    if (huge_pages)
+        address = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (address == MAP_FAILED)
+    {
+        address = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        // no reserved pool (vm.nr_hugepages), transparent ones may still do
+        if (address != MAP_FAILED && huge_pages)
+            madvise(address, rounded, MADV_HUGEPAGE);
+    }
+    if (address == MAP_FAILED)
+        return nullptr;
+
+    prefault(address, size);
+    return address;
+}
+
+
+void staging_free(void* address, size_t size)
+{
+    if (address)
+        munmap(address, (size + huge_page - 1) & ~(huge_page - 1));
+}
@@ -0,0 +1,45 @@
+#ifndef _gbm_egl_realtime_hpp__
+#define _gbm_egl_realtime_hpp__
+
+#include <stddef.h>
+
+enum class rt_policy
+{
+    none,       // default cfs scheduling
+    fifo,       // SCHED_FIFO at a fixed priority
+    deadline    // SCHED_DEADLINE, runtime reserved every period
+};
+
+// scheduling of one pipeline thread
+struct thread_profile
+{
+    rt_policy policy = rt_policy::none;
+    int priority = 0;           // fifo, 1..99
+    double period_ms = 0;       // deadline, how often the thread wakes up
+    double runtime_ms = 0;      // deadline, cpu time it needs per period
+    int cpu = -1;               // pinned there, -1 = anywhere
+};
+
+rt_policy parse_rt_policy(const char* name);
+
+// for the calling thread, threads it starts do not inherit it. failures are
+// reported and leave the thread as it was, real-time policies need
+// CAP_SYS_NICE or an RLIMIT_RTPRIO. deadline threads cannot be pinned, the
+// kernel rejects affinity narrower than the root domain.
+bool apply_thread_profile(const char* role, const thread_profile& profile);
+
+// locks everything mapped now and later, so page faults stay out of the
+// frame loop, and prefaults some stack for the calling thread. RLIMIT_MEMLOCK
+// is raised to its hard limit, if that is not unlimited only what is mapped
+// now gets locked.
+bool lock_memory();
+
+// writes to every page once
+void prefault(void* address, size_t size);
+
+// anonymous memory for staging frames, on 2 MB huge pages when asked for
+// and available, else on normal pages. always prefaulted.
+void* staging_alloc(size_t size, bool huge_pages);
+void staging_free(void* address, size_t size);
+
+#endif
@@ -0,0 +1,143 @@
+#include "gbm_egl_resources.hpp"
+#include "gbm_egl_metrics.hpp"
+#include <stdio.h>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+static const int kind_count = int(resource_kind::count);
+
+struct kind_metrics
+{
+    metric_gauge& live;
+    metric_gauge& bytes;
+    metric_counter& created;
+};
+
+struct live_resource
+{
+    size_t bytes;
+    const char* tag;
+};
+
+struct resource_registry
+{
+    std::mutex lock;
+    std::unordered_map<uint64_t, live_resource> live[kind_count];
+    resource_usage usage[kind_count];
+    kind_metrics metrics[kind_count] = {
+        { metrics_gauge("gbm_egl_live_bos", "Gbm buffer objects alive."),
+          metrics_gauge("gbm_egl_live_bo_bytes", "Bytes held by live gbm buffer objects."),
+          metrics_counter("gbm_egl_bos_created_total", "Gbm buffer objects created.") },
+        { metrics_gauge("gbm_egl_live_fbs", "Drm framebuffers alive."),
+          metrics_gauge("gbm_egl_live_fb_bytes", "Bytes scanned out from live drm framebuffers."),
+          metrics_counter("gbm_egl_fbs_created_total", "Drm framebuffers created.") },
+        { metrics_gauge("gbm_egl_live_images", "Egl images alive."),
+          metrics_gauge("gbm_egl_live_image_bytes", "Bytes behind live egl images."),
+          metrics_counter("gbm_egl_images_created_total", "Egl images created.") },
+        { metrics_gauge("gbm_egl_live_textures", "Gl textures alive."),
+          metrics_gauge("gbm_egl_live_texture_bytes", "Bytes held by live gl textures."),
+          metrics_counter("gbm_egl_textures_created_total", "Gl textures created.") },
+        { metrics_gauge("gbm_egl_live_programs", "Gl programs alive."),
+          metrics_gauge("gbm_egl_live_program_bytes", "Always 0, programs have no size of their own."),
+          metrics_counter("gbm_egl_programs_created_total", "Gl programs linked.") },
+        { metrics_gauge("gbm_egl_live_mappings", "Memory mappings alive."),
+          metrics_gauge("gbm_egl_live_mapping_bytes", "Bytes mapped."),
+          metrics_counter("gbm_egl_mappings_created_total", "Memory mappings made.") },
+    };
+};
+
+// never destroyed, the device singleton releases its resources after the
+// function statics made later than it are gone
+static resource_registry& registry()
+{
+    static resource_registry* instance = new resource_registry;
+    return *instance;
+}
+
+
+const char* resource_kind_name(resource_kind kind)
+{
+    static const char* names[kind_count] = { "bo", "fb", "image", "texture", "program", "mapping" };
+    return int(kind) >= 0 && int(kind) < kind_count ? names[int(kind)] : "unknown";
+}
+
+
+void resource_created(resource_kind kind, uint64_t handle, size_t bytes, const char* tag)
+{
+    resource_registry& r = registry();
+    const int k = int(kind);
+    std::lock_guard<std::mutex> guard(r.lock);
+    auto inserted = r.live[k].emplace(handle, live_resource{bytes, tag});
+    if (!inserted.second)
+    {
+        // made again without being destroyed through us, the old one is gone
+        fprintf(stderr, "%s %llx from %s replaced by one from %s\n", resource_kind_name(kind),
+                        (unsigned long long)handle, inserted.first->second.tag, tag);
+        r.usage[k].bytes -= inserted.first->second.bytes;
+        --r.usage[k].live;
+        inserted.first->second = live_resource{bytes, tag};
+    }
+    resource_usage& usage = r.usage[k];
+    ++usage.live;
+    usage.bytes += bytes;
+    ++usage.created;
+    r.metrics[k].live.set(usage.live);
+    r.metrics[k].bytes.set(usage.bytes);
+    r.metrics[k].created.add();
+}
+
+
+void resource_destroyed(resource_kind kind, uint64_t handle)
+{
+    resource_registry& r = registry();
+    const int k = int(kind);
+    std::lock_guard<std::mutex> guard(r.lock);
+    auto it = r.live[k].find(handle);
+    if (it == r.live[k].end())
+    {
+        fprintf(stderr, "untracked %s %llx destroyed\n", resource_kind_name(kind), (unsigned long long)handle);
+        return;
+    }
+    resource_usage& usage = r.usage[k];
+    --usage.live;
+    usage.bytes -= it->second.bytes;
+    ++usage.destroyed;
+    r.live[k].erase(it);
+    r.metrics[k].live.set(usage.live);
+    r.metrics[k].bytes.set(usage.bytes);
+}
+
+
+std::vector<resource_usage> resources_snapshot()
+{
+    resource_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    return std::vector<resource_usage>(r.usage, r.usage + kind_count);
+}
+
+
+std::string resources_report()
+{
+    resource_registry& r = registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    std::string report;
+    char line[256];
+    for (int k = 0; k < kind_count; ++k)
+    {
+        std::map<std::string, std::pair<uint64_t, uint64_t>> by_tag;
+        for (const auto& entry : r.live[k])
+        {
+            auto& totals = by_tag[entry.second.tag];
+            ++totals.first;
+            totals.second += entry.second.bytes;
+        }
+        for (const auto& tag : by_tag)
+        {
+            snprintf(line, sizeof(line), "%-8s %-20s %6llu live %10.1f KiB\n", resource_kind_name(resource_kind(k)), tag.first.c_str(),
+                     (unsigned long long)tag.second.first, tag.second.second / 1024.0);
+            report += line;
+        }
+    }
+    return report;
+}
@@ -0,0 +1,57 @@
+#ifndef _gbm_egl_resources_hpp__
+#define _gbm_egl_resources_hpp__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// every buffer object, drm framebuffer, egl image, gl texture, program and
+// mapping the pipeline makes. live counts and bytes per kind are exported
+// as metrics and each object is remembered with a tag naming the code that
+// made it, so whatever piles up can be traced back. a create or destroy
+// takes a lock and updates a map, fine for a few objects per frame.
+enum class resource_kind
+{
+    bo,
+    fb,
+    image,
+    texture,
+    program,
+    mapping,
+    count
+};
+
+const char* resource_kind_name(resource_kind kind);
+
+// handle is whatever identifies the object within its kind: the gbm_bo*,
+// the fb id, the EGLImage, the gl name, the mapped address. tags must be
+// string literals.
+void resource_created(resource_kind kind, uint64_t handle, size_t bytes, const char* tag);
+void resource_destroyed(resource_kind kind, uint64_t handle);
+
+inline void resource_created(resource_kind kind, const void* handle, size_t bytes, const char* tag)
+{
+    resource_created(kind, uint64_t(uintptr_t(handle)), bytes, tag);
+}
+
+inline void resource_destroyed(resource_kind kind, const void* handle)
+{
+    resource_destroyed(kind, uint64_t(uintptr_t(handle)));
+}
+
+struct resource_usage
+{
+    uint64_t live = 0;
+    uint64_t bytes = 0;
+    uint64_t created = 0;
+    uint64_t destroyed = 0;
+};
+
+// indexed by resource_kind
+std::vector<resource_usage> resources_snapshot();
+
+// what is alive now by kind and tag, one line each
+std::string resources_report();
+
+#endif
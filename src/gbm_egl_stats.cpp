@@ -0,0 +1,229 @@
+#include "gbm_egl_stats.hpp"
+#include <time.h>
+#include <pthread.h>
+#include <math.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+static double clock_ms(clockid_t id)
+{
+    timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+double monotonic_ms()
+{
+    return clock_ms(CLOCK_MONOTONIC);
+}
+
+
+double realtime_ms()
+{
+    return clock_ms(CLOCK_REALTIME);
+}
+
+
+std::vector<thread_cpu_time> thread_cpu_times()
+{
+    std::vector<thread_cpu_time> times;
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks)
+        return times;
+
+    const double tick_ms = 1000.0 / sysconf(_SC_CLK_TCK);
+    while (dirent* entry = readdir(tasks))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        char path[288], stat[512];      // a d_name is up to 255 bytes
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat", entry->d_name);
+        FILE* file = fopen(path, "r");
+        if (!file)
+            continue;
+        const size_t length = fread(stat, 1, sizeof(stat) - 1, file);
+        fclose(file);
+        stat[length] = 0;
+
+        // pid (comm) state ... utime stime are fields 14 and 15, comm may
+        // hold spaces and parentheses itself
+        const char* open = strchr(stat, '(');
+        const char* close = strrchr(stat, ')');
+        unsigned long long user = 0, system = 0;
+        if (!open || !close || close < open ||
+            sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &user, &system) != 2)
+            continue;
+        times.push_back({ std::string(open + 1, close), user * tick_ms, system * tick_ms });
+    }
+    closedir(tasks);
+    return times;
+}
+
+
+latency_histogram::latency_histogram(const char* name)
+    : label(name)
+{
+    reset();
+}
+
+
+int latency_histogram::bucket_of(uint64_t us)
+{
+    // values below 2 * sub_buckets are exact, above that every power of two
+    // is split into sub_buckets linear steps
+    if (us < 2 * sub_buckets)
+        return int(us);
+
+    const int msb = 63 - __builtin_clzll(us);
+    const int shift = msb - 7;
+    const int bucket = (shift + 1) * sub_buckets + int((us >> shift) - sub_buckets);
+    return bucket < bucket_count ? bucket : bucket_count - 1;
+}
+
+
+uint64_t latency_histogram::lower_bound_of(int bucket)
+{
+    if (bucket < 2 * sub_buckets)
+        return bucket;
+
+    const int shift = bucket / sub_buckets - 1;
+    return uint64_t(bucket % sub_buckets + sub_buckets) << shift;
+}
+
+
+void latency_histogram::record(double ms)
+{
+    if (ms < 0.0)
+        return;
+
+    const uint64_t us = uint64_t(ms * 1000.0);
+    buckets[bucket_of(us)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum_us.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t prev = max_us.load(std::memory_order_relaxed);
+    while (us > prev && !max_us.compare_exchange_weak(prev, us, std::memory_order_relaxed))
+        ;
+}
+
+
+void latency_histogram::reset()
+{
+    for (auto& bucket : buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum_us.store(0, std::memory_order_relaxed);
+    max_us.store(0, std::memory_order_relaxed);
+}
+
+
+uint64_t latency_histogram::count() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+
+double latency_histogram::mean() const
+{
+    const uint64_t n = count();
+    return n ? sum_us.load(std::memory_order_relaxed) / 1000.0 / n : 0.0;
+}
+
+
+double latency_histogram::max() const
+{
+    return max_us.load(std::memory_order_relaxed) / 1000.0;
+}
+
+
+double latency_histogram::quantile(double q) const
+{
+    const uint64_t n = count();
+    if (n == 0)
+        return 0.0;
+
+    // nearest rank
+    uint64_t target = uint64_t(ceil(q * n));
+    if (target < 1)
+        target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < bucket_count; ++i)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= target)
+        {
+            // report the middle of the bucket
+            const uint64_t lo = lower_bound_of(i);
+            const uint64_t hi = lower_bound_of(i + 1);
+            return std::min((lo + (hi - lo) / 2.0) / 1000.0, max());
+        }
+    }
+    return max();
+}
+
+
+void latency_histogram::print() const
+{
+    fprintf(stdout, "%-20s n=%-8llu mean=%7.2f p50=%7.2f p90=%7.2f p99=%7.2f p99.9=%7.2f max=%7.2f ms\n",
+                    label, (unsigned long long)count(), mean(),
+                    quantile(0.50), quantile(0.90), quantile(0.99), quantile(0.999), max());
+}
+
+
+void latency_histogram::dump(FILE* file) const
+{
+    // one row per non empty bucket, bounds in microseconds
+    fprintf(file, "# %s\n", label);
+    fprintf(file, "lower_us,upper_us,count\n");
+    for (int i = 0; i < bucket_count; ++i)
+    {
+        const uint64_t n = buckets[i].load(std::memory_order_relaxed);
+        if (n)
+            fprintf(file, "%llu,%llu,%llu\n", (unsigned long long)lower_bound_of(i),
+                                            (unsigned long long)lower_bound_of(i + 1),
+                                            (unsigned long long)n);
+    }
+}
+
+
+startup_timeline::startup_timeline()
+    : start(monotonic_ms())
+{
+}
+
+
+void startup_timeline::mark(const char* event)
+{
+    const double now = monotonic_ms();
+    std::lock_guard<std::mutex> guard(lock);
+    for (const entry& e : entries)
+    {
+        if (e.event == event)
+            return;
+    }
+    entries.push_back({ event, now - start, (unsigned long)pthread_self() });
+}
+
+
+void startup_timeline::print(const char* first_frame, double target_ms) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    fprintf(stdout, "startup timeline:\n");
+    const entry* shown = nullptr;
+    for (const entry& e : entries)
+    {
+        fprintf(stdout, "  %8.1f ms  %-32s thread %lx\n", e.time, e.event.c_str(), e.thread);
+        if (e.event == first_frame)
+            shown = &e;
+    }
+    if (!shown)
+        fprintf(stdout, "no %s, the target is %.0f ms\n", first_frame, target_ms);
+    else if (shown->time > target_ms)
+        fprintf(stdout, "%s after %.1f ms, %.1f ms over the %.0f ms target\n", first_frame, shown->time,
+                        shown->time - target_ms, target_ms);
+    else
+        fprintf(stdout, "%s after %.1f ms, within the %.0f ms target\n", first_frame, shown->time, target_ms);
+}
@@ -0,0 +1,80 @@
+#ifndef _gbm_egl_stats_hpp__
+#define _gbm_egl_stats_hpp__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// CLOCK_MONOTONIC / CLOCK_REALTIME in milliseconds
+double monotonic_ms();
+double realtime_ms();
+
+// cpu time each thread of the process used so far, by thread name
+struct thread_cpu_time
+{
+    std::string name;
+    double user_ms;
+    double system_ms;
+};
+std::vector<thread_cpu_time> thread_cpu_times();
+
+// log-linear latency histogram, ~1% resolution from 1us up to hours.
+// record() is lock free and may be called from any thread.
+class latency_histogram
+{
+public:
+    explicit latency_histogram(const char* name);
+
+    void record(double ms);
+    void reset();
+
+    const char* name() const { return label; }
+    uint64_t count() const;
+    double mean() const;
+    double max() const;
+    double quantile(double q) const;
+
+    void print() const;
+    void dump(FILE* file) const;
+
+private:
+    static constexpr int sub_buckets = 128;
+    static constexpr int bucket_count = 40 * sub_buckets;
+    static int bucket_of(uint64_t us);
+    static uint64_t lower_bound_of(int bucket);
+
+    const char* label;
+    std::atomic<uint64_t> buckets[bucket_count];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum_us;
+    std::atomic<uint64_t> max_us;
+};
+
+// named startup milestones relative to construction, first mark of a name wins
+class startup_timeline
+{
+public:
+    startup_timeline();
+
+    void mark(const char* event);
+    // every milestone, then how long it took until first_frame was marked
+    // against target_ms
+    void print(const char* first_frame, double target_ms) const;
+
+private:
+    struct entry
+    {
+        std::string event;
+        double time;
+        unsigned long thread;
+    };
+
+    double start;
+    mutable std::mutex lock;
+    std::vector<entry> entries;
+};
+
+#endif
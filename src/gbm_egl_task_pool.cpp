@@ -0,0 +1,229 @@
+#include "gbm_egl_task_pool.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+
+// queue index of the calling thread, the outside queue for non-workers
+static thread_local int worker_index = -1;
+
+
+task_pool::~task_pool()
+{
+    stop();
+}
+
+
+std::vector<int> task_pool::big_cores()
+{
+    // big.LITTLE parts only differ in their maximum clock
+    std::vector<int> cores;
+    long fastest = 0;
+    const int count = std::max(1u, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < count; ++cpu)
+    {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        long khz = 0;
+        if (FILE* file = fopen(path, "r"))
+        {
+            if (fscanf(file, "%ld", &khz) != 1)
+                khz = 0;
+            fclose(file);
+        }
+        if (khz > fastest)
+            fastest = khz, cores.clear();
+        if (khz == fastest)
+            cores.push_back(cpu);
+    }
+    return cores;
+}
+
+
+void task_pool::start(int count, bool pin)
+{
+    stop();
+
+    const std::vector<int> cores = big_cores();
+    if (count <= 0)
+        count = cores.size();
+
+    stopping = false;
+    queues.clear();
+    for (int i = 0; i < count; ++i)
+        queues.emplace_back(new task_queue());
+
+    // the waiting thread is one of the cores, so one worker less
+    for (int i = 0; i < count - 1; ++i)
+    {
+        threads.emplace_back([this, i](){ worker_loop(i); });
+        // room for any int, cut to the 15 characters a thread name can have
+        char name[24];
+        snprintf(name, sizeof(name), "worker %d", i);
+        name[15] = '\0';
+        pthread_setname_np(threads.back().native_handle(), name);
+        if (pin)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cores[i % cores.size()], &set);
+            if (pthread_setaffinity_np(threads.back().native_handle(), sizeof(set), &set) != 0)
+                std::cerr << "failed to pin worker " << i << " to cpu " << cores[i % cores.size()] << std::endl;
+        }
+    }
+}
+
+
+void task_pool::stop()
+{
+    if (threads.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+    threads.clear();
+    queues.clear();
+}
+
+
+void task_pool::run(task_group& group, std::function<void()> fn)
+{
+    task t;
+    t.fn = std::move(fn);
+    t.group = &group;
+    ++group.pending;
+
+    if (threads.empty())
+    {
+        execute(t);
+        return;
+    }
+
+    task_queue& queue = *queues[worker_index >= 0 ? worker_index : queues.size() - 1];
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(t));
+    }
+    if (queued++ == 0)
+    {
+        // taking the lock orders this against a worker about to sleep
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake.notify_one();
+}
+
+
+bool task_pool::pop(int index, task& out)
+{
+    const int count = queues.size();
+    const int own = index >= 0 ? index : count - 1;
+
+    // newest own task first, it is most likely still in cache
+    {
+        task_queue& queue = *queues[own];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            out = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --queued;
+            return true;
+        }
+    }
+
+    // the oldest of somebody else's, usually the biggest piece left
+    for (int k = 1; k < count; ++k)
+    {
+        task_queue& queue = *queues[(own + k) % count];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (!queue.tasks.empty())
+        {
+            out = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void task_pool::execute(task& t)
+{
+    t.fn();
+    if (--t.group->pending == 0)
+    {
+        // taking the lock orders this against a waiter about to sleep
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        finished.notify_all();
+    }
+}
+
+
+void task_pool::worker_loop(int index)
+{
+    worker_index = index;
+    while (true)
+    {
+        task t;
+        if (pop(index, t))
+        {
+            execute(t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        wake.wait(guard, [this](){ return stopping || queued > 0; });
+        if (stopping)
+            break;
+    }
+}
+
+
+void task_pool::wait(task_group& group)
+{
+    // help while there is work left, then sleep until the tasks still
+    // running elsewhere are done. a real-time waiter that yielded instead
+    // would keep the normal priority workers running them off its core
+    while (!group.done())
+    {
+        task t;
+        if (pop(worker_index, t))
+        {
+            execute(t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        finished.wait(guard, [&group](){ return group.done(); });
+    }
+}
+
+
+void task_pool::parallel_rows(int rows, const std::function<void(int first, int last)>& fn)
+{
+    // a few tiles per core evens out cores that get preempted
+    const int tiles = threads.empty() ? 1 : size() * 4;
+    const int tile_rows = std::max(16, (rows + tiles - 1) / tiles);
+    if (tile_rows >= rows)
+    {
+        fn(0, rows);
+        return;
+    }
+
+    task_group group;
+    for (int first = tile_rows; first < rows; first += tile_rows)
+    {
+        const int last = std::min(rows, first + tile_rows);
+        run(group, [&fn, first, last](){ fn(first, last); });
+    }
+    // the first tile on this thread, then whatever is left over
+    fn(0, tile_rows);
+    wait(group);
+}
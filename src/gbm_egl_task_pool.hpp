@@ -0,0 +1,76 @@
+#ifndef _gbm_egl_task_pool_hpp__
+#define _gbm_egl_task_pool_hpp__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// tasks that are joined together
+class task_group
+{
+public:
+    bool done() const { return pending == 0; }
+
+private:
+    friend class task_pool;
+    std::atomic_int pending {0};
+};
+
+// work stealing pool for per-frame cpu stages. every worker owns a deque,
+// runs its newest task first and steals the oldest from the others when it
+// runs dry. a thread waiting on a group runs tasks meanwhile, so tasks can
+// fork and join tasks of their own, and sleeps once none are left to take.
+// without workers everything runs inline.
+class task_pool
+{
+public:
+    ~task_pool();
+
+    // threads = cores working on a group, counting the one that waits on it,
+    // 0 = one per big core. workers are pinned to their core.
+    void start(int threads = 0, bool pin = true);
+    void stop();
+    // cores working on a group, 1 when everything runs inline
+    int size() const { return threads.size() + 1; }
+
+    void run(task_group& group, std::function<void()> task);
+    void wait(task_group& group);
+
+    // [0, rows) split into tiles, fn(first, last) for each, returns when all are done
+    void parallel_rows(int rows, const std::function<void(int first, int last)>& fn);
+
+    // the fastest cores, all of them on a symmetric cpu
+    static std::vector<int> big_cores();
+
+private:
+    struct task
+    {
+        std::function<void()> fn;
+        task_group* group = nullptr;
+    };
+    struct task_queue
+    {
+        std::mutex lock;
+        std::deque<task> tasks;
+    };
+
+    void worker_loop(int index);
+    bool pop(int index, task& out);
+    void execute(task& t);
+
+    // one per worker, the last one takes tasks from outside the pool
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> threads;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::condition_variable finished;   // a group's last task is done
+    std::atomic_int queued {0};
+    std::atomic_bool stopping {false};
+};
+
+#endif
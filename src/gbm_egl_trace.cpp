@@ -0,0 +1,292 @@
+#include "gbm_egl_trace.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+std::atomic_bool trace_enabled {false};
+thread_local trace_buffer* trace_local = nullptr;
+bool trace_counter_ticks = false;
+
+static std::mutex trace_lock;
+static std::vector<trace_buffer*> trace_buffers;
+static std::atomic_bool trace_toggle {false};
+static std::atomic_bool trace_running {false};
+static bool trace_draining = false;     // the writer frees exited rings, under trace_lock
+static std::thread trace_writer;
+static std::string trace_path;
+
+// a tick and CLOCK_MONOTONIC read together at trace_init. every drain reads
+// another pair, the rate between them gets better the longer the run
+struct tick_calibration
+{
+    uint64_t ticks = 0;
+    uint64_t ns = 0;
+    double ns_per_tick = 1.0;
+};
+static tick_calibration trace_calibration;
+
+
+static uint64_t monotonic_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+
+static tick_calibration calibration_pair()
+{
+    tick_calibration pair;
+    pair.ticks = trace_ticks();
+    pair.ns = monotonic_ns();
+    return pair;
+}
+
+
+static bool counter_ticks_usable()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // the kernel dropped the tsc as clocksource when it found it unstable
+    // or not in sync across cpus
+    char source[32] = {};
+    FILE* file = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (!file)
+        return false;
+    const bool tsc = fgets(source, sizeof(source), file) && strcmp(source, "tsc\n") == 0;
+    fclose(file);
+    return tsc;
+#elif defined(__aarch64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+// hands the ring of an exiting thread to the writer, whatever is still in
+// it gets written first
+struct trace_owner
+{
+    trace_buffer* buffer = nullptr;
+
+    ~trace_owner()
+    {
+        if (!buffer)
+            return;
+        std::lock_guard<std::mutex> guard(trace_lock);
+        if (trace_draining)
+        {
+            buffer->exited.store(true, std::memory_order_release);
+            return;
+        }
+        trace_buffers.erase(std::find(trace_buffers.begin(), trace_buffers.end(), buffer));
+        delete buffer;
+    }
+};
+
+static thread_local trace_owner local_owner;
+// named before it traced, the ring takes the name once it is made
+static thread_local const char* local_name = nullptr;
+
+trace_buffer* trace_register_thread()
+{
+    trace_buffer* buffer = new trace_buffer;
+    buffer->tid = syscall(SYS_gettid);
+    buffer->thread_name = local_name;
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    trace_buffers.push_back(buffer);
+    trace_local = buffer;
+    local_owner.buffer = buffer;
+    return buffer;
+}
+
+
+void trace_thread_name(const char* name)
+{
+    local_name = name;
+    if (trace_local)
+        trace_local->thread_name = name;
+
+    // the os keeps 15 characters
+    if (syscall(SYS_gettid) != getpid())
+    {
+        char comm[16];
+        snprintf(comm, sizeof(comm), "%s", name);
+        pthread_setname_np(pthread_self(), comm);
+    }
+}
+
+
+static void write_thread_name(FILE* file, bool& first, const trace_buffer* buffer)
+{
+    if (buffer->thread_name)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+                      first ? "" : ",\n", buffer->tid, buffer->thread_name);
+        first = false;
+    }
+}
+
+
+static bool drain(FILE* file, bool& first)
+{
+    bool wrote = false;
+    tick_calibration& base = trace_calibration;
+    const tick_calibration now = calibration_pair();
+    if (trace_counter_ticks && now.ticks > base.ticks)
+        base.ns_per_tick = double(now.ns - base.ns) / double(now.ticks - base.ticks);
+
+    std::lock_guard<std::mutex> guard(trace_lock);
+    for (size_t i = 0; i < trace_buffers.size(); ++i)
+    {
+        trace_buffer* buffer = trace_buffers[i];
+        // nothing gets pushed after exited is set, the head read after it is final
+        const bool exited = buffer->exited.load(std::memory_order_acquire);
+        const uint32_t head = buffer->head.load(std::memory_order_acquire);
+        uint32_t tail = buffer->tail.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+        {
+            const trace_event& e = buffer->events[tail & (trace_buffer::capacity - 1)];
+            if (file)
+            {
+                const double ns = e.phase == 'i' || !trace_counter_ticks
+                                ? double(e.ts) : base.ns + (double(e.ts) - double(base.ticks)) * base.ns_per_tick;
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%ld",
+                              first ? "" : ",\n", e.name, e.phase, ns / 1000.0, buffer->tid);
+                if (e.phase == 'C')
+                    fprintf(file, ",\"args\":{\"value\":%lld}}", (long long)e.value);
+                else if (e.phase == 'i')
+                    fprintf(file, ",\"s\":\"t\"}");
+                else
+                    fprintf(file, "}");
+                first = false;
+                wrote = true;
+            }
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+
+        if (exited)
+        {
+            if (file)
+                write_thread_name(file, first, buffer);
+            trace_buffers.erase(trace_buffers.begin() + i--);
+            delete buffer;
+        }
+    }
+    return wrote;
+}
+
+
+static void write_thread_names(FILE* file, bool& first)
+{
+    std::lock_guard<std::mutex> guard(trace_lock);
+    for (trace_buffer* buffer : trace_buffers)
+        write_thread_name(file, first, buffer);
+}
+
+
+static void writer_loop()
+{
+    // stay out of the way of the pipeline threads
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    trace_thread_name("trace writer");
+
+    FILE* file = nullptr;
+    bool first = true;
+    while (trace_running)
+    {
+        if (trace_toggle.exchange(false))
+            trace_enabled = !trace_enabled;
+
+        if (trace_enabled && !file)
+        {
+            file = fopen(trace_path.c_str(), "w");
+            if (file)
+            {
+                fprintf(file, "[\n");
+                first = true;
+                std::cout << "tracing to " << trace_path << std::endl;
+            }
+            else
+            {
+                std::cerr << "failed to open trace file " << trace_path << std::endl;
+                trace_enabled = false;
+            }
+        }
+
+        drain(file, first);
+
+        if (!trace_enabled && file)
+        {
+            drain(file, first);
+            write_thread_names(file, first);
+            fprintf(file, "\n]\n");
+            fclose(file);
+            file = nullptr;
+            std::cout << "trace written to " << trace_path << std::endl;
+        }
+
+        usleep(50000);
+    }
+
+    trace_enabled = false;
+    if (file)
+    {
+        drain(file, first);
+        write_thread_names(file, first);
+        fprintf(file, "\n]\n");
+        fclose(file);
+    }
+}
+
+
+void trace_init(const char* path, bool enabled)
+{
+    if (!path || trace_running)
+        return;
+
+    trace_path = path;
+    // before anything is pushed, every tick in the rings is of one kind
+    trace_counter_ticks = counter_ticks_usable();
+    trace_calibration = calibration_pair();
+    trace_enabled = enabled;
+    trace_running = true;
+    {
+        std::lock_guard<std::mutex> guard(trace_lock);
+        trace_draining = true;
+    }
+    signal(SIGUSR1, [](int){ trace_toggle = true; });
+    trace_writer = std::thread(writer_loop);
+}
+
+
+void trace_shutdown()
+{
+    if (trace_running)
+    {
+        trace_running = false;
+        trace_writer.join();
+
+        // what exited after the last drain, the rest goes with its thread
+        std::lock_guard<std::mutex> guard(trace_lock);
+        trace_draining = false;
+        for (size_t i = 0; i < trace_buffers.size(); ++i)
+        {
+            if (trace_buffers[i]->exited)
+            {
+                delete trace_buffers[i];
+                trace_buffers.erase(trace_buffers.begin() + i--);
+            }
+        }
+    }
+}
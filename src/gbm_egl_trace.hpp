@@ -0,0 +1,135 @@
+#ifndef _gbm_egl_trace_hpp__
+#define _gbm_egl_trace_hpp__
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// chrome trace event output (chrome://tracing, ui.perfetto.dev).
+// each thread writes into its own single producer ring, made the first time
+// it traces and freed once the thread has exited and its ring is drained. a
+// background thread drains them into the json file. names must be string
+// literals. events carry raw cpu counter ticks, the writer turns them into
+// CLOCK_MONOTONIC time with a calibration taken at trace_init.
+
+struct trace_event
+{
+    uint64_t ts;    // ticks, nanoseconds for instants
+    const char* name;
+    int64_t value;
+    char phase;     // 'B' begin, 'E' end, 'C' counter, 'i' instant
+};
+
+class trace_buffer
+{
+public:
+    static constexpr uint32_t capacity = 1 << 14;
+
+    bool push(char phase, const char* name, uint64_t ts, int64_t value)
+    {
+        const uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= capacity)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        events[h & (capacity - 1)] = { ts, name, value, phase };
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    std::atomic<uint32_t> head {0};
+    std::atomic<uint32_t> tail {0};
+    std::atomic<uint64_t> dropped {0};
+    std::atomic_bool exited {false};    // the writer frees it once drained
+    long tid = 0;
+    const char* thread_name = nullptr;
+    trace_event events[capacity];
+};
+
+extern std::atomic_bool trace_enabled;
+extern thread_local trace_buffer* trace_local;
+trace_buffer* trace_register_thread();
+
+// the invariant tsc, or the arm generic timer, a few ns to read where a
+// clock_gettime costs tens. CLOCK_MONOTONIC in ns where the kernel does not
+// trust the tsc itself
+extern bool trace_counter_ticks;
+
+inline uint64_t trace_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (trace_counter_ticks)
+        return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#endif
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+inline bool trace_push(char phase, const char* name, uint64_t ts, int64_t value = 0)
+{
+    trace_buffer* buffer = trace_local ? trace_local : trace_register_thread();
+    return buffer->push(phase, name, ts, value);
+}
+
+// true when the event made it into the ring
+inline bool trace_begin(const char* name)
+{
+    return trace_enabled.load(std::memory_order_relaxed) && trace_push('B', name, trace_ticks());
+}
+
+inline void trace_end(const char* name)
+{
+    if (trace_enabled.load(std::memory_order_relaxed))
+        trace_push('E', name, trace_ticks());
+}
+
+inline void trace_counter(const char* name, int64_t value)
+{
+    if (trace_enabled.load(std::memory_order_relaxed))
+        trace_push('C', name, trace_ticks(), value);
+}
+
+// for events timed elsewhere in CLOCK_MONOTONIC ns, e.g. page flip
+// completion from the kernel
+inline void trace_instant(const char* name, uint64_t ts_ns)
+{
+    if (trace_enabled.load(std::memory_order_relaxed))
+        trace_push('i', name, ts_ns);
+}
+
+// the end is written only for a begin that was, whether tracing was
+// toggled in between or not
+class trace_span
+{
+public:
+    explicit trace_span(const char* span_name) : name(span_name), begun(trace_begin(name)) {}
+    ~trace_span()
+    {
+        if (begun)
+            trace_push('E', name, trace_ticks());
+    }
+
+private:
+    const char* name;
+    bool begun;
+};
+
+// names the calling thread in the trace and, unless it is the main thread
+// whose name is the process name, for top and /proc
+void trace_thread_name(const char* name);
+
+// starts the writer thread, tracing is on right away when enabled is set,
+// SIGUSR1 toggles it at runtime, each session rewrites path
+void trace_init(const char* path, bool enabled);
+void trace_shutdown();
+
+#endif
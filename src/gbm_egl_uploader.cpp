@@ -0,0 +1,350 @@
+#include "gbm_egl_uploader.hpp"
+#include "gbm_egl_trace.hpp"
+#include <string.h>
+#include <iostream>
+#include <future>
+#define EGL_EGLEXT_PROTOTYPES
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GLES2/gl2ext.h>
+
+// gles 3.0, not in the gles2 headers
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+
+typedef void* (GL_APIENTRYP map_buffer_range_proc)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (GL_APIENTRYP unmap_buffer_proc)(GLenum target);
+static map_buffer_range_proc map_buffer_range = nullptr;
+static unmap_buffer_proc unmap_buffer = nullptr;
+
+// the pixel buffer belongs to the upload context
+static GLuint pixel_buffer = 0;
+
+
+texture_uploader::~texture_uploader()
+{
+    shutdown();
+}
+
+
+bool texture_uploader::init(EGLDisplay egl_display, EGLConfig config, EGLContext share)
+{
+    const char* extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_fence_sync"))
+    {
+        std::cout << "no EGL_KHR_fence_sync, uploads stay on the render thread" << std::endl;
+        return false;
+    }
+
+    // without surfaceless contexts the worker needs a surface of its own
+    EGLConfig upload_config = config;
+    EGLSurface upload_surface = EGL_NO_SURFACE;
+    if (!strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_NONE
+        };
+        const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        EGLint n = 0;
+        if (!eglChooseConfig(egl_display, config_attribs, &upload_config, 1, &n) || n != 1 ||
+            (upload_surface = eglCreatePbufferSurface(egl_display, upload_config, pbuffer_attribs)) == EGL_NO_SURFACE)
+        {
+            std::cerr << "failed to create an upload surface, uploads stay on the render thread" << std::endl;
+            return false;
+        }
+    }
+
+    const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    EGLContext upload_context = eglCreateContext(egl_display, upload_config, share, context_attribs);
+    if (upload_context == EGL_NO_CONTEXT)
+    {
+        std::cerr << "failed to create a shared upload context, uploads stay on the render thread" << std::endl;
+        if (upload_surface != EGL_NO_SURFACE)
+            eglDestroySurface(egl_display, upload_surface);
+        return false;
+    }
+
+    display = egl_display;
+    context = upload_context;
+    surface = upload_surface;
+    stopping = false;
+
+    std::promise<bool> current;
+    std::future<bool> made_current = current.get_future();
+    worker = std::thread([this](std::promise<bool> current){
+        const bool ok = eglMakeCurrent(display, surface, surface, context);
+        current.set_value(ok);
+        if (ok)
+            run();
+    }, std::move(current));
+    if (!made_current.get())
+    {
+        std::cerr << "failed to make the upload context current, uploads stay on the render thread" << std::endl;
+        worker.join();
+        eglDestroyContext(display, context);
+        if (surface != EGL_NO_SURFACE)
+            eglDestroySurface(display, surface);
+        context = surface = nullptr;
+        return false;
+    }
+
+    std::cout << "upload thread on a shared context" << (surface != EGL_NO_SURFACE ? " (pbuffer)" : "") << std::endl;
+    return true;
+}
+
+
+void texture_uploader::shutdown()
+{
+    if (!active())
+        return;
+
+    finish();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+
+    eglDestroyContext(display, context);
+    if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    context = surface = nullptr;
+}
+
+
+void texture_uploader::run()
+{
+    trace_thread_name("upload");
+
+    // pixel buffers are core in gles 3, a gles 2 driver uploads from client memory
+    const char* version = (const char*)glGetString(GL_VERSION);
+    if (version && strstr(version, "OpenGL ES 3"))
+    {
+        map_buffer_range = (map_buffer_range_proc)eglGetProcAddress("glMapBufferRange");
+        unmap_buffer = (unmap_buffer_proc)eglGetProcAddress("glUnmapBuffer");
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [this](){ return stopping || !pending.empty(); });
+        if (pending.empty())
+            break;
+
+        job next = std::move(pending.front());
+        pending.pop_front();
+        guard.unlock();
+
+        const double start = monotonic_ms();
+        {
+            trace_span span("upload job");
+            next.work();
+        }
+        // the fence only signals for other threads once it is flushed
+        EGLSyncKHR sync = eglCreateSyncKHR(display, EGL_SYNC_FENCE_KHR, nullptr);
+        if (sync != EGL_NO_SYNC_KHR)
+            glFlush();
+        else
+            glFinish();
+        next.sync = sync;
+        worker_time.record(monotonic_ms() - start);
+
+        guard.lock();
+        flushed.push_back(std::move(next));
+        wake.notify_all();
+    }
+    guard.unlock();
+
+    if (pixel_buffer)
+        glDeleteBuffers(1, &pixel_buffer), pixel_buffer = 0;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+
+uint64_t texture_uploader::submit(std::function<void()> work, std::function<void()> on_ready)
+{
+    job next;
+    next.ticket = next_ticket++;
+    next.work = std::move(work);
+    next.on_ready = std::move(on_ready);
+    next.submitted = monotonic_ms();
+
+    if (!active())
+    {
+        next.work();
+        complete(next);
+        return next.ticket;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.push_back(std::move(next));
+    }
+    wake.notify_all();
+    return next_ticket - 1;
+}
+
+
+uint64_t texture_uploader::retarget(uint texture, void* image, std::function<void()> on_ready)
+{
+    return submit([texture, image](){
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture);
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES)image);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+    }, std::move(on_ready));
+}
+
+
+uint64_t texture_uploader::upload_texture(uint texture, int width, int height, std::vector<uint8_t> pixels,
+                                          bool mipmaps, std::function<void()> on_ready)
+{
+    if (pixels.size() < size_t(width) * height * 4)
+    {
+        std::cerr << "upload of " << width << "x" << height << " needs " << size_t(width) * height * 4
+                  << " bytes, got " << pixels.size() << std::endl;
+        return submit([](){}, std::move(on_ready));
+    }
+
+    return submit([texture, width, height, pixels = std::move(pixels), mipmaps](){
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        // copied into a freshly orphaned buffer, so the copy never waits for
+        // the previous upload and the driver transfers it asynchronously
+        const void* data = pixels.data();
+        if (map_buffer_range && unmap_buffer)
+        {
+            if (!pixel_buffer)
+                glGenBuffers(1, &pixel_buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, pixels.size(), nullptr, GL_STREAM_DRAW);
+            void* mapped = map_buffer_range(GL_PIXEL_UNPACK_BUFFER, 0, pixels.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (mapped)
+            {
+                memcpy(mapped, pixels.data(), pixels.size());
+                unmap_buffer(GL_PIXEL_UNPACK_BUFFER);
+                data = nullptr;
+            }
+            else
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        if (!data)
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (mipmaps)
+            glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }, std::move(on_ready));
+}
+
+
+void texture_uploader::complete(job& done)
+{
+    // fences of one context signal in order, anything else is a bug here
+    if (done.ticket != last_completed + 1)
+        std::cerr << "upload " << done.ticket << " completed after " << last_completed << std::endl;
+
+    if (done.on_ready)
+        done.on_ready();
+    last_completed = done.ticket;
+    job_latency.record(monotonic_ms() - done.submitted);
+}
+
+
+void texture_uploader::poll()
+{
+    if (!active())
+        return;
+
+    const double start = monotonic_ms();
+    bool checked = false;
+    while (true)
+    {
+        job done;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (flushed.empty())
+                break;
+            checked = true;
+            job& front = flushed.front();
+            if (front.sync)
+            {
+                if (eglClientWaitSyncKHR(display, front.sync, 0, 0) != EGL_CONDITION_SATISFIED_KHR)
+                    break;
+                eglDestroySyncKHR(display, front.sync);
+            }
+            done = std::move(front);
+            flushed.pop_front();
+        }
+        complete(done);
+    }
+    if (checked)
+        poll_time.record(monotonic_ms() - start);
+}
+
+
+void texture_uploader::finish()
+{
+    if (!active())
+        return;
+
+    trace_span span("upload finish");
+    const uint64_t last = next_ticket - 1;
+    std::unique_lock<std::mutex> guard(lock);
+    wake.wait(guard, [this, last](){
+        return last_completed >= last || (!flushed.empty() && flushed.back().ticket >= last);
+    });
+
+    // everything is fenced and flushed, only the gpu is left to wait for
+    while (!flushed.empty())
+    {
+        job done = std::move(flushed.front());
+        flushed.pop_front();
+        if (done.sync)
+        {
+            eglClientWaitSyncKHR(display, done.sync, 0, EGL_FOREVER_KHR);
+            eglDestroySyncKHR(display, done.sync);
+        }
+        guard.unlock();
+        complete(done);
+        guard.lock();
+    }
+}
+
+
+void texture_uploader::print() const
+{
+    if (!worker_time.count())
+        return;
+
+    // the worker's time is what the render thread saved, minus the polling
+    const double worker_ms = worker_time.mean() * worker_time.count();
+    const double poll_ms = poll_time.mean() * poll_time.count();
+    fprintf(stdout, "uploads: %llu jobs, %.1f ms off the render thread, %.1f ms polling\n",
+                    (unsigned long long)worker_time.count(), worker_ms, poll_ms);
+    worker_time.print();
+    poll_time.print();
+    job_latency.print();
+}
+
+
+void texture_uploader::dump(FILE* file) const
+{
+    worker_time.dump(file);
+    poll_time.dump(file);
+    job_latency.dump(file);
+}
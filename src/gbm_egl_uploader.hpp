@@ -0,0 +1,87 @@
+#ifndef _gbm_egl_uploader_hpp__
+#define _gbm_egl_uploader_hpp__
+
+#include <EGL/egl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gbm_egl_stats.hpp"
+
+// gl uploads on a worker thread with its own context, shared with the render
+// context. each job is followed by an EGL fence, the render thread polls the
+// fences without waiting and runs a job's completion once the gpu is done
+// with it, so it never blocks on upload work. jobs finish in submit order.
+// without a worker (init failed or never called) jobs run inline.
+class texture_uploader
+{
+public:
+    ~texture_uploader();
+
+    // call on the render thread with its context current
+    bool init(EGLDisplay display, EGLConfig config, EGLContext share);
+    // waits for the queued jobs, then stops the worker
+    void shutdown();
+    bool active() const { return worker.joinable(); }
+
+    // work runs with the upload context current, on_ready on the render
+    // thread from poll(). returns a ticket, complete once completed() reaches it
+    uint64_t submit(std::function<void()> work, std::function<void()> on_ready = nullptr);
+
+    // binds an EGLImage to an external texture
+    uint64_t retarget(uint texture, void* image, std::function<void()> on_ready = nullptr);
+    // rgba8 pixels into a GL_TEXTURE_2D through a pixel buffer, optionally
+    // with mipmaps. the texture must have storage of at least width x height
+    uint64_t upload_texture(uint texture, int width, int height, std::vector<uint8_t> pixels,
+                            bool mipmaps, std::function<void()> on_ready = nullptr);
+
+    // render thread, once per frame: completes the jobs whose fence signaled
+    void poll();
+    // render thread: blocks until every submitted job is complete
+    void finish();
+    uint64_t completed() const { return last_completed; }
+    uint64_t submitted() const { return next_ticket - 1; }
+
+    void print() const;
+    void dump(FILE* file) const;
+    std::vector<const latency_histogram*> histograms() const { return { &worker_time, &poll_time, &job_latency }; }
+
+private:
+    struct job
+    {
+        uint64_t ticket = 0;
+        std::function<void()> work;
+        std::function<void()> on_ready;
+        void* sync = nullptr;
+        double submitted = 0;
+    };
+    void run();
+    void complete(job& done);
+
+    EGLDisplay display = nullptr;
+    EGLContext context = nullptr;
+    EGLSurface surface = nullptr;
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<job> pending;        // waiting for the worker
+    std::deque<job> flushed;        // fenced, waiting for the gpu
+    bool stopping = false;
+
+    uint64_t next_ticket = 1;
+    uint64_t last_completed = 0;
+
+    // worker time is what the render thread would otherwise have spent
+    latency_histogram worker_time {"upload worker"};
+    latency_histogram poll_time {"upload render-thread"};
+    latency_histogram job_latency {"upload submit-to-ready"};
+};
+
+#endif
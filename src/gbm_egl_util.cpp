@@ -1,4 +1,6 @@
 #include "gbm_egl_util.hpp"
+#include "gbm_egl_kernels.hpp"
+#include "gbm_egl_resources.hpp"
 #include <GLES2/gl2.h>
 #include <iostream>
 #include <memory.h>
@@ -159,34 +161,18 @@ void ESMatrix::ortho(float left, float right, float bottom, float top, float nea
 ESMatrix ESMatrix::multiply(const ESMatrix& srcA, const ESMatrix& srcB)
 {
     ESMatrix tmp;
-	for (int i=0; i<4; i++)
-	{
-		tmp.m[i][0] =	(srcA.m[i][0] * srcB.m[0][0]) +
-						(srcA.m[i][1] * srcB.m[1][0]) +
-						(srcA.m[i][2] * srcB.m[2][0]) +
-						(srcA.m[i][3] * srcB.m[3][0]) ;
-
-		tmp.m[i][1] =	(srcA.m[i][0] * srcB.m[0][1]) + 
-						(srcA.m[i][1] * srcB.m[1][1]) +
-						(srcA.m[i][2] * srcB.m[2][1]) +
-						(srcA.m[i][3] * srcB.m[3][1]) ;
-
-		tmp.m[i][2] =	(srcA.m[i][0] * srcB.m[0][2]) + 
-						(srcA.m[i][1] * srcB.m[1][2]) +
-						(srcA.m[i][2] * srcB.m[2][2]) +
-						(srcA.m[i][3] * srcB.m[3][2]) ;
-
-		tmp.m[i][3] =	(srcA.m[i][0] * srcB.m[0][3]) + 
-						(srcA.m[i][1] * srcB.m[1][3]) +
-						(srcA.m[i][2] * srcB.m[2][3]) +
-						(srcA.m[i][3] * srcB.m[3][3]) ;
-	}
-
+    kernels().mat4_multiply(&tmp.m[0][0], &srcA.m[0][0], &srcB.m[0][0], 1);
     return tmp;
 }
 
 
-uint create_program(const char* vs_src, const char* fs_src)
+void ESMatrix::multiply(const ESMatrix* srcA, const ESMatrix& srcB, ESMatrix* out, size_t count)
+{
+    kernels().mat4_multiply(&out[0].m[0][0], &srcA[0].m[0][0], &srcB.m[0][0], count);
+}
+
+
+uint create_program(const char* vs_src, const char* fs_src, const char* tag)
 {
 	GLint ret;
 
@@ -245,6 +231,7 @@ uint create_program(const char* vs_src, const char* fs_src)
 		return -1;
 	}
 
+    resource_created(resource_kind::program, uint64_t(program), 0, tag);
     return program;
 }
 
@@ -262,6 +249,7 @@ void destroy_program(uint program)
             glDetachShader(program, shader);
             glDeleteShader(shader);
         }
+        resource_destroyed(resource_kind::program, uint64_t(program));
         glDeleteProgram(program);
     }
 }
@@ -300,7 +288,44 @@ uint create_generic_program()
 		"    o_FragColor = texture(uTex, vTexCoord);\n"
 		"}                                  \n";
 
-    return create_program(vertex_shader_source, fragment_shader_source);
+    return create_program(vertex_shader_source, fragment_shader_source, "cube");
+}
+
+
+// like the generic program for plain 2d textures, e.g. post-processing results
+uint create_texture2d_program()
+{
+    static const char *vertex_shader_source =
+        "#version 300 es                      \n"
+		"uniform mat4 mvp;                    \n"
+		"                                     \n"
+		"in vec4 in_position;                 \n"
+		"in vec2 in_TexCoord;                 \n"
+		"                                     \n"
+		"out vec2 vTexCoord;                  \n"
+		"                                     \n"
+		"void main()                          \n"
+		"{                                    \n"
+		"    gl_Position = mvp * in_position; \n"
+		"    vTexCoord = in_TexCoord;         \n"
+		"}                                    \n";
+
+    static const char *fragment_shader_source =
+        "#version 300 es\n"
+		"precision mediump float;                       \n"
+		"                                               \n"
+		"uniform sampler2D uTex;                        \n"
+		"                                               \n"
+		"in vec2 vTexCoord;                             \n"
+		"                                               \n"
+		"out vec4 o_FragColor;                          \n"
+		"                                               \n"
+		"void main()                                    \n"
+		"{                                              \n"
+		"    o_FragColor = texture(uTex, vTexCoord);    \n"
+		"}                                              \n";
+
+    return create_program(vertex_shader_source, fragment_shader_source, "cube");
 }
 
 
@@ -344,7 +369,7 @@ uint create_z16_program()
         "    o_FragColor = vec4(depth);                       \n"
 		"}                                                    \n";
 
-    return create_program(vertex_shader_source, fragment_shader_source);
+    return create_program(vertex_shader_source, fragment_shader_source, "cube");
 }
 
 
@@ -443,6 +468,9 @@ void destroy_geometry(uint geometry)
 void draw_cube(uint cube_vbo)
 {
     glBindBuffer(GL_ARRAY_BUFFER, cube_vbo);
+    // meshes use other attribute formats, so set them on every draw
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)(intptr_t)(24 * 3 * sizeof(float)));
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	glDrawArrays(GL_TRIANGLE_STRIP, 4, 4);
 	glDrawArrays(GL_TRIANGLE_STRIP, 8, 4);
@@ -450,3 +478,22 @@ void draw_cube(uint cube_vbo)
 	glDrawArrays(GL_TRIANGLE_STRIP, 16, 4);
 	glDrawArrays(GL_TRIANGLE_STRIP, 20, 4);
 }
+
+
+void draw_barcode(uint32_t value, int x, int y, int width, int height)
+{
+    // a white and a black guard bar, then 32 bits msb first (white = 1)
+    const int bars = 2 + 32;
+    const int bar_width = width / bars;
+
+    glEnable(GL_SCISSOR_TEST);
+    for (int i = 0; i < bars; ++i)
+    {
+        const bool white = i < 2 ? i == 0 : (value >> (31 - (i - 2))) & 1;
+        const float c = white ? 1.0f : 0.0f;
+        glScissor(x + i * bar_width, y, bar_width, height);
+        glClearColor(c, c, c, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+}
@@ -2,6 +2,8 @@
 #define _gbm_egl_util_hpp__
 
 #include <sys/types.h>
+#include <stdint.h>
+#include <stddef.h>
 
 struct ESMatrix
 {
@@ -17,15 +19,20 @@ struct ESMatrix
     void ortho(float left, float right, float bottom, float top, float nearZ, float farZ);
     
     static ESMatrix multiply(const ESMatrix& srcA, const ESMatrix& srcB);
+    // out[i] = srcA[i] * srcB, out must not alias srcA
+    static void multiply(const ESMatrix* srcA, const ESMatrix& srcB, ESMatrix* out, size_t count);
 };
 
 
-uint create_program(const char* vs_src, const char* fs_src);
+// tag names the user in the resource accounting
+uint create_program(const char* vs_src, const char* fs_src, const char* tag = "program");
 void destroy_program(uint program);
 uint create_generic_program();
 uint create_z16_program();
+uint create_texture2d_program();
 uint create_geometry_cube();
 void destroy_geometry(uint geometry);
 void draw_cube(uint cube_vbo);
+void draw_barcode(uint32_t value, int x, int y, int width, int height);
 
 #endif
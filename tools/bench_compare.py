@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# compares two gbm-drm-gles-cube-bench results scenario by scenario and exits
+# with 1 when any of them got worse than the threshold allows:
+#
+#   tools/bench_compare.py baseline.json candidate.json [--threshold 5]
+#
+# throughput, the p50 and p99 of each pipeline stage, peak rss, cpu time and
+# color texture bytes sampled per frame are compared. stages with too few
+# samples in either run are left out, their tails are noise.
+import argparse
+import json
+import sys
+
+# (histogram, what it measures)
+STAGES = [
+    ("cpu update", "cpu update"),
+    ("cpu render", "cpu render"),
+    ("gpu frame", "gpu frame"),
+    ("gpu color cube", "gpu color cube"),
+    ("render-to-scanout", "render to done"),
+    ("glass-to-glass", "camera to done"),
+    ("upload submit-to-ready", "upload"),
+]
+MIN_SAMPLES = 100
+
+
+def metrics(scenario):
+    run = scenario.get("run")
+    if not run:
+        return None
+    frames = max(run.get("frames", 0), 1)
+    values = {
+        # name: (value, higher is better)
+        "fps": (run.get("fps", 0.0), True),
+        "peak rss MB": (scenario["peak_rss_kb"] / 1024.0, False),
+        "cpu ms/frame": ((scenario["cpu_user_ms"] + scenario["cpu_system_ms"]) / frames, False),
+    }
+    sampled = run.get("counters", {}).get("gbm_egl_color_sampled_bytes_total")
+    if sampled is not None:
+        values["color sampled MB/frame"] = (sampled / 1e6 / frames, False)
+    histograms = run.get("histograms_ms", {})
+    for key, label in STAGES:
+        histogram = histograms.get(key)
+        if not histogram or histogram["count"] < MIN_SAMPLES:
+            continue
+        values[label + " p50"] = (histogram["p50"], False)
+        values[label + " p99"] = (histogram["p99"], False)
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description="compare two gbm-drm-gles-cube-bench results")
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="percent a metric may get worse before it counts as a regression")
+    args = parser.parse_args()
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)["scenarios"]
+    with open(args.candidate) as f:
+        candidate = json.load(f)["scenarios"]
+
+    regressions = 0
+    for name in baseline:
+        if name not in candidate:
+            print("%s: missing from %s" % (name, args.candidate))
+            continue
+        before = metrics(baseline[name])
+        after = metrics(candidate[name])
+        if before is None or after is None:
+            print("%s: failed in %s" % (name, args.baseline if before is None else args.candidate))
+            regressions += after is None
+            continue
+
+        print(name)
+        for key, (old, higher_is_better) in before.items():
+            if key not in after:
+                continue
+            new = after[key][0]
+            change = (new - old) / old * 100.0 if old else 0.0
+            worse = -change if higher_is_better else change
+            flag = ""
+            if worse > args.threshold:
+                flag = "  REGRESSION"
+                regressions += 1
+            elif worse < -args.threshold:
+                flag = "  improved"
+            print("  %-24s %10.3f -> %10.3f  %+6.1f%%%s" % (key, old, new, change, flag))
+
+    if regressions:
+        print("%d regression%s over %.1f%%" % (regressions, "" if regressions == 1 else "s", args.threshold))
+        return 1
+    print("no regressions over %.1f%%" % args.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,266 @@
+// end-to-end pipeline benchmark without a display or a camera. every
+// scenario renders a fixed number of frames offscreen from generated (or
+// recorded) camera frames in a child process of its own, so options are read
+// fresh and peak rss is per scenario. the results go into one json file for
+// tools/bench_compare.py.
+#include "gbm_egl_device_interface.hpp"
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+struct scenario
+{
+    const char* name;
+    const char* description;
+    uint16_t width;
+    uint16_t height;
+    const char* env;            // NAME=value ..., on top of the bench defaults
+    bool single_core;
+};
+
+static const scenario scenarios[] = {
+    { "720p",           "default camera profile into 1280x720",         1280, 720,  "", false },
+    { "1080p",          "default camera profile into 1920x1080",        1920, 1080, "", false },
+    { "1080p-postfx",   "sharpen, depth edges and overlay at 1080p",    1920, 1080, "GBM_EGL_POSTFX=sharpen,edges,overlay", false },
+    { "postfx-uncached", "1080p-postfx with the filters run every frame", 1920, 1080, "GBM_EGL_POSTFX=sharpen,edges,overlay GBM_EGL_LAYER_CACHE=0", false },
+    { "preview",        "color preview pyramid",                        1280, 720,  "GBM_EGL_PREVIEW_PYRAMID=1", false },
+    { "preview-off",    "the preview scenario sampling full size",      1280, 720,  "GBM_EGL_PREVIEW_PYRAMID=0", false },
+    { "roi-decimate",   "color cropped to the centre, depth halved",    1280, 720,  "GBM_EGL_COLOR_ROI=480,270,960,540 GBM_EGL_DEPTH_DECIMATE=2", false },
+    { "static",         "the same camera frame over and over",          1280, 720,  "GBM_EGL_SOURCE=static", false },
+    { "static-tiles",   "static frames, only changed tiles written",    1280, 720,  "GBM_EGL_SOURCE=static GBM_EGL_DIRTY_TILES=1", false },
+    { "motion-tiles",   "moving frames, tiles hashed for nothing",      1280, 720,  "GBM_EGL_DIRTY_TILES=1", false },
+    { "single-core",    "one worker, the whole process on one cpu",     1280, 720,  "GBM_EGL_WORKERS=1", true },
+};
+
+
+static bool selected(const char* only, const char* name)
+{
+    if (!only)
+        return true;
+    const size_t length = strlen(name);
+    for (const char* p = only; (p = strstr(p, name)); p += length)
+    {
+        const bool starts = p == only || p[-1] == ',';
+        const bool ends = p[length] == 0 || p[length] == ',';
+        if (starts && ends)
+            return true;
+    }
+    return false;
+}
+
+
+static void run_child(const scenario& s, int frames, const char* source, const std::string& json, const std::string& log)
+{
+    char number[16];
+    snprintf(number, sizeof(number), "%d", frames);
+    setenv("GBM_EGL_PRESENT", "offscreen", 1);
+    setenv("GBM_EGL_SOURCE", source, 1);
+    setenv("GBM_EGL_FRAMES", number, 1);
+    setenv("GBM_EGL_BENCH_JSON", json.c_str(), 1);
+
+    std::string env = s.env;
+    for (char* pair = strtok(&env[0], " "); pair; pair = strtok(nullptr, " "))
+    {
+        char* value = strchr(pair, '=');
+        if (value)
+            *value++ = 0, setenv(pair, value, 1);
+    }
+
+    if (s.single_core)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(0, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    // the pipeline's own output would bury the summary
+    if (!freopen(log.c_str(), "w", stdout) || !freopen(log.c_str(), "a", stderr))
+        exit(2);
+
+    const bool ok = gbm_egl_device_interface::get_instance()->create(s.width, s.height);
+    fflush(stdout);
+    exit(ok ? 0 : 1);
+}
+
+
+static std::string read_file(const std::string& path)
+{
+    std::string text;
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file)
+        return text;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, n);
+    fclose(file);
+    return text;
+}
+
+
+// the fps, or 0, from the child's results
+static double json_fps(const std::string& json)
+{
+    const size_t at = json.find("\"fps\":");
+    return at == std::string::npos ? 0.0 : atof(json.c_str() + at + 6);
+}
+
+
+// a number in the child's results: "field" of the object "key", or the
+// value of "key" itself without a field. 0 when missing
+static double json_number(const std::string& json, const char* key, const char* field = nullptr)
+{
+    size_t at = json.find(std::string("\"") + key + "\": ");
+    if (at != std::string::npos && field)
+        at = json.find(std::string("\"") + field + "\": ", at);
+    if (at == std::string::npos)
+        return 0.0;
+    return atof(json.c_str() + json.find(": ", at) + 2);
+}
+
+
+// gpu time of the frame and of the color cube pass, and the color bytes
+// the cube sampled, per frame
+struct gpu_cost
+{
+    double frame_ms = 0;
+    double color_cube_ms = 0;
+    double sampled_mb = 0;
+};
+
+
+static gpu_cost json_gpu_cost(const std::string& json)
+{
+    gpu_cost cost;
+    cost.frame_ms = json_number(json, "gpu frame", "p50");
+    cost.color_cube_ms = json_number(json, "gpu color cube", "p50");
+    const double frames = json_number(json, "frames");
+    if (frames > 0)
+        cost.sampled_mb = json_number(json, "gbm_egl_color_sampled_bytes_total") / frames / 1e6;
+    return cost;
+}
+
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbm-drm-gles-cube-bench [--frames n] [--only name,..] [--source synthetic|static|<file.bag>] [--out results.json] [--list]\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    int frames = 600;
+    const char* only = nullptr;
+    const char* source = "synthetic";
+    const char* out = "bench.json";
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--frames") == 0 && has_value)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--only") == 0 && has_value)
+            only = argv[++i];
+        else if (strcmp(argv[i], "--source") == 0 && has_value)
+            source = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && has_value)
+            out = argv[++i];
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            for (const scenario& s : scenarios)
+                printf("%-14s %ux%u  %s\n", s.name, s.width, s.height, s.description);
+            return 0;
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (frames <= 0)
+    {
+        usage();
+        return 2;
+    }
+
+    FILE* results = fopen(out, "w");
+    if (!results)
+    {
+        fprintf(stderr, "failed to open %s: %s\n", out, strerror(errno));
+        return 1;
+    }
+    fprintf(results, "{\n\"frames\": %d,\n\"source\": \"%s\",\n\"scenarios\": {", frames, source);
+
+    int failed = 0;
+    const char* separator = "\n";
+    gpu_cost preview_on, preview_off;
+    int preview_runs = 0;
+    for (const scenario& s : scenarios)
+    {
+        if (!selected(only, s.name))
+            continue;
+
+        const std::string json = std::string(out) + "." + s.name + ".run.json";
+        const std::string log = std::string(out) + "." + s.name + ".log";
+        remove(json.c_str());
+        printf("%-14s %ux%u, %d frames ... ", s.name, s.width, s.height, frames);
+        // the child would write out whatever is still buffered on exit
+        fflush(stdout);
+        fflush(results);
+
+        const pid_t pid = fork();
+        if (pid == 0)
+            run_child(s, frames, source, json, log);
+        int status = 0;
+        rusage usage = {};
+        if (pid < 0 || wait4(pid, &status, 0, &usage) != pid)
+        {
+            fprintf(stderr, "failed to run %s: %s\n", s.name, strerror(errno));
+            return 1;
+        }
+
+        const bool exited = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        const std::string run = read_file(json);
+        const double user_ms = usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0;
+        const double system_ms = usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+        if (exited && !run.empty())
+        {
+            const gpu_cost cost = json_gpu_cost(run);
+            printf("%7.1f fps, peak rss %ld MB, cpu %.0f ms, gpu p50 %.3f ms, color cube %.3f ms, sampled %.2f MB/frame\n",
+                   json_fps(run), usage.ru_maxrss / 1024, user_ms + system_ms,
+                   cost.frame_ms, cost.color_cube_ms, cost.sampled_mb);
+            if (strcmp(s.name, "preview") == 0)
+                preview_on = cost, preview_runs |= 1;
+            else if (strcmp(s.name, "preview-off") == 0)
+                preview_off = cost, preview_runs |= 2;
+        }
+        else
+            printf("failed, see %s\n", log.c_str()), ++failed;
+
+        fprintf(results, "%s\"%s\": {\n\"description\": \"%s\",\n\"width\": %u,\n\"height\": %u,\n\"env\": \"%s\",\n"
+                         "\"status\": %d,\n\"peak_rss_kb\": %ld,\n\"cpu_user_ms\": %.1f,\n\"cpu_system_ms\": %.1f,\n\"run\": %s\n}",
+                         separator, s.name, s.description, s.width, s.height, s.env,
+                         WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status),
+                         usage.ru_maxrss, user_ms, system_ms, run.empty() ? "null" : run.c_str());
+        separator = ",\n";
+        remove(json.c_str());
+    }
+
+    // what the pyramid saves, the gpu numbers are 0 without timer queries
+    if (preview_runs == 3)
+        printf("preview pyramid on vs off: gpu p50 %.3f vs %.3f ms, color cube %.3f vs %.3f ms, sampled %.2f vs %.2f MB/frame\n",
+               preview_on.frame_ms, preview_off.frame_ms, preview_on.color_cube_ms, preview_off.color_cube_ms,
+               preview_on.sampled_mb, preview_off.sampled_mb);
+
+    fprintf(results, "\n}\n}\n");
+    fclose(results);
+    printf("results written to %s\n", out);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+// cost of dirty tile tracking on the camera copy: a 1920x1080 yuyv frame
+// copied whole, against hashed in 64x16 tiles with only the changed ones
+// copied. a still scene, one where a bar sweeps across, and one where
+// sensor noise touches every tile, for each kernel variant.
+// every variant has to hash like the scalar one, and a change has to show,
+// or the run fails.
+#include "gbm_egl_task_pool.hpp"
+#include "gbm_egl_kernels.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <vector>
+
+static const int width = 1920;
+static const int height = 1080;
+static const size_t stride = width * 2;
+static const int tile_width = 64;
+static const int tile_height = 16;
+static const int tiles_x = width / tile_width;
+static const int tiles_y = (height + tile_height - 1) / tile_height;
+
+static double now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+static void copy_whole(task_pool& pool, const kernel_table& table, uint8_t* dst, const uint8_t* src)
+{
+    pool.parallel_rows(height, [&](int first, int last){
+        table.copy(dst + first * stride, src + first * stride, (last - first) * stride);
+    });
+}
+
+
+// same scheme as update_texture, without the refresh row: tiles hashed,
+// runs of changed ones copied one row span at a time
+static int copy_tiles(task_pool& pool, const kernel_table& table, uint8_t* dst, const uint8_t* src, std::vector<uint64_t>& hashes)
+{
+    std::atomic<int> written {0};
+    pool.parallel_rows(tiles_y, [&](int first, int last){
+        int count = 0;
+        bool dirty[tiles_x];
+        for (int ty = first; ty < last; ++ty)
+        {
+            const int y0 = ty * tile_height;
+            const int rows = std::min(tile_height, height - y0);
+            for (int tx = 0; tx < tiles_x; ++tx)
+            {
+                const uint64_t hash = tile_hash(src + y0 * stride + tx * tile_width * 2, stride, tile_width * 2, rows, table);
+                dirty[tx] = hash != hashes[ty * tiles_x + tx];
+                hashes[ty * tiles_x + tx] = hash;
+            }
+            for (int tx = 0; tx < tiles_x; )
+            {
+                if (!dirty[tx])
+                {
+                    ++tx;
+                    continue;
+                }
+                int end = tx;
+                while (end < tiles_x && dirty[end])
+                    ++end;
+                const size_t offset = y0 * stride + tx * tile_width * 2;
+                for (int y = 0; y < rows; ++y)
+                    table.copy(dst + offset + y * stride, src + offset + y * stride, (end - tx) * tile_width * 2);
+                count += end - tx;
+                tx = end;
+            }
+        }
+        written += count;
+    });
+    return written;
+}
+
+
+static void make_frames(std::vector<std::vector<uint8_t>>& frames, const char* scene)
+{
+    for (size_t f = 0; f < frames.size(); ++f)
+    {
+        std::vector<uint8_t>& frame = frames[f];
+        frame.resize(stride * height);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                uint8_t v = uint8_t((x + y) / 12);
+                if (strcmp(scene, "sweep") == 0 && x >= int(f) * 120 && x < int(f) * 120 + 120)
+                    v = 235;
+                else if (strcmp(scene, "noise") == 0)
+                    v += rand() & 1;
+                frame[y * stride + x * 2] = v;
+                frame[y * stride + x * 2 + 1] = 128;
+            }
+        }
+    }
+}
+
+
+// the hashes of every tile of a frame
+static std::vector<uint64_t> frame_hashes(const kernel_table& table, const uint8_t* src)
+{
+    std::vector<uint64_t> hashes;
+    for (int ty = 0; ty < tiles_y; ++ty)
+    {
+        const int y0 = ty * tile_height;
+        for (int tx = 0; tx < tiles_x; ++tx)
+            hashes.push_back(tile_hash(src + y0 * stride + tx * tile_width * 2, stride, tile_width * 2,
+                                       std::min(tile_height, height - y0), table));
+    }
+    return hashes;
+}
+
+
+static bool check_hashes(const kernel_table& table, const std::vector<std::vector<uint8_t>>& frames, const char* scene)
+{
+    bool ok = true;
+    for (size_t f = 0; f < frames.size(); ++f)
+    {
+        if (frame_hashes(table, frames[f].data()) != frame_hashes(*kernels_scalar(), frames[f].data()))
+        {
+            printf("  %-6s %-7s frame %zu hashes differ from scalar\n", scene, table.name, f);
+            ok = false;
+        }
+    }
+
+    // the top bit of two v bytes that land in the same lane, 64 bytes apart
+    std::vector<uint8_t> flipped = frames[0];
+    flipped[3] ^= 0x80;
+    flipped[3 + 64] ^= 0x80;
+    if (frame_hashes(table, flipped.data())[0] == frame_hashes(table, frames[0].data())[0])
+    {
+        printf("  %-6s %-7s two flips of bit 31 in one lane cancel\n", scene, table.name);
+        ok = false;
+    }
+    return ok;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    task_pool pool;
+    pool.start(argc > 2 ? atoi(argv[2]) : 0);
+    std::vector<uint8_t> dst(stride * height);
+    printf("%dx%d yuyv, %d tiles of %dx%d, %d cores\n", width, height, tiles_x * tiles_y, tile_width, tile_height, pool.size());
+
+    bool ok = true;
+    for (const char* scene : { "still", "sweep", "noise" })
+    {
+        std::vector<std::vector<uint8_t>> frames(16);
+        make_frames(frames, scene);
+
+        for (const kernel_table* table : { kernels_scalar(), kernels_neon(), kernels_sse41(), kernels_avx2() })
+        {
+            // only what this cpu runs: the best variant and everything below it
+            if (!table || (table != kernels_scalar() && table != &kernels() &&
+                !(table == kernels_sse41() && &kernels() == kernels_avx2())))
+                continue;
+
+            ok &= check_hashes(*table, frames, scene);
+
+            double start = now_ms();
+            for (int i = 0; i < iterations; ++i)
+                copy_whole(pool, *table, dst.data(), frames[i % frames.size()].data());
+            const double whole = (now_ms() - start) / iterations;
+
+            std::vector<uint64_t> hashes(tiles_x * tiles_y, 0);
+            copy_tiles(pool, *table, dst.data(), frames[0].data(), hashes);
+            long tiles = 0;
+            start = now_ms();
+            for (int i = 1; i <= iterations; ++i)
+                tiles += copy_tiles(pool, *table, dst.data(), frames[i % frames.size()].data(), hashes);
+            const double tracked = (now_ms() - start) / iterations;
+
+            printf("  %-6s %-7s whole %6.3f ms  tiles %6.3f ms  %5.1f%% of tiles copied  %+6.1f%%\n",
+                   scene, table->name, whole, tracked, 100.0 * tiles / iterations / (tiles_x * tiles_y),
+                   (tracked - whole) / whole * 100.0);
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+// load time and memory of the binary mesh format against parsing the source
+// model, with a generated sphere when no model is given
+#include "gbm_egl_mesh_format.hpp"
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+static double now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+static bool write_sphere_obj(const char* path, int rings, int segments)
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+        return false;
+
+    for (int r = 0; r <= rings; ++r)
+    {
+        const float theta = M_PI * r / rings;
+        for (int s = 0; s <= segments; ++s)
+        {
+            const float phi = 2.0f * M_PI * s / segments;
+            fprintf(file, "v %f %f %f\n", sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            fprintf(file, "vt %f %f\n", float(s) / segments, float(r) / rings);
+        }
+    }
+
+    // shuffled, as exporters rarely write triangles in a cache friendly order
+    std::vector<int> quads(rings * segments);
+    for (size_t i = 0; i < quads.size(); ++i)
+        quads[i] = i;
+    std::shuffle(quads.begin(), quads.end(), std::mt19937(1));
+    for (int quad : quads)
+    {
+        const int r = quad / segments, s = quad % segments;
+        const int a = r * (segments + 1) + s + 1, b = a + segments + 1;
+        fprintf(file, "f %d/%d %d/%d %d/%d\n", a, a, b, b, a + 1, a + 1);
+        fprintf(file, "f %d/%d %d/%d %d/%d\n", a + 1, a + 1, b, b, b + 1, b + 1);
+    }
+    return fclose(file) == 0;
+}
+
+
+// maps the file and reads every byte, as glBufferData does from the mapping
+static double map_and_read(const char* path, bool cold)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (cold)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    const double start = now_ms();
+    struct stat st;
+    fstat(fd, &st);
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return -1;
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+    double elapsed = -1;
+    if (const mesh_file_header* header = validate_mesh_file(data, st.st_size))
+    {
+        volatile uint64_t sum = 0;
+        const uint64_t* words = (const uint64_t*)data;
+        for (size_t i = 0; i < size_t(st.st_size) / 8; ++i)
+            sum += words[i];
+        (void)header;
+        elapsed = now_ms() - start;
+    }
+    munmap(data, st.st_size);
+    return elapsed;
+}
+
+
+int main(int argc, char* argv[])
+{
+    std::string model = argc > 1 ? argv[1] : "/tmp/gbm-egl-mesh-bench.obj";
+    if (argc < 2)
+    {
+        std::cout << "generating " << model << std::endl;
+        if (!write_sphere_obj(model.c_str(), 500, 1000))
+            return 1;
+    }
+    const std::string mesh_path = model + ".gmsh";
+
+    mesh_source source;
+    double start = now_ms();
+    const bool is_ply = model.size() > 4 && strcasecmp(model.c_str() + model.size() - 4, ".ply") == 0;
+    if (!(is_ply ? read_ply(model.c_str(), source) : read_obj(model.c_str(), source)))
+        return 1;
+    const double parse_ms = now_ms() - start;
+
+    const size_t vertices = source.positions.size() / 3;
+    const size_t unpacked = vertices * (3 + 2) * sizeof(float) + source.indices.size() * sizeof(uint32_t);
+
+    mesh_build_info info;
+    start = now_ms();
+    if (!write_mesh_file(mesh_path.c_str(), source, &info))
+        return 1;
+    const double convert_ms = now_ms() - start;
+
+    source = mesh_source();
+    const double cold_ms = map_and_read(mesh_path.c_str(), true);
+    const double warm_ms = map_and_read(mesh_path.c_str(), false);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("model             %s\n", model.c_str());
+    printf("triangles         %u\n", info.triangle_count);
+    printf("vertices          %u\n", info.vertex_count);
+    printf("parse source      %.1f ms\n", parse_ms);
+    printf("convert           %.1f ms\n", convert_ms);
+    printf("map+read cold     %.1f ms\n", cold_ms);
+    printf("map+read warm     %.1f ms\n", warm_ms);
+    printf("float layout      %zu bytes (%.1f per triangle)\n", unpacked, double(unpacked) / info.triangle_count);
+    printf("mesh file         %zu bytes (%.1f per triangle, %.0f%%)\n", info.file_size,
+           double(info.file_size) / info.triangle_count, 100.0 * info.file_size / unpacked);
+    printf("acmr (fifo 16)    %.3f -> %.3f\n", info.acmr_before, info.acmr_after);
+    printf("peak rss          %ld KiB\n", usage.ru_maxrss);
+    return 0;
+}
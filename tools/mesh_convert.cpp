@@ -0,0 +1,39 @@
+// converts an OBJ or PLY model into the binary mesh format loaded by GBM_EGL_MESH
+#include "gbm_egl_mesh_format.hpp"
+#include <string.h>
+#include <iostream>
+
+static bool ends_with(const char* s, const char* suffix)
+{
+    const size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcasecmp(s + n - m, suffix) == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::cerr << "usage: " << argv[0] << " <model.obj|model.ply> <out.gmsh>" << std::endl;
+        return 1;
+    }
+
+    mesh_source source;
+    bool ok = false;
+    if (ends_with(argv[1], ".obj"))
+        ok = read_obj(argv[1], source);
+    else if (ends_with(argv[1], ".ply"))
+        ok = read_ply(argv[1], source);
+    else
+        std::cerr << "unknown model format: " << argv[1] << std::endl;
+    if (!ok)
+        return 1;
+
+    mesh_build_info info;
+    if (!write_mesh_file(argv[2], source, &info))
+        return 1;
+
+    std::cout << argv[2] << ": " << info.triangle_count << " triangles, " << info.vertex_count << " vertices, "
+              << info.file_size << " bytes, acmr " << info.acmr_before << " -> " << info.acmr_after << std::endl;
+    return 0;
+}
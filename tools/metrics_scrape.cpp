@@ -0,0 +1,344 @@
+// scrapes the metrics endpoint and checks the text exposition format: a
+// HELP and a TYPE line before each family, samples only of the family they
+// follow, counters named _total with integer values, summaries with their
+// quantiles in order and _sum and _count, histograms with cumulative le
+// buckets ending in +Inf. without an address it serves a few metrics of its
+// own on a unix socket, checks their values came through and scrapes that;
+// given one (unix:<path> or a port) it checks a running pipeline.
+#include "gbm_egl_metrics.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> errors;
+
+static void fail(int line, const std::string& what)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "line %d: ", line);
+    errors.push_back(text + what);
+}
+
+
+static std::string scrape(const char* address)
+{
+    int fd = -1;
+    if (strncmp(address, "unix:", 5) == 0)
+    {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", address + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+            close(fd), fd = -1;
+    }
+    else
+    {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(address));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+            close(fd), fd = -1;
+    }
+    if (fd < 0)
+    {
+        fprintf(stderr, "cannot connect to %s\n", address);
+        return std::string();
+    }
+
+    const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL);
+    std::string response;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+        response.append(buffer, n);
+    close(fd);
+    return response;
+}
+
+
+// the body of a complete 200 response, empty otherwise
+static std::string body_of(const std::string& response)
+{
+    const size_t end = response.find("\r\n\r\n");
+    if (response.compare(0, 15, "HTTP/1.0 200 OK") != 0 || end == std::string::npos)
+    {
+        errors.push_back("not a 200 response");
+        return std::string();
+    }
+    const std::string header = response.substr(0, end);
+    const std::string body = response.substr(end + 4);
+    if (header.find("Content-Type: text/plain; version=0.0.4") == std::string::npos)
+        errors.push_back("content type is not text/plain; version=0.0.4");
+    const size_t length = header.find("Content-Length: ");
+    if (length == std::string::npos || strtoull(header.c_str() + length + 16, nullptr, 10) != body.size())
+        errors.push_back("content length does not match the body");
+    return body;
+}
+
+
+static bool valid_name(const std::string& name)
+{
+    if (name.empty() || isdigit((unsigned char)name[0]))
+        return false;
+    for (char c : name)
+    {
+        if (!isalnum((unsigned char)c) && c != '_' && c != ':')
+            return false;
+    }
+    return true;
+}
+
+
+static bool ends_with(const std::string& text, const char* suffix)
+{
+    const size_t n = strlen(suffix);
+    return text.size() >= n && text.compare(text.size() - n, n, suffix) == 0;
+}
+
+
+struct sample
+{
+    std::string name;
+    std::string label;      // quantile or le, the only labels used
+    std::string label_value;
+    double value = 0;
+};
+
+
+static bool parse_sample(const std::string& line, sample& out)
+{
+    const size_t brace = line.find('{');
+    const size_t space = line.rfind(' ');
+    if (space == std::string::npos)
+        return false;
+    out.name = line.substr(0, std::min(brace, space));
+    if (brace != std::string::npos && brace < space)
+    {
+        const size_t equals = line.find("=\"", brace);
+        const size_t close = line.find("\"}", brace);
+        if (equals == std::string::npos || close == std::string::npos || close + 2 != space)
+            return false;
+        out.label = line.substr(brace + 1, equals - brace - 1);
+        out.label_value = line.substr(equals + 2, close - equals - 2);
+    }
+    const std::string value = line.substr(space + 1);
+    char* end = nullptr;
+    out.value = strtod(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+
+
+struct family
+{
+    std::string name;
+    std::string type;
+    int line = 0;
+    int samples = 0;
+    // summary and histogram state
+    double last_bound = -INFINITY;
+    double last_value = -INFINITY;
+    double bucket_total = NAN;
+    bool has_sum = false;
+    bool has_count = false;
+    double count = NAN;
+};
+
+
+static void finish(const family& f)
+{
+    if (f.name.empty())
+        return;
+    if (!f.samples)
+        fail(f.line, f.name + " has no samples");
+    if ((f.type == "summary" || f.type == "histogram") && (!f.has_sum || !f.has_count))
+        fail(f.line, f.name + " lacks _sum or _count");
+    if (f.type == "histogram" && f.bucket_total != f.count)
+        fail(f.line, f.name + " +Inf bucket does not match _count");
+}
+
+
+static void check_sample(family& f, const sample& s, int number)
+{
+    ++f.samples;
+    if (f.type == "counter" || f.type == "gauge")
+    {
+        if (s.name != f.name || !s.label.empty())
+            fail(number, s.name + " does not belong to " + f.name);
+        else if (f.type == "counter" && (s.value < 0 || s.value != floor(s.value)))
+            fail(number, f.name + " is not a count");
+        return;
+    }
+
+    if (s.name == f.name + "_sum")
+        f.has_sum = true;
+    else if (s.name == f.name + "_count")
+        f.has_count = true, f.count = s.value;
+    else if (f.type == "summary" && s.name == f.name && s.label == "quantile")
+    {
+        const double q = atof(s.label_value.c_str());
+        if (q <= 0 || q > 1 || q <= f.last_bound)
+            fail(number, "quantile " + s.label_value + " out of order");
+        // an empty summary reports NaN for all of them
+        if (!isnan(s.value) && s.value < f.last_value)
+            fail(number, "quantile " + s.label_value + " below the one before");
+        f.last_bound = q;
+        if (!isnan(s.value))
+            f.last_value = s.value;
+    }
+    else if (f.type == "histogram" && s.name == f.name + "_bucket" && s.label == "le")
+    {
+        const double le = s.label_value == "+Inf" ? INFINITY : atof(s.label_value.c_str());
+        if (le <= f.last_bound)
+            fail(number, "bucket le=" + s.label_value + " out of order");
+        if (s.value < f.last_value)
+            fail(number, "bucket le=" + s.label_value + " is not cumulative");
+        f.last_bound = le;
+        f.last_value = s.value;
+        if (isinf(le))
+            f.bucket_total = s.value;
+    }
+    else
+        fail(number, s.name + " does not belong to " + f.type + " " + f.name);
+
+    if (f.has_count && f.count != floor(f.count))
+        fail(number, f.name + "_count is not a count");
+}
+
+
+// every family, with its samples by series name
+static std::map<std::string, std::map<std::string, double>> validate(const std::string& text)
+{
+    std::map<std::string, std::map<std::string, double>> families;
+    if (text.empty() || text.back() != '\n')
+        errors.push_back("exposition does not end with a newline");
+
+    std::set<std::string> seen;
+    family current;
+    std::string help_of;
+    std::istringstream lines(text);
+    std::string line;
+    for (int number = 1; std::getline(lines, line); ++number)
+    {
+        if (line.compare(0, 7, "# HELP ") == 0)
+        {
+            finish(current);
+            current = family();
+            const std::string name = line.substr(7, line.find(' ', 7) - 7);
+            if (!valid_name(name) || line.size() <= 8 + name.size())
+                fail(number, "bad HELP line");
+            if (!seen.insert(name).second)
+                fail(number, name + " declared twice");
+            help_of = name;
+            current.line = number;
+            continue;
+        }
+        if (line.compare(0, 7, "# TYPE ") == 0)
+        {
+            std::istringstream words(line.substr(7));
+            std::string name, type;
+            words >> name >> type;
+            if (name != help_of)
+                fail(number, "TYPE of " + name + " does not follow its HELP");
+            if (type != "counter" && type != "gauge" && type != "summary" && type != "histogram")
+                fail(number, "unknown type " + type);
+            if (type == "counter" && !ends_with(name, "_total"))
+                fail(number, "counter " + name + " does not end in _total");
+            if ((type == "summary" || type == "histogram") && !ends_with(name, "_seconds"))
+                fail(number, type + " " + name + " is not in seconds");
+            current.name = name;
+            current.type = type;
+            help_of.clear();
+            continue;
+        }
+        if (line.empty() || line[0] == '#')
+        {
+            fail(number, "unexpected line \"" + line + "\"");
+            continue;
+        }
+
+        sample s;
+        if (!parse_sample(line, s) || !valid_name(s.name))
+        {
+            fail(number, "cannot read sample \"" + line + "\"");
+            continue;
+        }
+        if (current.type.empty())
+        {
+            fail(number, s.name + " before any TYPE");
+            continue;
+        }
+        check_sample(current, s, number);
+        families[current.name][s.label.empty() ? s.name : s.name + "{" + s.label_value + "}"] = s.value;
+    }
+    finish(current);
+    return families;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const bool own = argc < 2;
+    char address[108];
+    if (own)
+        snprintf(address, sizeof(address), "unix:/tmp/gbm-egl-metrics-scrape-%d.sock", int(getpid()));
+    else
+        snprintf(address, sizeof(address), "%s", argv[1]);
+
+    // a bit of each kind, an empty histogram among them
+    latency_histogram latency("scrape check");
+    latency_histogram idle("scrape idle");
+    if (own)
+    {
+        metrics_counter("gbm_egl_scrape_checks_total", "Scrape checks run.").add(3);
+        metrics_gauge("gbm_egl_scrape_depth", "A gauge below zero.").set(-5);
+        for (int i = 1; i <= 100; ++i)
+            latency.record(i * 0.5);
+        metrics_histogram(latency);
+        metrics_histogram(idle);
+        if (!metrics_init(address))
+            return 1;
+    }
+
+    const std::string body = body_of(scrape(address));
+    const auto families = validate(body);
+    if (own)
+    {
+        auto expect = [&](const char* family, const char* series, double value){
+            auto f = families.find(family);
+            auto s = f != families.end() ? f->second.find(series) : decltype(f->second.end())();
+            if (f == families.end() || s == f->second.end())
+                errors.push_back(std::string(series) + " missing");
+            else if (fabs(s->second - value) > 1e-9 && !(isnan(value) && isnan(s->second)))
+                errors.push_back(std::string(series) + " is " + std::to_string(s->second) + ", expected " + std::to_string(value));
+        };
+        expect("gbm_egl_scrape_checks_total", "gbm_egl_scrape_checks_total", 3);
+        expect("gbm_egl_scrape_depth", "gbm_egl_scrape_depth", -5);
+        expect("gbm_egl_scrape_check_seconds", "gbm_egl_scrape_check_seconds_count", 100);
+        expect("gbm_egl_scrape_check_seconds", "gbm_egl_scrape_check_seconds_sum", latency.mean() * 100 / 1000.0);
+        expect("gbm_egl_scrape_idle_seconds", "gbm_egl_scrape_idle_seconds{0.5}", NAN);
+        expect("gbm_egl_scrape_idle_seconds", "gbm_egl_scrape_idle_seconds_count", 0);
+        metrics_shutdown();
+    }
+
+    size_t samples = 0;
+    for (const auto& f : families)
+        samples += f.second.size();
+    for (const std::string& error : errors)
+        fprintf(stderr, "%s\n", error.c_str());
+    printf("%s: %zu families, %zu samples, %zu errors\n", address, families.size(), samples, errors.size());
+    return errors.empty() ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+// replays the display mode and primary plane selection on tables dumped
+// with GBM_EGL_MODES_DUMP (plus plane records), no drm needed. each table
+// carries its expectations as comments:
+//
+//   # expect 1920x1080@60 -> connector 77 mode 2 crtc 51 plane 31
+//   # expect 1280x720 scaling -> connector 77 mode 0 crtc 51 plane 31 scaled
+//   # expect 0x0 -> connector 77 mode 0 crtc 51 plane 31
+//   # expect 800x600 -> none
+//
+// the size is what the application asks for, 0x0 takes the preferred mode,
+// @hz asks for a refresh rate. every expectation of every table is checked
+// and the exit status is 1 if any of them does not hold.
+#include "gbm_egl_modeset.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+struct expectation
+{
+    mode_policy policy;
+    bool none = false;
+    uint32_t connector_id = 0;
+    int mode = -1;
+    uint32_t crtc_id = 0;
+    uint32_t plane_id = 0;
+    bool scaled = false;
+};
+
+
+// "1920x1080@60 scaling -> connector 77 mode 2 crtc 51 plane 31 [scaled]"
+static bool parse_expectation(const std::string& text, expectation& out)
+{
+    const size_t arrow = text.find("->");
+    if (arrow == std::string::npos)
+        return false;
+
+    std::istringstream request(text.substr(0, arrow));
+    std::string size, word;
+    if (!(request >> size))
+        return false;
+    unsigned width = 0, height = 0, hz = 0;
+    if (sscanf(size.c_str(), "%ux%u@%u", &width, &height, &hz) < 2)
+        return false;
+    out.policy.width = uint16_t(width);
+    out.policy.height = uint16_t(height);
+    out.policy.refresh_hz = hz;
+    while (request >> word)
+    {
+        if (word != "scaling")
+            return false;
+        out.policy.allow_scaling = true;
+    }
+
+    std::istringstream result(text.substr(arrow + 2));
+    if (!(result >> word))
+        return false;
+    if (word == "none")
+        return out.none = true;
+    std::string mode, crtc, plane;
+    if (word != "connector" || !(result >> out.connector_id >> mode >> out.mode >> crtc >> out.crtc_id >> plane >> out.plane_id) ||
+        mode != "mode" || crtc != "crtc" || plane != "plane")
+        return false;
+    if (result >> word)
+    {
+        if (word != "scaled")
+            return false;
+        out.scaled = true;
+    }
+    return true;
+}
+
+
+static std::string describe(const display_table& table, const mode_selection& selection, uint32_t plane_id)
+{
+    const display_connector& connector = table.connectors[selection.connector];
+    const display_mode& mode = connector.modes[selection.mode];
+    char text[160];
+    snprintf(text, sizeof(text), "connector %u mode %d (%ux%u@%.2f) crtc %u plane %u%s",
+             connector.connector_id, selection.mode, mode.hdisplay, mode.vdisplay,
+             mode.refresh_mhz() / 1000.0, selection.crtc_id, plane_id, selection.scaled ? " scaled" : "");
+    return text;
+}
+
+
+static int replay(const char* path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+
+    display_table table;
+    if (!parse_display_table(text.str(), table))
+    {
+        fprintf(stderr, "%s: not a display table\n", path);
+        return 1;
+    }
+
+    int failed = 0, checked = 0;
+    std::istringstream lines(text.str());
+    std::string line;
+    for (int number = 1; std::getline(lines, line); ++number)
+    {
+        const size_t at = line.find("# expect ");
+        if (at != 0)
+            continue;
+
+        expectation expected;
+        if (!parse_expectation(line.substr(9), expected))
+        {
+            fprintf(stderr, "%s:%d: cannot read expectation\n", path, number);
+            ++failed;
+            continue;
+        }
+
+        ++checked;
+        mode_selection selection;
+        const bool found = select_display_mode(table, expected.policy, selection);
+        const uint32_t plane_id = found ? select_primary_plane(table, selection.crtc_index) : 0;
+        const bool ok = found ? !expected.none &&
+                                table.connectors[selection.connector].connector_id == expected.connector_id &&
+                                selection.mode == expected.mode && selection.crtc_id == expected.crtc_id &&
+                                plane_id == expected.plane_id && selection.scaled == expected.scaled
+                              : expected.none;
+        const std::string got = found ? describe(table, selection, plane_id) : "none";
+        printf("%s:%d: %s -> %s%s\n", path, number, line.substr(9, line.find("->") - 10).c_str(),
+               got.c_str(), ok ? "" : "  MISMATCH");
+        failed += !ok;
+    }
+
+    if (!checked)
+        fprintf(stderr, "%s: no expectations\n", path);
+    return failed || !checked ? 1 : 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: gbm-egl-modeset-replay <table> ..\n");
+        return 2;
+    }
+
+    int failed = 0;
+    for (int i = 1; i < argc; ++i)
+        failed += replay(argv[i]);
+    printf("%d of %d tables as expected\n", argc - 1 - failed, argc - 1);
+    return failed ? 1 : 0;
+}
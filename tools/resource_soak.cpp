@@ -0,0 +1,170 @@
+// reconfiguration soak without a display or a camera: generated frames
+// through every stream profile in turn with postfx, the preview pyramid and
+// the governor on, for a day by default. the live resources are sampled
+// throughout and the run fails when any kind keeps growing, the kind of
+// leak a short run does not show.
+#include "gbm_egl_device_interface.hpp"
+#include "gbm_egl_metrics.hpp"
+#include "gbm_egl_resources.hpp"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const int windows = 4;
+static const char* soak_profiles = "1920x1080+1280x720@30,1280x720+640x480@30,640x480@60";
+static const int soak_profile_count = 3;
+
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbm-egl-resource-soak [--seconds n] [--cycle seconds] [--interval seconds]\n");
+}
+
+
+// the lowest value of each window after the warmup, what a window cannot
+// drop below is what it leaked
+static std::vector<uint64_t> window_floors(const std::vector<uint64_t>& values, size_t warmup)
+{
+    std::vector<uint64_t> floors;
+    const size_t span = (values.size() - warmup) / windows;
+    for (int w = 0; w < windows; ++w)
+    {
+        const auto first = values.begin() + warmup + w * span;
+        floors.push_back(*std::min_element(first, first + span));
+    }
+    return floors;
+}
+
+
+// never shrinking from one window to the next and larger at the end
+static bool growing(const std::vector<uint64_t>& floors)
+{
+    for (size_t w = 1; w < floors.size(); ++w)
+    {
+        if (floors[w] < floors[w - 1])
+            return false;
+    }
+    return floors.back() > floors.front();
+}
+
+
+int main(int argc, char* argv[])
+{
+    int seconds = 24 * 60 * 60;
+    int cycle = 2;
+    int interval = 10;
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--seconds") == 0 && has_value)
+            seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cycle") == 0 && has_value)
+            cycle = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--interval") == 0 && has_value)
+            interval = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (seconds <= 0 || cycle <= 0 || interval <= 0)
+    {
+        usage();
+        return 2;
+    }
+
+    // the soak setup, anything set in the environment already wins
+    char number[16];
+    snprintf(number, sizeof(number), "%d", cycle);
+    setenv("GBM_EGL_PRESENT", "offscreen", 0);
+    setenv("GBM_EGL_SOURCE", "synthetic", 0);
+    setenv("GBM_EGL_PROFILES", soak_profiles, 0);
+    setenv("GBM_EGL_PROFILE_CYCLE", number, 0);
+    setenv("GBM_EGL_POSTFX", "sharpen,edges,overlay", 0);
+    setenv("GBM_EGL_PREVIEW_PYRAMID", "1", 0);
+    setenv("GBM_EGL_GOVERNOR", "1", 0);
+
+    // the clock starts with the first frame, SIGINT ends the render loop
+    // like Ctrl+C does
+    std::vector<std::vector<resource_usage>> samples;
+    std::atomic_bool done {false};
+    std::thread sampler([&](){
+        const metric_counter& rendered = metrics_counter("gbm_egl_frames_rendered_total", "Frames rendered.");
+        while (!done && rendered.value == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const auto start = std::chrono::steady_clock::now();
+        const auto end = start + std::chrono::seconds(seconds);
+        auto next = start;
+        while (!done && next < end)
+        {
+            samples.push_back(resources_snapshot());
+            next += std::chrono::seconds(interval);
+            std::this_thread::sleep_until(std::min(next, end));
+        }
+        if (!done)
+            kill(getpid(), SIGINT);
+    });
+
+    printf("soak for %d s, profiles %s switched every %d s, sampled every %d s\n",
+           seconds, soak_profiles, cycle, interval);
+    fflush(stdout);
+    const bool ok = gbm_egl_device_interface::get_instance()->create(1280, 720);
+    done = true;
+    sampler.join();
+    if (!ok)
+    {
+        fprintf(stderr, "the pipeline did not come up\n");
+        return 1;
+    }
+
+    // every profile twice before anything counts, pools fill up over that
+    const size_t warmup = std::max(samples.size() / 10, size_t(2 * soak_profile_count * cycle / interval + 1));
+    if (samples.size() < warmup + windows)
+    {
+        fprintf(stderr, "%zu samples, too few to judge growth, run longer or sample more often\n", samples.size());
+        return 2;
+    }
+
+    int grown = 0;
+    printf("\n%-8s %-6s %s\n", "kind", "", "floor per window after warmup");
+    for (int k = 0; k < int(resource_kind::count); ++k)
+    {
+        std::vector<uint64_t> live, bytes;
+        for (const std::vector<resource_usage>& sample : samples)
+            live.push_back(sample[k].live), bytes.push_back(sample[k].bytes);
+
+        for (int bytes_row = 0; bytes_row < 2; ++bytes_row)
+        {
+            const std::vector<uint64_t> floors = window_floors(bytes_row ? bytes : live, warmup);
+            const bool grows = growing(floors);
+            grown += grows;
+            printf("%-8s %-6s", bytes_row ? "" : resource_kind_name(resource_kind(k)), bytes_row ? "bytes" : "live");
+            for (uint64_t floor : floors)
+                printf(" %12llu", (unsigned long long)floor);
+            printf("%s\n", grows ? "  GROWING" : "");
+        }
+    }
+
+    const std::vector<resource_usage> last = resources_snapshot();
+    printf("\n%llu bos, %llu images, %llu textures and %llu mappings made over the run\n",
+           (unsigned long long)last[int(resource_kind::bo)].created,
+           (unsigned long long)last[int(resource_kind::image)].created,
+           (unsigned long long)last[int(resource_kind::texture)].created,
+           (unsigned long long)last[int(resource_kind::mapping)].created);
+    printf("alive when the render loop ended:\n%s", resources_report().c_str());
+    if (grown)
+    {
+        printf("%d resource count%s kept growing\n", grown, grown == 1 ? "" : "s");
+        return 1;
+    }
+    printf("no growth\n");
+    return 0;
+}
@@ -0,0 +1,241 @@
+// frame interval jitter of a 60 Hz render loop and a 30 Hz camera ingest
+// while every core is kept busy, first under default scheduling and then
+// with the real-time profile: fifo or deadline, pinned, memory locked and
+// the camera frames staged on huge pages. the ingest goes through the task
+// pool like the processing thread's does, so a real-time thread waiting on
+// normal priority workers shows up in its work time.
+#include "gbm_egl_realtime.hpp"
+#include "gbm_egl_kernels.hpp"
+#include "gbm_egl_task_pool.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+static const int color_rows = 1080;
+static const size_t color_row = 1920 * 2;
+static const size_t color_size = color_rows * color_row;
+static const int depth_rows = 720;
+static const size_t depth_row = 1280 * 2;
+static const size_t depth_size = depth_rows * depth_row;
+static const size_t target_size = 1280 * 720 * 4;
+
+static double now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+static void sleep_until(double ms)
+{
+    timespec ts;
+    ts.tv_sec = time_t(ms / 1000.0);
+    ts.tv_nsec = long((ms - ts.tv_sec * 1000.0) * 1000000.0);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) != 0)
+        ;
+}
+
+
+struct loop_result
+{
+    std::vector<double> intervals;
+    std::vector<double> lateness;       // woke up this long after the deadline
+    std::vector<double> work;           // took this long for its frame
+};
+
+
+// wakes every period, does one frame of work and keeps the wake times
+static void periodic_loop(const std::atomic_bool& running, double period_ms, const std::function<void()>& frame,
+                          loop_result& out)
+{
+    double next = now_ms() + period_ms;
+    double last = 0;
+    while (running)
+    {
+        sleep_until(next);
+        const double woke = now_ms();
+        if (last > 0)
+        {
+            out.intervals.push_back(woke - last);
+            out.lateness.push_back(woke - next);
+        }
+        last = woke;
+        frame();
+        out.work.push_back(now_ms() - woke);
+        next += period_ms;
+        // fell behind by whole periods, skip them like a missed vblank would
+        while (next < now_ms())
+            next += period_ms;
+    }
+}
+
+
+// other work on the box: arithmetic and allocations on every core
+static void load_loop(const std::atomic_bool& running)
+{
+    std::vector<uint8_t> churn;
+    volatile double sink = 0;
+    while (running)
+    {
+        for (int i = 0; i < 100000; ++i)
+            sink = sink + sqrt(double(i));
+        churn.assign(size_t(rand() % 8 + 1) * 1024 * 1024, uint8_t(sink));
+        churn.clear();
+        churn.shrink_to_fit();
+    }
+}
+
+
+static void print_stats(const char* name, loop_result result)
+{
+    std::vector<double>& intervals = result.intervals;
+    if (intervals.empty())
+    {
+        printf("  %-8s no frames\n", name);
+        return;
+    }
+    double mean = 0;
+    for (double v : intervals)
+        mean += v;
+    mean /= intervals.size();
+    double variance = 0;
+    for (double v : intervals)
+        variance += (v - mean) * (v - mean);
+    variance /= intervals.size();
+    std::vector<double>& lateness = result.lateness;
+    std::vector<double>& work = result.work;
+    std::sort(intervals.begin(), intervals.end());
+    std::sort(lateness.begin(), lateness.end());
+    std::sort(work.begin(), work.end());
+    printf("  %-8s %6zu frames  interval %7.3f ms  stddev %6.3f  p99 %7.3f  max %7.3f  late p99 %6.3f max %7.3f"
+           "  work p99 %6.3f max %7.3f\n",
+           name, intervals.size(), mean, sqrt(variance),
+           intervals[size_t(intervals.size() * 0.99)], intervals.back(),
+           lateness[size_t(lateness.size() * 0.99)], lateness.back(),
+           work[size_t(work.size() * 0.99)], work.back());
+}
+
+
+// the color and depth copies side by side, each split into rows, the way
+// ingest_frameset and update_texture do it
+static void camera_frame(task_pool& pool, uint8_t* color_dst, const uint8_t* color_src,
+                         uint8_t* depth_dst, const uint8_t* depth_src)
+{
+    auto copy_rows = [&pool](uint8_t* dst, const uint8_t* src, int rows, size_t row){
+        pool.parallel_rows(rows, [&](int first, int last){
+            kernels().copy(dst + first * row, src + first * row, (last - first) * row);
+        });
+    };
+    task_group streams;
+    pool.run(streams, [&](){ copy_rows(color_dst, color_src, color_rows, color_row); });
+    pool.run(streams, [&](){ copy_rows(depth_dst, depth_src, depth_rows, depth_row); });
+    pool.wait(streams);
+}
+
+
+static void run(const char* title, double seconds, int load_threads, bool profile, rt_policy policy)
+{
+    const int cores = std::max(1, int(sysconf(_SC_NPROCESSORS_ONLN)));
+    if (profile)
+        lock_memory();
+
+    // the camera hands over frames in its own buffers, staged here
+    uint8_t* color_src = (uint8_t*)staging_alloc(color_size, profile);
+    uint8_t* color_dst = (uint8_t*)staging_alloc(color_size, profile);
+    uint8_t* depth_src = (uint8_t*)staging_alloc(depth_size, profile);
+    uint8_t* depth_dst = (uint8_t*)staging_alloc(depth_size, profile);
+    std::vector<uint8_t> target_src(target_size, 0x40), target_dst(target_size);
+    if (!color_src || !color_dst || !depth_src || !depth_dst)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    if (profile)
+        prefault(target_dst.data(), target_size);
+
+    // workers at normal priority, like the device's
+    task_pool pool;
+    pool.start();
+    const int pool_threads = pool.size();
+
+    std::atomic_bool running {true};
+    std::vector<std::thread> load;
+    for (int i = 0; i < load_threads; ++i)
+        load.emplace_back(load_loop, std::cref(running));
+
+    loop_result render, ingest;
+    std::thread render_thread([&](){
+        if (profile)
+        {
+            thread_profile p;
+            p.policy = policy;
+            p.priority = 50;
+            p.period_ms = 1000.0 / 60.0;
+            p.runtime_ms = p.period_ms * 0.5;
+            p.cpu = cores - 1;
+            apply_thread_profile("render", p);
+        }
+        periodic_loop(running, 1000.0 / 60.0, [&](){
+            kernels().copy(target_dst.data(), target_src.data(), target_size);
+        }, render);
+    });
+    std::thread ingest_thread([&](){
+        if (profile)
+        {
+            thread_profile p;
+            p.policy = policy;
+            p.priority = 51;
+            p.period_ms = 1000.0 / 30.0;
+            p.runtime_ms = p.period_ms * 0.25;
+            p.cpu = cores > 1 ? cores - 2 : 0;
+            apply_thread_profile("ingest", p);
+        }
+        periodic_loop(running, 1000.0 / 30.0, [&](){
+            camera_frame(pool, color_dst, color_src, depth_dst, depth_src);
+        }, ingest);
+    });
+
+    sleep_until(now_ms() + seconds * 1000.0);
+    running = false;
+    render_thread.join();
+    ingest_thread.join();
+    for (std::thread& t : load)
+        t.join();
+    pool.stop();
+
+    printf("%s, %d pool threads\n", title, pool_threads);
+    print_stats("render", render);
+    print_stats("ingest", ingest);
+
+    staging_free(color_src, color_size);
+    staging_free(color_dst, color_size);
+    staging_free(depth_src, depth_size);
+    staging_free(depth_dst, depth_size);
+    if (profile)
+        munlockall();
+}
+
+
+int main(int argc, char* argv[])
+{
+    const double seconds = argc > 1 ? atof(argv[1]) : 10.0;
+    const rt_policy policy = argc > 2 ? parse_rt_policy(argv[2]) : rt_policy::fifo;
+    const int load_threads = argc > 3 ? atoi(argv[3]) : int(sysconf(_SC_NPROCESSORS_ONLN));
+
+    printf("kernels: %s, %d load threads, %.0f s per run\n", kernels().name, load_threads, seconds);
+    run("default scheduling", seconds, load_threads, false, rt_policy::none);
+    run(policy == rt_policy::deadline ? "real-time profile (deadline, mlock, huge pages)"
+                                      : "real-time profile (fifo, pinned, mlock, huge pages)",
+        seconds, load_threads, true, policy);
+    return 0;
+}
@@ -0,0 +1,97 @@
+// per-frame cpu stages of the camera path on 1, 2, 4 and 8 cores: the color
+// and depth copies side by side, and the rgb expansion split into rows
+#include "gbm_egl_task_pool.hpp"
+#include "gbm_egl_kernels.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static double now_ms()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+struct frame_buffers
+{
+    std::vector<uint8_t> color_src = std::vector<uint8_t>(1920 * 1080 * 2, 0x80);
+    std::vector<uint8_t> depth_src = std::vector<uint8_t>(1280 * 720 * 2, 0x40);
+    std::vector<uint8_t> rgb_src = std::vector<uint8_t>(1920 * 1080 * 3, 0x20);
+    std::vector<uint8_t> color_dst = std::vector<uint8_t>(1920 * 1080 * 2);
+    std::vector<uint8_t> depth_dst = std::vector<uint8_t>(1280 * 720 * 2);
+    std::vector<uint8_t> rgbx_dst = std::vector<uint8_t>(1920 * 1080 * 4);
+};
+
+
+static void copy_rows(task_pool& pool, uint8_t* dst, const uint8_t* src, int rows, size_t row)
+{
+    pool.parallel_rows(rows, [&](int first, int last){
+        kernels().copy(dst + first * row, src + first * row, (last - first) * row);
+    });
+}
+
+
+// what the processing thread does for one frameset
+static void camera_frame(task_pool& pool, frame_buffers& b)
+{
+    task_group streams;
+    pool.run(streams, [&](){ copy_rows(pool, b.color_dst.data(), b.color_src.data(), 1080, 1920 * 2); });
+    pool.run(streams, [&](){ copy_rows(pool, b.depth_dst.data(), b.depth_src.data(), 720, 1280 * 2); });
+    pool.wait(streams);
+}
+
+
+static void rgb_frame(task_pool& pool, frame_buffers& b)
+{
+    pool.parallel_rows(1080, [&](int first, int last){
+        for (int y = first; y < last; ++y)
+            kernels().rgb_to_rgbx(b.rgbx_dst.data() + y * 1920 * 4, b.rgb_src.data() + y * 1920 * 3, 1920);
+    });
+}
+
+
+template <typename Stage>
+static double time_stage(task_pool& pool, frame_buffers& b, int frames, Stage stage)
+{
+    stage(pool, b);
+    const double start = now_ms();
+    for (int i = 0; i < frames; ++i)
+        stage(pool, b);
+    return (now_ms() - start) / frames;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const int frames = argc > 1 ? atoi(argv[1]) : 200;
+    const bool pin = !(argc > 2 && strcmp(argv[2], "nopin") == 0);
+
+    frame_buffers buffers;
+    printf("kernels: %s, %zu big cores, %d frames%s\n", kernels().name, task_pool::big_cores().size(),
+           frames, pin ? "" : ", unpinned");
+    printf("%5s  %18s  %18s\n", "cores", "yuyv+z16 copy ms", "rgb to rgbx ms");
+
+    double base_copy = 0, base_rgb = 0;
+    for (int cores : { 1, 2, 4, 8 })
+    {
+        task_pool pool;
+        pool.start(cores, pin);
+        const double copy = time_stage(pool, buffers, frames, camera_frame);
+        const double rgb = time_stage(pool, buffers, frames, rgb_frame);
+        if (cores == 1)
+            base_copy = copy, base_rgb = rgb;
+        printf("%5d  %8.3f (x%5.2f)  %8.3f (x%5.2f)\n", cores, copy, base_copy / copy, rgb, base_rgb / rgb);
+    }
+
+    // the copies must have landed whatever the split
+    const bool ok = memcmp(buffers.color_dst.data(), buffers.color_src.data(), buffers.color_src.size()) == 0 &&
+                    memcmp(buffers.depth_dst.data(), buffers.depth_src.data(), buffers.depth_src.size()) == 0 &&
+                    buffers.rgbx_dst[3] == 0xff && buffers.rgbx_dst.back() == 0xff;
+    if (!ok)
+        fprintf(stderr, "output mismatch\n");
+    return ok ? 0 : 1;
+}
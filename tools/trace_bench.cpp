@@ -0,0 +1,96 @@
+// cost of a trace event on the calling thread: spans with tracing off, then
+// spans and counters with it on while the writer drains into a file. each
+// round fills a quarter of the ring and waits for the writer to empty it,
+// so nothing is dropped. fails when an event takes longer than the budget
+// or a thread that never traced got a ring.
+#include "gbm_egl_trace.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const double budget_ns = 50.0;
+static const int spans = trace_buffer::capacity / 8;
+
+
+// ns per event of each round, sorted
+template <typename Body>
+static std::vector<double> measure(int rounds, int events_per_round, Body body)
+{
+    std::vector<double> results;
+    for (int r = 0; r < rounds; ++r)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        results.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+                          events_per_round);
+
+        // the writer drains every 50 ms
+        while (trace_local && trace_local->tail.load() != trace_local->head.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::sort(results.begin(), results.end());
+    return results;
+}
+
+
+static bool report(const char* name, const std::vector<double>& results, bool budgeted)
+{
+    const double median = results[results.size() / 2];
+    const bool ok = !budgeted || median <= budget_ns;
+    printf("  %-14s median %6.1f ns  p99 %6.1f ns  max %6.1f ns%s\n", name, median,
+           results[size_t(results.size() * 0.99)], results.back(), ok ? "" : "  OVER BUDGET");
+    return ok;
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : "/tmp/gbm-egl-trace-bench.json";
+    const int rounds = argc > 2 ? atoi(argv[2]) : 100;
+    if (rounds <= 0)
+    {
+        fprintf(stderr, "usage: gbm-egl-trace-bench [trace.json] [rounds]\n");
+        return 2;
+    }
+
+    trace_init(path, false);
+    trace_thread_name("trace bench");
+    printf("%d rounds of %d spans, budget %.0f ns per event\n", rounds, spans, budget_ns);
+
+    // every event reads the tick counter once
+    bool ok = true;
+    volatile uint64_t sink = 0;
+    ok &= report(trace_counter_ticks ? "ticks" : "clock", measure(rounds, spans, [&sink](){
+        for (int i = 0; i < spans; ++i)
+            sink = sink + trace_ticks();
+    }), false);
+    ok &= report("span, off", measure(rounds, 2 * spans, [](){
+        for (int i = 0; i < spans; ++i)
+            trace_span span("bench span");
+    }), false);
+    if (trace_local)
+    {
+        printf("a ring was made while tracing was off\n");
+        ok = false;
+    }
+
+    trace_enabled = true;
+    ok &= report("span, on", measure(rounds, 2 * spans, [](){
+        for (int i = 0; i < spans; ++i)
+            trace_span span("bench span");
+    }), true);
+    ok &= report("counter, on", measure(rounds, spans, [](){
+        for (int i = 0; i < spans; ++i)
+            trace_counter("bench counter", i);
+    }), true);
+
+    const uint64_t dropped = trace_local ? trace_local->dropped.load() : 0;
+    if (dropped)
+        printf("%llu events dropped\n", (unsigned long long)dropped);
+    trace_enabled = false;
+    trace_shutdown();
+    return ok ? 0 : 1;
+}
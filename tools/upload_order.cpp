@@ -0,0 +1,330 @@
+// checks the upload thread's handoff on a render node. jobs of very
+// different cost are submitted so they would finish out of order if they
+// could, several of them onto the same texture, some from completions, all
+// while the render thread polls like a frame loop. it checks that
+// - completions run once each, in submit order
+// - a ticket reads as ready (ticket <= completed(), what texture_ready
+//   asks) only once its completion ran, and from then on
+// - once an upload reads as ready the render context sees its pixels, and
+//   the last of the uploads onto one texture wins
+// - finish() leaves nothing outstanding
+// and once more without a worker, where every job completes in submit().
+// usage: gbm-egl-upload-order [/dev/dri/renderD128 | surfaceless]
+#include "gbm_egl_uploader.hpp"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <gbm.h>
+#define EGL_EGLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int job_count = 96;
+static const int large = 1024;
+static const int small = 64;
+
+static std::vector<std::string> errors;
+
+static void expect(bool condition, const std::string& what)
+{
+    if (!condition)
+        errors.push_back(what);
+}
+
+
+struct gl_setup
+{
+    int fd = -1;
+    gbm_device* gbm = nullptr;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLConfig config = nullptr;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+
+// a surfaceless gles2 context on the node, like the offscreen mode has.
+// "surfaceless" takes mesa's software renderer, no gpu needed
+static bool make_context(const char* node, gl_setup& gl)
+{
+    if (strcmp(node, "surfaceless") == 0)
+        gl.display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    else
+    {
+        gl.fd = open(node, O_RDWR | O_CLOEXEC);
+        if (gl.fd < 0 || !(gl.gbm = gbm_create_device(gl.fd)))
+        {
+            fprintf(stderr, "cannot open %s\n", node);
+            return false;
+        }
+        gl.display = eglGetPlatformDisplayEXT(EGL_PLATFORM_GBM_KHR, gl.gbm, nullptr);
+    }
+    EGLint major, minor, n = 0;
+    if (!eglInitialize(gl.display, &major, &minor) || !eglBindAPI(EGL_OPENGL_ES_API))
+    {
+        fprintf(stderr, "cannot initialize egl on %s\n", node);
+        return false;
+    }
+    const char* extensions = eglQueryString(gl.display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+    {
+        fprintf(stderr, "no EGL_KHR_surfaceless_context on %s\n", node);
+        return false;
+    }
+    const EGLint config_attribs[] = {
+        EGL_RED_SIZE, 1,
+        EGL_GREEN_SIZE, 1,
+        EGL_BLUE_SIZE, 1,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+    const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    if (!eglChooseConfig(gl.display, config_attribs, &gl.config, 1, &n) || n != 1 ||
+        (gl.context = eglCreateContext(gl.display, gl.config, EGL_NO_CONTEXT, context_attribs)) == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(gl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, gl.context))
+    {
+        fprintf(stderr, "cannot make a gles2 context current on %s\n", node);
+        return false;
+    }
+    return true;
+}
+
+
+static void destroy_context(gl_setup& gl)
+{
+    if (gl.context != EGL_NO_CONTEXT)
+    {
+        eglMakeCurrent(gl.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(gl.display, gl.context);
+    }
+    if (gl.display != EGL_NO_DISPLAY)
+        eglTerminate(gl.display);
+    if (gl.gbm)
+        gbm_device_destroy(gl.gbm);
+    if (gl.fd >= 0)
+        close(gl.fd);
+}
+
+
+static GLuint create_texture(int size)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+
+// the red channel of one texel, as the render context sees it now
+static int read_texel(GLuint texture, int x, int y)
+{
+    GLuint fbo = 0;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    uint8_t texel[4] = {};
+    glReadPixels(x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    return texel[0];
+}
+
+
+static std::vector<uint8_t> filled(int size, int value)
+{
+    std::vector<uint8_t> pixels(size_t(size) * size * 4, uint8_t(value));
+    for (size_t i = 3; i < pixels.size(); i += 4)
+        pixels[i] = 255;
+    return pixels;
+}
+
+
+struct order_check
+{
+    texture_uploader& uploader;
+    std::vector<uint64_t> submitted;
+    std::vector<uint64_t> completed;
+
+    // ready means every earlier completion ran and this one is running
+    std::function<void()> on_ready(uint64_t ticket, std::function<void()> then = nullptr)
+    {
+        return [this, ticket, then](){
+            expect(uploader.completed() + 1 == ticket, "ticket " + std::to_string(ticket) + " completed after " +
+                                                       std::to_string(uploader.completed()));
+            completed.push_back(ticket);
+            if (then)
+                then();
+        };
+    }
+
+    // the ticket submit() is about to hand out, the completion has to know it
+    uint64_t next() const { return uploader.submitted() + 1; }
+
+    void check_ready() const
+    {
+        for (uint64_t ticket : submitted)
+        {
+            const bool ready = ticket <= uploader.completed();
+            const bool ran = std::find(completed.begin(), completed.end(), ticket) != completed.end();
+            expect(ready == ran, "ticket " + std::to_string(ticket) + (ready ? " ready before its completion ran"
+                                                                            : " not ready after its completion ran"));
+        }
+    }
+};
+
+
+// costly and cheap jobs mixed, on the worker and on the gpu
+static void mixed_jobs(texture_uploader& uploader)
+{
+    order_check check {uploader};
+    std::vector<GLuint> textures = { create_texture(large), create_texture(large), create_texture(small) };
+
+    for (int i = 0; i < job_count; ++i)
+    {
+        const uint64_t ticket = check.next();
+        check.submitted.push_back(ticket);
+        uint64_t returned = 0;
+        switch (i % 4)
+        {
+        case 0:
+            // large with mipmaps, the gpu is busy with it for a while
+            returned = uploader.upload_texture(textures[i / 4 % 2], large, large, filled(large, i), true,
+                                               check.on_ready(ticket));
+            break;
+        case 1:
+            returned = uploader.submit([](){}, check.on_ready(ticket));
+            break;
+        case 2:
+            // slow on the worker, nothing for the gpu
+            returned = uploader.submit([](){ std::this_thread::sleep_for(std::chrono::milliseconds(3)); },
+                                       check.on_ready(ticket));
+            break;
+        default:
+        {
+            // a completion that submits, like the texture swap does
+            const GLuint texture = textures[2];
+            returned = uploader.upload_texture(texture, small, small, filled(small, i), false,
+                check.on_ready(ticket, [&check, &uploader, texture, i](){
+                    const uint64_t follow = check.next();
+                    check.submitted.push_back(follow);
+                    expect(uploader.submit([](){}, check.on_ready(follow)) == follow, "follow-up ticket out of sequence");
+                }));
+            break;
+        }
+        }
+        expect(returned == ticket, "submit returned " + std::to_string(returned) + " for " + std::to_string(ticket));
+
+        // a frame every few submits
+        if (i % 3 == 2)
+        {
+            uploader.poll();
+            check.check_ready();
+        }
+    }
+
+    // polling alone gets everything done, like frames do
+    const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (uploader.completed() < uploader.submitted() && std::chrono::steady_clock::now() < give_up)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        uploader.poll();
+        check.check_ready();
+    }
+    expect(uploader.completed() == uploader.submitted(), "polling left " +
+           std::to_string(uploader.submitted() - uploader.completed()) + " jobs outstanding");
+    uploader.finish();
+
+    expect(check.completed == check.submitted, "completions do not match submissions one to one and in order");
+    printf("mixed: %zu jobs, %zu completions\n", check.submitted.size(), check.completed.size());
+    glDeleteTextures(textures.size(), textures.data());
+}
+
+
+// uploads onto one texture back to back, each sees its own or a later value
+static void overlapping_uploads(texture_uploader& uploader)
+{
+    order_check check {uploader};
+    const GLuint texture = create_texture(large);
+    const int uploads = 16;
+    int lowest_seen = 255;
+    for (int k = 1; k <= uploads; ++k)
+    {
+        const uint64_t ticket = check.next();
+        check.submitted.push_back(ticket);
+        uploader.upload_texture(texture, large, large, filled(large, k * 10), k % 2 == 0,
+            check.on_ready(ticket, [texture, k, &lowest_seen](){
+                const int seen = read_texel(texture, large - 1, large - 1);
+                expect(seen >= k * 10, "upload " + std::to_string(k) + " ready but the texture holds " + std::to_string(seen));
+                lowest_seen = std::min(lowest_seen, seen);
+            }));
+        if (k % 4 == 0)
+            uploader.poll();
+    }
+    uploader.finish();
+    check.check_ready();
+
+    const int last = read_texel(texture, 0, 0);
+    expect(last == uploads * 10, "after finish the texture holds " + std::to_string(last) + ", not the last upload");
+    expect(check.completed == check.submitted, "overlapping completions out of order");
+    printf("overlapping: %d uploads onto one texture, first completion saw %d, last value %d\n",
+           uploads, lowest_seen, last);
+    glDeleteTextures(1, &texture);
+}
+
+
+// without a worker every job has completed by the time submit() returns
+static void inline_jobs()
+{
+    texture_uploader uploader;
+    order_check check {uploader};
+    for (int i = 0; i < 8; ++i)
+    {
+        const uint64_t ticket = check.next();
+        check.submitted.push_back(ticket);
+        uploader.submit([](){}, check.on_ready(ticket));
+        expect(uploader.completed() == ticket, "inline job " + std::to_string(ticket) + " not complete after submit");
+    }
+    check.check_ready();
+    expect(check.completed == check.submitted, "inline completions out of order");
+    printf("inline: %zu jobs\n", check.completed.size());
+}
+
+
+int main(int argc, char* argv[])
+{
+    const char* node = argc > 1 ? argv[1] : "/dev/dri/renderD128";
+
+    inline_jobs();
+
+    gl_setup gl;
+    if (!make_context(node, gl))
+    {
+        destroy_context(gl);
+        return 2;
+    }
+    texture_uploader uploader;
+    if (!uploader.init(gl.display, gl.config, gl.context))
+    {
+        destroy_context(gl);
+        return 2;
+    }
+    mixed_jobs(uploader);
+    overlapping_uploads(uploader);
+    uploader.print();
+    uploader.shutdown();
+    destroy_context(gl);
+
+    for (const std::string& error : errors)
+        fprintf(stderr, "%s\n", error.c_str());
+    printf("%zu errors\n", errors.size());
+    return errors.empty() ? 0 : 1;
+}